@@ -0,0 +1,151 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <cstdio>
+#include <string>
+#include "raytracer.h"
+#include "parallel.h"
+
+/*
+Out-of-core rendering of images too large to fit in memory.
+The image is rendered in horizontal bands of rows, and each band is written to the PPM
+file as soon as all its rows are done, so the whole image is never in memory: only
+n_buffers band buffers of (at most) band_bytes each are allocated.
+
+Worker threads take rows one at a time from a shared counter, across band boundaries,
+while a writer thread writes the completed bands in order. A worker has to wait only
+when all the band buffers are taken by bands not yet written, i.e. when the disk is
+slower than the rendering.
+*/
+struct banded_renderer {
+	banded_renderer(int _w, int _h, size_t band_bytes, int _n_buffers = 3) :w(_w), h(_h), n_buffers(std::max(1, _n_buffers)) {
+		band_rows = (int)std::max<size_t>(1, band_bytes / (size_t(w) * 3));
+		band_rows = std::min(band_rows, h);
+		n_bands = (h + band_rows - 1) / band_rows;
+	}
+
+	int w, h;
+	int band_rows;	// rows per band
+	int n_bands;
+	int n_buffers;	// band buffers in memory
+
+	// memory used for the pixels
+	size_t memory_bytes() const { return size_t(n_buffers) * band_rows * w * 3; }
+
+	/* render the image and write it to filename as binary (P6) or ASCII (P3) PPM.
+	*  shade(i,j) returns the color of pixel (i,j), with (0,0) bottom left as in the other examples.
+	*/
+	template <class SHADE>
+	bool render(const char* filename, SHADE shade, bool ascii = false, int n_threads = n_hardware_threads()) {
+		FILE* f = fopen(filename, "wb");
+		if (!f) {
+			std::cout << "Error: cannot open " << filename << std::endl;
+			return false;
+		}
+		fprintf(f, "%s\n%d %d\n255\n", ascii ? "P3" : "P6", w, h);
+
+		buffers.assign(n_buffers, std::vector<unsigned char>(size_t(band_rows) * w * 3));
+		free_buffers.clear();
+		for (int i = 0; i < n_buffers; ++i)
+			free_buffers.push_back(i);
+		band_buffer.assign(n_bands, -1);
+		band_done = std::vector<std::atomic<int>>(n_bands);
+		for (auto& c : band_done)
+			c = 0;
+		next_assign = 0;
+
+		std::thread writer(&banded_renderer::write_bands, this, f, ascii);
+
+		// rows are numbered from the top, as they are stored in the file
+		parallel_for(h, [&](int y) {
+			int b = y / band_rows;
+			unsigned char* row = &buffers[acquire_buffer(b)][size_t(y - b * band_rows) * w * 3];
+			int j = h - 1 - y;
+			for (int i = 0; i < w; ++i) {
+				p3 c = shade(i, j);
+				row[i * 3] = (unsigned char)std::min(255.f, std::max(0.f, c.x));
+				row[i * 3 + 1] = (unsigned char)std::min(255.f, std::max(0.f, c.y));
+				row[i * 3 + 2] = (unsigned char)std::min(255.f, std::max(0.f, c.z));
+			}
+			if (++band_done[b] == rows_in_band(b)) {
+				std::lock_guard<std::mutex> lock(m);
+				cv.notify_all();
+			}
+		}, n_threads);
+
+		writer.join();
+		bool ok = !ferror(f);
+		fclose(f);
+		buffers.clear();
+		return ok;
+	}
+
+private:
+	int rows_in_band(int b) const { return std::min(band_rows, h - b * band_rows); }
+
+	/* buffer of band b, waiting for a free one if the band has none yet.
+	*  Buffers are assigned in band order: the first band not yet written always gets one
+	*  before the following bands, so the workers cannot block the writer.
+	*/
+	int acquire_buffer(int b) {
+		std::unique_lock<std::mutex> lock(m);
+		bool assigned = false;
+		while (band_buffer[b] < 0) {
+			if (!free_buffers.empty()) {
+				band_buffer[next_assign++] = free_buffers.front();
+				free_buffers.pop_front();
+				assigned = true;
+			}
+			else
+				cv.wait(lock);
+		}
+		if (assigned)
+			cv.notify_all();
+		return band_buffer[b];
+	}
+
+	// writer thread: writes the bands in order, as they are completed, and recycles their buffers
+	void write_bands(FILE* f, bool ascii) {
+		std::string text;
+		for (int b = 0; b < n_bands; ++b) {
+			int buf;
+			{
+				std::unique_lock<std::mutex> lock(m);
+				cv.wait(lock, [&] { return band_done[b] == rows_in_band(b); });
+				buf = band_buffer[b];
+			}
+
+			size_t n = size_t(rows_in_band(b)) * w * 3;
+			const unsigned char* data = &buffers[buf][0];
+			if (!ascii)
+				fwrite(data, 1, n, f);
+			else {
+				// one pixel per line, as image::save
+				text.clear();
+				char tmp[16];
+				for (size_t i = 0; i < n; i += 3) {
+					int l = snprintf(tmp, sizeof(tmp), "%d %d %d\n", data[i], data[i + 1], data[i + 2]);
+					text.append(tmp, l);
+				}
+				fwrite(text.data(), 1, text.size(), f);
+			}
+
+			std::lock_guard<std::mutex> lock(m);
+			free_buffers.push_back(buf);
+			cv.notify_all();
+		}
+	}
+
+	std::vector<std::vector<unsigned char>> buffers;
+	std::vector<std::atomic<int>> band_done;	// rows completed in each band
+
+	// protected by m
+	std::mutex m;
+	std::condition_variable cv;
+	std::deque<int> free_buffers;
+	std::vector<int> band_buffer;	// buffer assigned to each band (-1: none yet)
+	int next_assign;				// first band without a buffer
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <vector>
+#include <random>
+#include <string>
+#include "raytracer.h"
+#include "parallel.h"
+#include "render_kernel.h"
+
+/*
+Reconstruction filters for antialiasing. Instead of averaging the samples inside each pixel
+(box filter), every sample is splatted, with weight f(dx)*f(dy), into all the pixels whose
+center is within the radius of the filter, and each pixel is the weighted average of the
+samples it received.
+The 1D filters are precomputed in tables (filter_table). The image is rendered by tiles in
+parallel, and every tile splats into its own buffer, larger than the tile by a guard band as
+wide as the filter: no two threads ever write the same memory, so no locks or atomics are
+needed. resolve() then adds up the overlapping guard bands into the image.
+*/
+
+enum filter_kind {
+	FILTER_BOX,				// radius 0.5: the plain average of the samples in the pixel
+	FILTER_GAUSSIAN,		// radius 1.5, exp(-2 x^2) shifted to 0 at the radius
+	FILTER_MITCHELL,		// radius 2, Mitchell-Netravali with B = C = 1/3
+	FILTER_BLACKMAN_HARRIS	// radius 2, 4-term Blackman-Harris window
+};
+
+inline const char* filter_name(filter_kind k) {
+	const char* names[] = { "box", "gaussian", "mitchell", "blackman-harris" };
+	return names[k];
+}
+
+struct filter_table {
+	static const int SIZE = 64;	// entries over [0, radius)
+
+	filter_table(filter_kind k = FILTER_BOX) :kind(k) {
+		const float radii[] = { 0.5f, 1.5f, 2.f, 2.f };
+		radius = radii[k];
+		for (int i = 0; i < SIZE; ++i)
+			table[i] = eval((i + 0.5f) * radius / SIZE);
+	}
+
+	filter_kind kind;
+	float radius;
+	float table[SIZE];
+
+	// weight of a sample at (dx, dy) from the center of a pixel
+	float weight(float dx, float dy) const {
+		int ix = (int)(fabs(dx) * (SIZE / radius)), iy = (int)(fabs(dy) * (SIZE / radius));
+		return (ix < SIZE && iy < SIZE) ? table[ix] * table[iy] : 0.f;
+	}
+
+	// the 1D filter at distance x (in pixels) from the center
+	float eval(float x) const {
+		x = fabs(x);
+		switch (kind) {
+		case FILTER_GAUSSIAN:
+			return std::max(0.f, exp(-2.f * x * x) - exp(-2.f * radius * radius));
+		case FILTER_MITCHELL: {
+			const float B = 1.f / 3.f, C = 1.f / 3.f;
+			if (x < 1.f)
+				return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.f;
+			if (x < 2.f)
+				return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.f;
+			return 0.f;
+		}
+		case FILTER_BLACKMAN_HARRIS: {
+			const float pi = 3.14159265f;
+			float t = 0.5f + x / (2 * radius);	// window over [-radius, radius] -> [0, 1]
+			return 0.35875f - 0.48829f * cos(2 * pi * t) + 0.14128f * cos(4 * pi * t) - 0.01168f * cos(6 * pi * t);
+		}
+		default:
+			return (x < 0.5f) ? 1.f : 0.f;
+		}
+	}
+};
+
+/*
+Film of w x h pixels split in tiles of TILE x TILE, each with its own buffer of
+(TILE + 2 guard)^2 pixels holding the weighted sum of the colors and the sum of the weights.
+A tile must only be written by one thread at a time.
+*/
+struct filtered_film {
+	static const int TILE = 16;
+
+	filtered_film(int _w, int _h, const filter_table& _f) :w(_w), h(_h), f(_f) {
+		guard = (int)ceil(f.radius + 0.5f);
+		side = TILE + 2 * guard;
+		tiles_x = (w + TILE - 1) / TILE;
+		tiles_y = (h + TILE - 1) / TILE;
+		buffer.assign(size_t(tiles_x) * tiles_y * side * side * 4, 0.f);
+	}
+
+	int w, h;
+	int tiles_x, tiles_y;
+
+	int n_tiles() const { return tiles_x * tiles_y; }
+
+	// adds a sample of color col at (x, y) (in pixels, (0,0) bottom left) inside tile t
+	void splat(int t, float x, float y, p3 col) {
+		int ox = (t % tiles_x) * TILE - guard, oy = (t / tiles_x) * TILE - guard;	// pixel of buffer[0]
+		int i0 = std::max(0, (int)floor(x - 0.5f - f.radius) + 1), i1 = std::min(w - 1, (int)floor(x - 0.5f + f.radius));
+		int j0 = std::max(0, (int)floor(y - 0.5f - f.radius) + 1), j1 = std::min(h - 1, (int)floor(y - 0.5f + f.radius));
+		float* tile = &buffer[size_t(t) * side * side * 4];
+		for (int j = j0; j <= j1; ++j)
+			for (int i = i0; i <= i1; ++i) {
+				float wt = f.weight(i + 0.5f - x, j + 0.5f - y);
+				float* px = tile + ((j - oy) * side + (i - ox)) * 4;
+				px[0] += col.x * wt;
+				px[1] += col.y * wt;
+				px[2] += col.z * wt;
+				px[3] += wt;
+			}
+	}
+
+	// adds up the tiles (guard bands included) and writes the averages into a
+	void resolve(image& a) const {
+		parallel_for(h, [&](int j) {
+			std::vector<float> row(w * 4, 0.f);
+			for (int ty = std::max(0, (j - TILE - guard + 1) / TILE); ty < tiles_y && ty * TILE - guard <= j; ++ty) {
+				int y = j - (ty * TILE - guard);
+				if (y >= side)
+					continue;
+				for (int tx = 0; tx < tiles_x; ++tx) {
+					int ox = tx * TILE - guard;
+					const float* src = &buffer[(size_t(ty * tiles_x + tx) * side + y) * side * 4];
+					for (int x = std::max(0, -ox); x < side && ox + x < w; ++x)
+						for (int c = 0; c < 4; ++c)
+							row[(ox + x) * 4 + c] += src[x * 4 + c];
+				}
+			}
+			for (int i = 0; i < w; ++i) {
+				float* px = &row[i * 4];
+				float s = (px[3] > 0.f) ? 1.f / px[3] : 0.f;
+				a.set_pixel(i, j, std::min(255.f, std::max(0.f, px[0] * s)), std::min(255.f, std::max(0.f, px[1] * s)),
+					std::min(255.f, std::max(0.f, px[2] * s)));
+			}
+		});
+	}
+
+private:
+	filter_table f;
+	int guard, side;
+	std::vector<float> buffer;
+};
+
+// renders scene into a with n_samples stratified samples per pixel, reconstructed with the filter k
+template <class SCENE>
+void render_filtered(image& a, const SCENE& scene, const camera& cam, p3 Lp, int n_samples, filter_kind k, unsigned int seed = 0) {
+	filtered_film film(a.w, a.h, filter_table(k));
+	parallel_for(film.n_tiles(), [&](int t) {
+		std::mt19937 gen(seed * 7919u + t);	// one sequence per tile
+		int i0 = (t % film.tiles_x) * filtered_film::TILE, j0 = (t / film.tiles_x) * filtered_film::TILE;
+		for (int j = j0; j < std::min(j0 + filtered_film::TILE, (int)a.h); ++j)
+			for (int i = i0; i < std::min(i0 + filtered_film::TILE, (int)a.w); ++i)
+				for (int s = 0; s < n_samples; ++s) {
+					float du, dv;
+					pixel_sample<SAMPLER_STRATIFIED>(s, n_samples, gen, du, dv);
+					float x = i + 0.5f + du, y = j + 0.5f + dv;
+					film.splat(t, x, y, shade<true>(cam.primary(x / a.w, y / a.h), scene, Lp));
+				}
+	});
+	film.resolve(a);
+}
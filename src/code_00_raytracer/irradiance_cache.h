@@ -0,0 +1,284 @@
+#pragma once
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <random>
+#include <cstdio>
+#include "raytracer.h"
+
+/*
+Irradiance caching (Ward et al. 1988, gradients from Ward & Heckbert 1992).
+
+Diffuse indirect irradiance changes slowly over a surface, so it is computed with a full
+hemisphere of rays only at some points (records) and interpolated everywhere else.
+Each record stores position, normal, irradiance, the harmonic mean distance R of the
+surfaces seen from it and the rotational and translational gradients of the irradiance.
+A record is used at point p with normal n if its weight
+	w = 1 / ( |p - pi| / Ri + sqrt(1 - n.ni) )
+is larger than 1/a (a = error threshold); the gradients extrapolate its irradiance to p.
+
+Records are kept in an octree; lookups take a shared lock, insertions an exclusive one,
+so many threads can shade in parallel. The records only depend on the scene, not on the
+camera, so a cache can be kept (or saved and loaded) across the frames of a fly-through.
+*/
+
+struct irradiance_record {
+	p3 p, n;		// position and normal
+	p3 E;			// irradiance (per color channel)
+	float R;		// harmonic mean distance to the surfaces seen
+	p3 grad_r[3];	// rotational gradient of each channel
+	p3 grad_t[3];	// translational gradient of each channel
+};
+
+struct irradiance_cache {
+	irradiance_cache(p3 bmin, p3 bmax, float _a = 0.2f, int _theta_samples = 8, int _phi_samples = 32)
+		:a(_a), M(_theta_samples), N(_phi_samples), min_R(0.05f), max_R(2.f), lookups(0), hits(0) {
+		p3 c = (bmin + bmax) * 0.5f;
+		p3 e = bmax - bmin;
+		root.reset(new node(c, std::max(e.x, std::max(e.y, e.z)) * 0.5f));
+	}
+
+	float a;		// error threshold
+	int M, N;		// stratification of the hemisphere: M in theta, N in phi
+	float min_R, max_R;	// clamp of the record radius
+
+	size_t size() {
+		std::shared_lock<std::shared_mutex> lock(m);
+		return records.size();
+	}
+
+	/* irradiance at p with normal n. Interpolated from the cache if possible, otherwise a new
+	*  record is computed with radiance(ray, hit_distance&), which must return the radiance
+	*  arriving along the ray and the distance of the surface hit (FAR_AWAY if none)
+	*/
+	template <class RADIANCE>
+	p3 irradiance(p3 p, p3 n, RADIANCE radiance) {
+		++lookups;
+		p3 E;
+		{
+			std::shared_lock<std::shared_mutex> lock(m);
+			if (interpolate(p, n, E)) {
+				++hits;
+				return E;
+			}
+		}
+		irradiance_record rec = compute_record(p, n, radiance);
+		{
+			std::unique_lock<std::shared_mutex> lock(m);
+			records.push_back(rec);
+			insert(root.get(), &records.back());
+		}
+		return rec.E;
+	}
+
+	float hit_rate() const { return lookups ? float(hits) / lookups : 0.f; }
+
+	// the records do not depend on the view: save them to reuse them in another run
+	bool save(const char* filename) {
+		std::shared_lock<std::shared_mutex> lock(m);
+		FILE* f = fopen(filename, "wb");
+		if (!f) return false;
+		size_t n = records.size();
+		fwrite(&n, sizeof(n), 1, f);
+		for (const irradiance_record& r : records)
+			fwrite(&r, sizeof(r), 1, f);
+		fclose(f);
+		return true;
+	}
+
+	bool load(const char* filename) {
+		FILE* f = fopen(filename, "rb");
+		if (!f) return false;
+		size_t n = 0;
+		bool ok = fread(&n, sizeof(n), 1, f) == 1;
+		std::unique_lock<std::shared_mutex> lock(m);
+		for (size_t i = 0; ok && i < n; ++i) {
+			irradiance_record r;
+			ok = fread(&r, sizeof(r), 1, f) == 1;
+			if (ok) {
+				records.push_back(r);
+				insert(root.get(), &records.back());
+			}
+		}
+		fclose(f);
+		return ok;
+	}
+
+private:
+	struct node {
+		node(p3 c, float h) :center(c), half(h) {}
+		p3 center;
+		float half;
+		std::vector<const irradiance_record*> recs;
+		std::unique_ptr<node> child[8];
+	};
+
+	std::shared_mutex m;
+	std::deque<irradiance_record> records; // a deque does not move its elements when it grows
+	std::unique_ptr<node> root;
+	std::atomic<long long> lookups, hits;
+
+	// validity radius of a record: beyond it the weight is always below 1/a
+	float radius(const irradiance_record& r) const { return r.R * a; }
+
+	/* a record is stored in the smallest node containing its center whose size is still
+	*  larger than its validity radius; it can only be used at points within that radius,
+	*  i.e. in the node or in its neighbours
+	*/
+	void insert(node* nd, const irradiance_record* r) {
+		float rad = radius(*r);
+		while (nd->half > 2 * rad) {
+			int ci = (r->p.x > nd->center.x) | ((r->p.y > nd->center.y) << 1) | ((r->p.z > nd->center.z) << 2);
+			if (!nd->child[ci]) {
+				float h = nd->half * 0.5f;
+				p3 c = nd->center + p3((ci & 1) ? h : -h, (ci & 2) ? h : -h, (ci & 4) ? h : -h);
+				nd->child[ci].reset(new node(c, h));
+			}
+			nd = nd->child[ci].get();
+		}
+		nd->recs.push_back(r);
+	}
+
+	bool interpolate(p3 p, p3 n, p3& E) const {
+		float sum_w = 0.f;
+		p3 sum_E(0, 0, 0);
+		lookup(root.get(), p, n, sum_w, sum_E);
+		if (sum_w == 0.f)
+			return false;
+		E = sum_E * (1.f / sum_w);
+		return true;
+	}
+
+	void lookup(const node* nd, p3 p, p3 n, float& sum_w, p3& sum_E) const {
+		for (const irradiance_record* r : nd->recs) {
+			p3 d = p - r->p;
+			float dist = length(d);
+			float ndot = std::min(1.f, n * r->n);
+			float err = dist / r->R + sqrt(std::max(0.f, 1.f - ndot));
+			if (err >= a)
+				continue;
+			// reject records in front of p (they see a different part of the scene)
+			if (d * ((n + r->n) * 0.5f) < -0.01f)
+				continue;
+			float w = 1.f / std::max(err, 1e-4f);
+			p3 nxn = cross(r->n, n);
+			p3 Ei(r->E.x + nxn * r->grad_r[0] + d * r->grad_t[0],
+				r->E.y + nxn * r->grad_r[1] + d * r->grad_t[1],
+				r->E.z + nxn * r->grad_r[2] + d * r->grad_t[2]);
+			sum_E = sum_E + p3_max(Ei, p3(0, 0, 0)) * w;
+			sum_w += w;
+		}
+		for (int ci = 0; ci < 8; ++ci) {
+			const node* c = nd->child[ci].get();
+			if (!c)
+				continue;
+			// records of a child are valid up to (at most) its half size beyond its boundary
+			float ext = c->half * 2.f;
+			if (fabs(p.x - c->center.x) <= ext && fabs(p.y - c->center.y) <= ext && fabs(p.z - c->center.z) <= ext)
+				lookup(c, p, n, sum_w, sum_E);
+		}
+	}
+
+	// stratified hemisphere sampling, with gradients (Ward & Heckbert 1992)
+	template <class RADIANCE>
+	irradiance_record compute_record(p3 p, p3 n, RADIANCE radiance) const {
+		thread_local std::mt19937 gen(std::random_device{}());
+		std::uniform_real_distribution<float> U(0.f, 1.f);
+		const float PI = 3.14159265358979f;
+
+		// local frame
+		p3 t = (fabs(n.x) > 0.9f) ? p3(0, 1, 0) : p3(1, 0, 0);
+		p3 u = normalize(cross(t, n));
+		p3 v = cross(n, u);
+		auto dir = [&](float theta, float phi) {
+			return (u * cos(phi) + v * sin(phi)) * sin(theta) + n * cos(theta);
+		};
+
+		std::vector<p3> L(M * N);
+		std::vector<float> dist(M * N);
+		irradiance_record rec;
+		rec.p = p;
+		rec.n = n;
+		rec.E = p3(0, 0, 0);
+		for (int c = 0; c < 3; ++c)
+			rec.grad_r[c] = rec.grad_t[c] = p3(0, 0, 0);
+		float inv_R = 0.f;
+
+		for (int j = 0; j < M; ++j)
+			for (int k = 0; k < N; ++k) {
+				// cosine weighted stratified sample
+				float theta = asin(sqrt((j + U(gen)) / M));
+				float phi = 2 * PI * (k + U(gen)) / N;
+				float d = FAR_AWAY;
+				L[j * N + k] = radiance(ray(p + n * 0.001f, dir(theta, phi)), d);
+				dist[j * N + k] = d;
+				rec.E = rec.E + L[j * N + k];
+				inv_R += 1.f / d;
+
+				// rotational gradient
+				p3 vk = u * cos(phi + PI / 2) + v * sin(phi + PI / 2);
+				float tn = -tan(theta);
+				rec.grad_r[0] = rec.grad_r[0] + vk * (tn * L[j * N + k].x);
+				rec.grad_r[1] = rec.grad_r[1] + vk * (tn * L[j * N + k].y);
+				rec.grad_r[2] = rec.grad_r[2] + vk * (tn * L[j * N + k].z);
+			}
+		float norm = PI / (M * N);
+		rec.E = rec.E * norm;
+		for (int c = 0; c < 3; ++c)
+			rec.grad_r[c] = rec.grad_r[c] * norm;
+
+		rec.R = std::min(max_R, std::max(min_R, (M * N) / inv_R));
+
+		// translational gradient: change of the solid angle of the cells between the samples
+		for (int k = 0; k < N; ++k) {
+			float phi_k = 2 * PI * k / N;	// boundary between cells k-1 and k
+			p3 uk = u * cos(phi_k + PI / N) + v * sin(phi_k + PI / N);
+			p3 vk = u * cos(phi_k + PI / 2) + v * sin(phi_k + PI / 2);
+			for (int j = 0; j < M; ++j) {
+				float sin_tm = sqrt(float(j) / M), cos_tm2 = 1.f - float(j) / M;	// theta_j-
+				float cos_tm = sqrt(cos_tm2), cos_tp = sqrt(1.f - float(j + 1) / M);	// theta_j+
+				float sin_tj = sqrt((j + 0.5f) / M);
+				int jk = j * N + k, jk_prev_phi = j * N + (k + N - 1) % N;
+				if (j > 0) {
+					int jm_k = (j - 1) * N + k;
+					float s = (2 * PI / N) * sin_tm * cos_tm2 / std::min(dist[jk], dist[jm_k]);
+					p3 dL = L[jk] - L[jm_k];
+					rec.grad_t[0] = rec.grad_t[0] + uk * (s * dL.x);
+					rec.grad_t[1] = rec.grad_t[1] + uk * (s * dL.y);
+					rec.grad_t[2] = rec.grad_t[2] + uk * (s * dL.z);
+				}
+				float s = (cos_tm - cos_tp) / (sin_tj * std::min(dist[jk], dist[jk_prev_phi]));
+				p3 dL = L[jk] - L[jk_prev_phi];
+				rec.grad_t[0] = rec.grad_t[0] + vk * (s * dL.x);
+				rec.grad_t[1] = rec.grad_t[1] + vk * (s * dL.y);
+				rec.grad_t[2] = rec.grad_t[2] + vk * (s * dL.z);
+			}
+		}
+		return rec;
+	}
+};
+
+/*
+Diffuse global illumination with one bounce of indirect light from the irradiance cache:
+direct light (as ray_color) + albedo * E_indirect / pi. The indirect radiance seen by the
+records is the direct light reflected by the surfaces they see.
+*/
+template <class SCENE>
+p3 ray_color_gi(ray r, const SCENE& scene, p3 Lp, irradiance_cache& cache) {
+	hit_info hi = scene.closest_hit(r);
+	if (!hi.hit)
+		return p3(0, 0, 0);
+	p3 direct = direct_light(hi, scene, Lp);
+	// step back toward the viewer: a hit on an edge of the room can be on the wrong side of
+	// the other wall by a rounding error, and its hemisphere rays would leak outside
+	p3 E = cache.irradiance(hi.p - r.dir * 0.001f, hi.n, [&](ray rr, float& d) {
+		hit_info h2 = scene.closest_hit(rr);
+		d = h2.hit ? h2.t : FAR_AWAY;
+		return h2.hit ? direct_light(h2, scene, Lp) : p3(0, 0, 0);
+	});
+	const float INV_PI = 0.318309886f;
+	// colors are in 0..255: albedo = color/255
+	return direct + mul(hi.color * (1.f / 255.f), E) * INV_PI;
+}
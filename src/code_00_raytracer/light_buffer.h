@@ -0,0 +1,165 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include "raytracer.h"
+
+/*
+Light buffer: every shadow ray of direct_light() ends in the same point Lp, so the spheres
+that can block it only depend on its direction as seen from the light. The directions around
+Lp are split by a cube centered in the light, with res x res cells on each face, and every
+cell lists the spheres whose projection from Lp overlaps it (conservatively, as the screen
+rectangles of visibility_buffer), sorted by their distance from the light.
+A shadow query only tests the list of the cell its direction falls in, and stops at the
+first sphere farther from the light than the shaded point. Spheres containing the light (or
+almost) are in every cell.
+On top of that every thread remembers the last occluder it found (last-occluder cache), in a
+slot of the light buffer chosen by its id: the next shadow rays are mostly from nearby points
+and blocked by the same sphere. Threads sharing a slot only make the cache miss more often.
+*/
+struct light_buffer {
+	light_buffer(const std::vector<sphere>& _spheres, p3 _Lp, int _res = 32) :spheres(_spheres), Lp(_Lp), res(_res) {
+		build();
+	}
+
+	const std::vector<sphere>& spheres;
+	p3 Lp;
+	int res;
+
+	// is r a shadow ray toward Lp, with t_max reaching it? (as the ones of direct_light)
+	bool toward_light(ray r, float t_max) const {
+		p3 end = r.orig + r.dir * t_max - Lp;
+		return end * end < 4e-6f + 1e-8f * t_max * t_max;
+	}
+
+	// same as sphere_list::any_hit(r, t_max) for a shadow ray toward the light
+	bool any_hit(ray r, float t_max) const {
+		std::atomic<int>& last = last_occluder();
+		int l = last.load(std::memory_order_relaxed);
+		if (l >= 0 && hits(r, t_max, l))
+			return true;
+		for (int s : always)
+			if (hits(r, t_max, s)) {
+				last.store(s, std::memory_order_relaxed);
+				return true;
+			}
+
+		// cell of the direction from the light to the origin of the ray
+		p3 d = r.dir * -1.f;
+		int a = (fabs(d.x) > fabs(d.y)) ? ((fabs(d.x) > fabs(d.z)) ? 0 : 2) : ((fabs(d.y) > fabs(d.z)) ? 1 : 2);
+		int face = a * 2 + (d[a] < 0);
+		float z = fabs(d[a]);
+		int ci = std::min(res - 1, std::max(0, (int)((d[(a + 1) % 3] / z + 1) * 0.5f * res)));
+		int cj = std::min(res - 1, std::max(0, (int)((d[(a + 2) % 3] / z + 1) * 0.5f * res)));
+		const int c = (face * res + cj) * res + ci;
+
+		float reach = length(r.orig - Lp) + 1e-3f;	// no point of the segment is farther from the light
+		for (int k = start[c]; k < start[c + 1]; ++k) {
+			if (entries[k].near > reach)
+				break;
+			if (hits(r, t_max, entries[k].id)) {
+				last.store(entries[k].id, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// average number of spheres per cell
+	float average_list() const { return (float)entries.size() / (6 * res * res); }
+
+private:
+	struct entry {
+		float near;	// distance of the sphere from the light
+		int id;
+	};
+	std::vector<int> start;		// entries of cell c: [start[c], start[c+1])
+	std::vector<entry> entries;
+	std::vector<int> always;	// spheres around the light
+
+	// last-occluder cache, a slot per thread (one cache line each)
+	static const int N_SLOTS = 64;
+	struct alignas(64) cache_slot {
+		std::atomic<int> last{ -1 };
+	};
+	mutable cache_slot cache[N_SLOTS];
+
+	std::atomic<int>& last_occluder() const {
+		return cache[std::hash<std::thread::id>()(std::this_thread::get_id()) % N_SLOTS].last;
+	}
+
+	bool hits(ray r, float t_max, int s) const {
+		hit_info hi = hit_sphere(r, spheres[s]);
+		return hi.hit && hi.t < t_max;
+	}
+
+	void build() {
+		std::vector<std::vector<entry>> cells(6 * res * res);
+		for (int s = 0; s < (int)spheres.size(); ++s) {
+			p3 c = spheres[s].center - Lp;
+			float rad = spheres[s].radius;
+			float near = length(c) - rad;
+			if (near < 0.01f) {
+				always.push_back(s);
+				continue;
+			}
+			for (int face = 0; face < 6; ++face) {
+				int a = face / 2;
+				float sign = (face % 2) ? -1.f : 1.f;
+				float cz = c[a] * sign;
+				if (cz + rad <= 0.f)
+					continue;	// behind this face
+				// range of the direction coordinates x/z over the sphere (whole face if it reaches z = 0)
+				float lo[2] = { -2.f, -2.f }, hi[2] = { 2.f, 2.f };
+				if (cz - rad > 1e-4f) {
+					float cc[2] = { c[(a + 1) % 3], c[(a + 2) % 3] };
+					for (int k = 0; k < 2; ++k) {
+						float v0 = (cc[k] - rad) / (cz - rad), v1 = (cc[k] - rad) / (cz + rad);
+						float v2 = (cc[k] + rad) / (cz - rad), v3 = (cc[k] + rad) / (cz + rad);
+						lo[k] = std::min(std::min(v0, v1), std::min(v2, v3));
+						hi[k] = std::max(std::max(v0, v1), std::max(v2, v3));
+					}
+				}
+				int r0[2], r1[2];
+				bool empty = false;
+				for (int k = 0; k < 2; ++k) {
+					r0[k] = std::max(0, (int)floor((std::max(-2.f, lo[k]) + 1) * 0.5f * res));
+					r1[k] = std::min(res - 1, (int)ceil((std::min(2.f, hi[k]) + 1) * 0.5f * res));
+					empty |= r0[k] > r1[k];
+				}
+				if (empty)
+					continue;
+				for (int cj = r0[1]; cj <= r1[1]; ++cj)
+					for (int ci = r0[0]; ci <= r1[0]; ++ci)
+						cells[(face * res + cj) * res + ci].push_back(entry{ near, s });
+			}
+		}
+
+		// flatten, nearest to the light first
+		start.assign(1, 0);
+		for (auto& cell : cells) {
+			std::sort(cell.begin(), cell.end(), [](const entry& e0, const entry& e1) { return e0.near < e1.near; });
+			entries.insert(entries.end(), cell.begin(), cell.end());
+			start.push_back((int)entries.size());
+		}
+	}
+};
+
+/*
+A scene whose shadow rays toward the light go through a light_buffer, for ray_color / render:
+	light_buffer lb(scene.spheres, Lp);
+	render(img, light_buffered<sphere_list>{ scene, lb }, cam, Lp, opts);
+Other rays are answered by the scene itself.
+*/
+template <class SCENE>
+struct light_buffered {
+	const SCENE& scene;
+	const light_buffer& lb;
+
+	hit_info closest_hit(ray r) const { return scene.closest_hit(r); }
+	bool any_hit(ray r, float t_max) const {
+		return lb.toward_light(r, t_max) ? lb.any_hit(r, t_max) : scene.any_hit(r, t_max);
+	}
+};
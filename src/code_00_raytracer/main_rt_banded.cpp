@@ -0,0 +1,50 @@
+#include <random>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include "raytracer.h"
+#include "banded_render.h"
+
+/*
+Renders very large images in bounded memory: the image is written band by band (banded_render.h)
+usage: code_00_raytracer_banded [width] [height] [band_MB] [n_samples] [out.ppm] [--ascii]
+e.g. a 65536x65536 poster with 64MB bands: code_00_raytracer_banded 65536 65536 64 1 poster.ppm
+*/
+int main(int argc, char** argv) {
+	int sx = (argc > 1) ? atoi(argv[1]) : 4096;
+	int sy = (argc > 2) ? atoi(argv[2]) : sx;
+	size_t band_mb = (argc > 3) ? atoi(argv[3]) : 16;
+	int n_samples = (argc > 4) ? atoi(argv[4]) : 1;
+	const char* out_name = (argc > 5) ? argv[5] : "rendering.ppm";
+	bool ascii = (argc > 6) && !strcmp(argv[6], "--ascii");
+
+	// scene setup: two spheres with colors
+	sphere_list scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+
+	// one generator per thread, jittered samples as in main_rt_AA.cpp
+	auto shade = [&](int i, int j) {
+		thread_local std::mt19937 gen(std::hash<std::thread::id>()(std::this_thread::get_id()));
+		std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+		if (n_samples == 1)
+			return ray_color(cam.primary((i + 0.5f) / sx, (j + 0.5f) / sy), scene, Lp);
+		p3 col_avg = p3(0, 0, 0);
+		for (int ir = 0; ir < n_samples; ++ir)
+			col_avg = col_avg + ray_color(cam.primary((i + dist(gen) + 0.5f) / sx, (j + dist(gen) + 0.5f) / sy), scene, Lp);
+		return col_avg * (1.f / n_samples);
+	};
+
+	banded_renderer br(sx, sy, band_mb << 20);
+	std::cout << sx << "x" << sy << ": " << br.n_bands << " bands of " << br.band_rows << " rows, "
+		<< (br.memory_bytes() >> 20) << " MB for the pixels" << std::endl;
+
+	auto start = std::chrono::steady_clock::now();
+	if (!br.render(out_name, shade, ascii))
+		return 1;
+	std::cout << std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+	return 0;
+}
@@ -0,0 +1,116 @@
+#include <random>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include "raytracer.h"
+#include "parallel.h"
+#include "uniform_grid.h"
+#include "y4m_writer.h"
+
+/*
+Thousands of bouncing spheres, moved every frame and rendered either with the uniform
+grid (updated incrementally with move()) or with the plain sphere_list.
+With --video the frames are streamed to a YUV4MPEG2 file (or "-", or "|command") by
+y4m_writer, while the next one is rendered (the timings go to stderr, out of the way of "-").
+usage: code_00_raytracer_dynamic [n_spheres] [n_frames] [--accel grid|list] [--video out.y4m]
+*/
+
+struct particle {
+	p3 pos, vel;
+	float radius;
+	p3 color;
+};
+
+template <class SCENE>
+void render(image& a, const SCENE& scene, const camera& cam, p3 Lp) {
+	parallel_for(a.h, [&](int j) {
+		for (int i = 0; i < (int)a.w; ++i) {
+			p3 col = ray_color(cam.primary((i + 0.5f) / a.w, (j + 0.5f) / a.h), scene, Lp);
+			a.set_pixel(i, j, col.x, col.y, col.z);
+		}
+	});
+}
+
+int main(int argc, char** argv) {
+	int n_spheres = (argc > 1) ? atoi(argv[1]) : 5000;
+	int n_frames = (argc > 2) ? atoi(argv[2]) : 10;
+	bool use_grid = true;
+	const char* video = 0;
+	for (int i = 3; i + 1 < argc; i += 2) {
+		if (!strcmp(argv[i], "--accel"))
+			use_grid = strcmp(argv[i + 1], "list") != 0;
+		else if (!strcmp(argv[i], "--video"))
+			video = argv[i + 1];
+	}
+
+	// particles in the box [-2,2]x[-1,1]x[-6,-2]
+	p3 box_min(-2, -1, -6), box_max(2, 1, -2);
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	std::vector<particle> particles(n_spheres);
+	std::vector<sphere> spheres;
+	for (particle& pt : particles) {
+		pt.radius = 0.02f + 0.03f * u(gen);
+		pt.pos = p3(-2 + 4 * u(gen), -1 + 2 * u(gen), -6 + 4 * u(gen));
+		pt.vel = p3(u(gen) - 0.5f, u(gen) - 0.5f, u(gen) - 0.5f) * 0.1f;
+		pt.color = p3(55 + 200 * u(gen), 55 + 200 * u(gen), 55 + 200 * u(gen));
+		spheres.push_back(sphere(pt.pos, pt.radius, pt.color));
+	}
+
+	// about 2 spheres per cell
+	int res = std::max(1, (int)cbrt(n_spheres / 2.0));
+	uniform_grid grid(box_min - p3(0.1f, 0.1f, 0.1f), box_max + p3(0.1f, 0.1f, 0.1f), res, res, res);
+	sphere_list list;
+
+	auto t0 = std::chrono::steady_clock::now();
+	if (use_grid)
+		grid.build(spheres);
+	else
+		list.spheres = spheres;
+	std::cerr << "build: " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count() << " ms" << std::endl;
+
+	p3 Lp = p3(0, 3, -1); // point light position
+	camera cam;
+	image a(512, 512);
+	y4m_writer writer(a.w, a.h);
+	if (video && !writer.open(video))
+		return 1;
+
+	for (int f = 0; f < n_frames; ++f) {
+		auto t_update = std::chrono::steady_clock::now();
+		for (int i = 0; i < n_spheres; ++i) {
+			particle& pt = particles[i];
+			pt.pos = pt.pos + pt.vel;
+			for (int c = 0; c < 3; ++c) {
+				float* pc = &pt.pos.x + c, * vc = &pt.vel.x + c;
+				if (*pc < box_min[c] || *pc > box_max[c])
+					*vc = -*vc; // bounce on the walls
+			}
+			if (use_grid)
+				grid.move(i, sphere(pt.pos, pt.radius, pt.color));
+			else
+				list.spheres[i].center = pt.pos;
+		}
+		auto t_render = std::chrono::steady_clock::now();
+		image& target = video ? writer.frame() : a;
+		if (use_grid)
+			render(target, grid, cam, Lp);
+		else
+			render(target, list, cam, Lp);
+		if (video) {
+			if (f == n_frames - 1)
+				a.data = target.data;	// keep the last frame for rendering.ppm
+			writer.submit();
+		}
+		auto t_end = std::chrono::steady_clock::now();
+		std::cerr << "frame " << f << ": update " << std::chrono::duration<float, std::milli>(t_render - t_update).count()
+			<< " ms, render " << std::chrono::duration<float, std::milli>(t_end - t_render).count() << " ms" << std::endl;
+	}
+	if (video) {
+		writer.close();
+		std::cerr << writer.n_frames << " frames written, " << writer.wait_ms << " ms waiting for the encoder" << std::endl;
+	}
+
+	a.save("rendering.ppm"); // save to disk
+	return 0;
+}
@@ -0,0 +1,37 @@
+#include <chrono>
+#include <string>
+#include "raytracer.h"
+#include "primitives.h"
+#include "filters.h"
+
+/*
+The scene of main_rt_primitives.cpp rendered with each of the reconstruction filters of
+filters.h, saved to rendering_<filter>.ppm
+usage: code_00_raytracer_filters [size] [n_samples]
+*/
+int main(int argc, char** argv) {
+	int size = (argc > 1) ? atoi(argv[1]) : 800;
+	int n_samples = (argc > 2) ? atoi(argv[2]) : 4;
+	image a(size, size);
+
+	primitive_scene scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+	scene.add_plane(p3(0, 1, 0), -1.f, p3(180, 180, 180));                              // floor
+	scene.add_box(p3(-1.9f, -1, -3.5f), p3(-1.2f, -0.3f, -2.8f), p3(0, 200, 0));        // box
+	scene.add_triangle(p3(1.2f, -1, -3.5f), p3(2.2f, -1, -3.5f), p3(1.7f, 0.2f, -3.8f), p3(255, 200, 0));
+	scene.add_ellipsoid(p3(-0.9f, 0.6f, -2.8f), p3(0.4f, 0.2f, 0.2f), p3(200, 0, 200)); // ellipsoid
+	scene.add_cylinder(p3(1.0f, -1, -2.5f), 0.15f, 0.8f, p3(0, 200, 200));              // open cylinder
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+
+	filter_kind kinds[] = { FILTER_BOX, FILTER_GAUSSIAN, FILTER_MITCHELL, FILTER_BLACKMAN_HARRIS };
+	for (filter_kind k : kinds) {
+		auto start = std::chrono::steady_clock::now();
+		render_filtered(a, scene, cam, Lp, n_samples, k);
+		std::cout << filter_name(k) << ": " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+		a.save(("rendering_" + std::string(filter_name(k)) + ".ppm").c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include <random>
+#include <chrono>
+#include "raytracer.h"
+#include "parallel.h"
+#include "visibility_buffer.h"
+
+/*
+Hybrid rendering: the primary hits come from a visibility buffer filled by rasterizing the
+spheres (visibility_buffer.h), only the shadow rays are traced. The same image is also ray
+traced as usual, and the two are compared.
+usage: code_00_raytracer_hybrid [size] [n_spheres]
+*/
+int main(int argc, char** argv) {
+	int size = (argc > 1) ? atoi(argv[1]) : 800;
+	int n_spheres = (argc > 2) ? atoi(argv[2]) : 200;
+
+	// the two spheres of main_rt.cpp and many small ones on a big "floor" sphere
+	sphere_list scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+	scene.add(sphere(p3(0, -1001, -3), 1000.f, p3(180, 180, 180)));
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	for (int i = 0; i < n_spheres; ++i) {
+		float r = 0.05f + 0.1f * u(gen);
+		scene.add(sphere(p3(-4 + 8 * u(gen), -1 + r, -2 - 8 * u(gen)), r, p3(55 + 200 * u(gen), 55 + 200 * u(gen), 55 + 200 * u(gen))));
+	}
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+	image traced(size, size), hybrid(size, size);
+
+	// ray traced: a primary ray per pixel, a shadow ray per hit
+	std::atomic<long long> traced_rays(0);
+	auto start = std::chrono::steady_clock::now();
+	parallel_for(size, [&](int j) {
+		int n_rays = 0;
+		for (int i = 0; i < size; ++i) {
+			hit_info hi = scene.closest_hit(cam.primary((i + 0.5f) / size, (j + 0.5f) / size));
+			p3 col = hi.hit ? direct_light(hi, scene, Lp) : p3(0, 0, 0);
+			n_rays += 1 + hi.hit;
+			traced.set_pixel(i, j, col.x, col.y, col.z);
+		}
+		traced_rays += n_rays;
+	});
+	float ms_traced = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	// hybrid: rasterize, then only the shadow rays
+	std::atomic<long long> hybrid_rays(0);
+	start = std::chrono::steady_clock::now();
+	visibility_buffer vb(size, size);
+	vb.rasterize(scene.spheres, cam);
+	float ms_raster = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	parallel_for(size, [&](int j) {
+		int n_rays = 0;
+		for (int i = 0; i < size; ++i) {
+			hit_info hi = vb.hit(i, j, cam, scene.spheres);
+			p3 col = hi.hit ? direct_light(hi, scene, Lp) : p3(0, 0, 0);
+			n_rays += hi.hit;
+			hybrid.set_pixel(i, j, col.x, col.y, col.z);
+		}
+		hybrid_rays += n_rays;
+	});
+	float ms_hybrid = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	int n_diff = 0;
+	for (size_t i = 0; i < traced.data.size(); ++i)
+		n_diff += traced.data[i] != hybrid.data[i];
+	std::cout << "ray traced: " << ms_traced << " ms, " << traced_rays << " rays" << std::endl;
+	std::cout << "hybrid:     " << ms_hybrid << " ms (" << ms_raster << " ms rasterizing), " << hybrid_rays << " rays" << std::endl;
+	std::cout << n_diff << " color values differ between the two images" << std::endl;
+
+	hybrid.save("rendering.ppm"); // save to disk
+	return n_diff ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+#include <random>
+#include <chrono>
+#include "raytracer.h"
+#include "tile_deps.h"
+
+/*
+Incremental re-rendering (tile_deps.h): the scene of main_rt_hybrid.cpp is rendered once,
+then a small sphere at a time is moved and only the tiles depending on it are rendered again.
+This is done with the light above the scene, then with a low light among the small spheres
+(inside the bounds of the hit points of some tiles, whose shadow rays go in every direction).
+Every frame is checked against a full render of the edited scene.
+usage: code_00_raytracer_incremental [size] [n_spheres] [n_edits]
+*/
+int main(int argc, char** argv) {
+	int size = (argc > 1) ? atoi(argv[1]) : 800;
+	int n_spheres = (argc > 2) ? atoi(argv[2]) : 200;
+	int n_edits = (argc > 3) ? atoi(argv[3]) : 20;
+
+	sphere_list scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+	scene.add(sphere(p3(0, -1001, -3), 1000.f, p3(180, 180, 180)));
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	for (int i = 0; i < n_spheres; ++i) {
+		float r = 0.05f + 0.1f * u(gen);
+		scene.add(sphere(p3(-4 + 8 * u(gen), -1 + r, -2 - 8 * u(gen)), r, p3(55 + 200 * u(gen), 55 + 200 * u(gen), 55 + 200 * u(gen))));
+	}
+
+	p3 lights[2] = { p3(1, 1, -1), p3(-0.5f, -0.95f, -4) }; // point light positions
+	camera cam;
+	image img(size, size), full(size, size);
+	tile_deps_renderer tdr(size, size);
+
+	int total_tiles = 0, total_diff = 0;
+	float total_ms = 0.f, ms_full = 0.f;
+	for (int e = 0; e < 2 * n_edits; ++e) {
+		p3 Lp = lights[e / std::max(1, n_edits)];
+		if (e % std::max(1, n_edits) == 0) {
+			// the light moved: everything again
+			tdr.invalidate_all();
+			auto start = std::chrono::steady_clock::now();
+			tdr.render_invalid(img, scene, cam, Lp);
+			float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+			ms_full += ms;
+			std::cout << "light at " << Lp.x << " " << Lp.y << " " << Lp.z << ", full frame: " << ms << " ms, " << tdr.n_tiles() << " tiles" << std::endl;
+		}
+
+		// the artist drags one of the small spheres a bit (one near the light, if any)
+		std::vector<int> near;
+		for (int i = 3; i < 3 + n_spheres; ++i)
+			if (length(scene.spheres[i].center - Lp) < 1.5f)
+				near.push_back(i);
+		int id = near.empty() ? 3 + gen() % n_spheres : near[gen() % near.size()];
+		sphere before = scene.spheres[id];
+		scene.spheres[id].center = before.center + p3(0.4f * u(gen) - 0.2f, 0, 0.4f * u(gen) - 0.2f);
+
+		auto start = std::chrono::steady_clock::now();
+		tdr.invalidate(id, before, scene.spheres[id]);
+		int n = tdr.render_invalid(img, scene, cam, Lp);
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		parallel_for(size, [&](int j) {
+			for (int i = 0; i < size; ++i) {
+				p3 col = ray_color(cam.primary((i + 0.5f) / size, (j + 0.5f) / size), scene, Lp);
+				full.set_pixel(i, j, col.x, col.y, col.z);
+			}
+		});
+		int n_diff = 0;
+		for (size_t i = 0; i < img.data.size(); ++i)
+			n_diff += img.data[i] != full.data[i];
+
+		std::cout << "edit " << e << ": sphere " << id << ", " << n << " tiles (" << 100.f * n / tdr.n_tiles() << "%), "
+			<< ms << " ms, " << n_diff << " values differ from a full render" << std::endl;
+		total_tiles += n;
+		total_ms += ms;
+		total_diff += n_diff;
+	}
+	if (n_edits > 0)
+		std::cout << "average: " << 100.f * total_tiles / (2 * n_edits * tdr.n_tiles()) << "% of the tiles, "
+			<< 100.f * total_ms / (n_edits * ms_full) << "% of the time of a full frame" << std::endl;
+
+	img.save("rendering.ppm"); // save to disk
+	return total_diff ? 1 : 0;
+}
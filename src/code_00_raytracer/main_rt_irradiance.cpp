@@ -0,0 +1,63 @@
+#include <chrono>
+#include <string>
+#include "raytracer.h"
+#include "parallel.h"
+#include "primitives.h"
+#include "irradiance_cache.h"
+
+/*
+Diffuse interreflections in a closed room with the irradiance cache (irradiance_cache.h).
+The camera flies through the room for n_frames frames and the cache is shared by all of
+them, so the later frames mostly reuse the records of the previous ones.
+usage: code_00_raytracer_irradiance [size] [n_frames] [cache_file]
+If cache_file is given the records are loaded from it (if it exists) and saved at the end.
+*/
+int main(int argc, char** argv) {
+	int size = (argc > 1) ? atoi(argv[1]) : 400;
+	int n_frames = (argc > 2) ? atoi(argv[2]) : 4;
+	const char* cache_file = (argc > 3) ? argv[3] : NULL;
+
+	// a room [-2,2]x[-1,2]x[-6,1] with two spheres inside
+	primitive_scene scene;
+	scene.add_plane(p3(0, 1, 0), -1.f, p3(200, 200, 200));	// floor
+	scene.add_plane(p3(0, -1, 0), -2.f, p3(200, 200, 200));	// ceiling
+	scene.add_plane(p3(1, 0, 0), -2.f, p3(220, 40, 40));	// left wall (red)
+	scene.add_plane(p3(-1, 0, 0), -2.f, p3(40, 220, 40));	// right wall (green)
+	scene.add_plane(p3(0, 0, 1), -6.f, p3(200, 200, 200));	// back wall
+	scene.add_plane(p3(0, 0, -1), -1.f, p3(200, 200, 200));	// wall behind the camera
+	scene.add(sphere(p3(-0.7f, -0.4f, -3.5f), 0.6f, p3(230, 230, 230)));
+	scene.add(sphere(p3(0.8f, -0.6f, -2.8f), 0.4f, p3(60, 60, 230)));
+
+	p3 Lp = p3(0, 1.8f, -3); // point light position, close to the ceiling
+
+	irradiance_cache cache(p3(-2.1f, -1.1f, -6.1f), p3(2.1f, 2.1f, 1.1f));
+	if (cache_file && cache.load(cache_file))
+		std::cout << "loaded " << cache.size() << " records from " << cache_file << std::endl;
+
+	image a(size, size);
+	camera cam;
+	cam.eye = p3(0, 0.2f, 0.5f);
+	for (int f = 0; f < n_frames; ++f) {
+		size_t n_before = cache.size();
+		auto start = std::chrono::steady_clock::now();
+
+		parallel_for(size, [&](int j) {
+			for (int i = 0; i < size; ++i) {
+				p3 col = ray_color_gi(cam.primary((i + 0.5f) / size, (j + 0.5f) / size), scene, Lp, cache);
+				a.set_pixel(i, j, std::min(255.f, col.x), std::min(255.f, col.y), std::min(255.f, col.z));
+			}
+		});
+
+		std::cout << "frame " << f << ": " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count()
+			<< " ms, " << cache.size() - n_before << " new records (" << cache.size() << " total), hit rate " << cache.hit_rate() << std::endl;
+		a.save(("rendering_" + std::to_string(f) + ".ppm").c_str());
+
+		// fly toward the back of the room, slowly turning
+		cam.eye = cam.eye + p3(0, 0, -0.3f);
+		cam.yaw += 0.05f;
+	}
+
+	if (cache_file)
+		cache.save(cache_file);
+	return 0;
+}
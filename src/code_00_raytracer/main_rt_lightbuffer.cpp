@@ -0,0 +1,70 @@
+#include <random>
+#include <chrono>
+#include "raytracer.h"
+#include "parallel.h"
+#include "light_buffer.h"
+
+/*
+Shadow rays through a light buffer (light_buffer.h) on the scene of main_rt_hybrid.cpp:
+the primary hits are found once, then shaded with the shadow rays traced in the plain
+sphere_list and through the light buffer, and the two images are compared.
+usage: code_00_raytracer_lightbuffer [size] [n_spheres] [res]
+*/
+int main(int argc, char** argv) {
+	int size = (argc > 1) ? atoi(argv[1]) : 800;
+	int n_spheres = (argc > 2) ? atoi(argv[2]) : 1000;
+	int res = (argc > 3) ? atoi(argv[3]) : 32;
+
+	sphere_list scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+	scene.add(sphere(p3(0, -1001, -3), 1000.f, p3(180, 180, 180)));
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	for (int i = 0; i < n_spheres; ++i) {
+		float r = 0.05f + 0.1f * u(gen);
+		scene.add(sphere(p3(-4 + 8 * u(gen), -1 + r, -2 - 8 * u(gen)), r, p3(55 + 200 * u(gen), 55 + 200 * u(gen), 55 + 200 * u(gen))));
+	}
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+	image plain(size, size), buffered(size, size);
+
+	// the primary hits are the same for both: find them once, and time only the shading
+	std::vector<hit_info> hits(size * size);
+	parallel_for(size, [&](int j) {
+		for (int i = 0; i < size; ++i)
+			hits[j * size + i] = scene.closest_hit(cam.primary((i + 0.5f) / size, (j + 0.5f) / size));
+	});
+	auto shade_all = [&](image& a, auto& sc) {
+		parallel_for(size, [&](int j) {
+			for (int i = 0; i < size; ++i) {
+				const hit_info& hi = hits[j * size + i];
+				p3 col = hi.hit ? direct_light(hi, sc, Lp) : p3(0, 0, 0);
+				a.set_pixel(i, j, col.x, col.y, col.z);
+			}
+		});
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	shade_all(plain, scene);
+	float ms_plain = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	light_buffer lb(scene.spheres, Lp, res);
+	float ms_build = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	light_buffered<sphere_list> lscene{ scene, lb };
+	shade_all(buffered, lscene);
+	float ms_buffered = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	int n_diff = 0;
+	for (size_t i = 0; i < plain.data.size(); ++i)
+		n_diff += plain.data[i] != buffered.data[i];
+	std::cout << "shadow rays, sphere_list:  " << ms_plain << " ms" << std::endl;
+	std::cout << "shadow rays, light buffer: " << ms_buffered << " ms (" << ms_build << " ms building, "
+		<< lb.average_list() << " spheres per cell)" << std::endl;
+	std::cout << n_diff << " color values differ between the two images" << std::endl;
+
+	buffered.save("rendering.ppm"); // save to disk
+	return n_diff ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+#include <random>
+#include <chrono>
+#include "raytracer.h"
+#include "render_kernel.h"
+#include "ooc_bvh.h"
+
+/*
+Out-of-core BVH (ooc_bvh.h): a "point scan" of the scene of main_rt.cpp, i.e. millions of
+tiny spheres on the surfaces of the two spheres and of the floor, is written to a BVH file
+with a bounded amount of memory, then memory mapped and rendered.
+With few spheres the image is also rendered from a sphere_list, and the two are compared.
+usage: code_00_raytracer_ooc [n_spheres] [memory_MB] [size] [file]
+*/
+int main(int argc, char** argv) {
+	long long n_spheres = (argc > 1) ? atoll(argv[1]) : 2000000;
+	size_t memory = size_t((argc > 2) ? atoi(argv[2]) : 16) << 20;
+	int size = (argc > 3) ? atoi(argv[3]) : 400;
+	std::string file = (argc > 4) ? argv[4] : "scan.bvh";
+
+	auto start = std::chrono::steady_clock::now();
+	ooc_bvh_builder builder(file, memory);
+	sphere_list check;
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	float r = 5.f / sqrt((float)n_spheres);	// about the spacing of the samples over the ~50 square units scanned
+	for (long long k = 0; k < n_spheres; ++k) {
+		p3 p, col;
+		float c = u(gen);
+		if (c < 0.35f || c > 0.45f) {
+			// point on a sphere: uniform direction
+			bool big = c < 0.35f;
+			float z = 2 * u(gen) - 1, phi = 6.2831853f * u(gen), s = sqrt(1 - z * z);
+			p3 d(s * cos(phi), s * sin(phi), z);
+			p = big ? p3(0, 0, -3) + d : p3(0.6f, 0.6f, -2.0f) + d * 0.2f;
+			col = big ? p3(255, 0, 0) : p3(0, 0, 255);
+		}
+		else {
+			p = p3(-3 + 6 * u(gen), -1, -1 - 6 * u(gen));	// floor
+			col = p3(180, 180, 180);
+		}
+		sphere s(p, r, col);
+		builder.add(s);
+		if (n_spheres <= 20000)
+			check.add(s);
+	}
+	if (!builder.build()) {
+		std::cout << "cannot write " << file << std::endl;
+		return 1;
+	}
+	float ms_build = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	ooc_bvh bvh;
+	if (!bvh.open(file))
+		return 1;
+	std::cout << "built " << file << " (" << bvh.file_bytes() / (1 << 20) << " MB, " << bvh.size() << " spheres) in "
+		<< ms_build << " ms with " << (memory >> 20) << " MB of memory" << std::endl;
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+	image a(size, size);
+	render_options opt;
+	start = std::chrono::steady_clock::now();
+	render(a, bvh, cam, Lp, opt);
+	std::cout << "render: " << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+	a.save("rendering.ppm"); // save to disk
+
+	if (!check.spheres.empty()) {
+		image b(size, size);
+		render(b, check, cam, Lp, opt);
+		int n_diff = 0;
+		for (size_t i = 0; i < a.data.size(); ++i)
+			n_diff += a.data[i] != b.data[i];
+		std::cout << n_diff << " color values differ from the sphere_list" << std::endl;
+		return n_diff ? 1 : 0;
+	}
+	return 0;
+}
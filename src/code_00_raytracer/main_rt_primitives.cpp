@@ -0,0 +1,37 @@
+#include <chrono>
+#include "raytracer.h"
+#include "primitives.h"
+#include "render_kernel.h"
+
+/*
+Same renderer of main_rt_AA.cpp on a scene with all the kinds of primitives of primitives.h
+usage: code_00_raytracer_primitives [size] [n_samples]
+*/
+int main(int argc, char** argv) {
+	int sx = (argc > 1) ? atoi(argv[1]) : 800;
+	int sy = sx;
+	int n_samples = (argc > 2) ? atoi(argv[2]) : 10;
+	image a(sx, sy);
+
+	primitive_scene scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+	scene.add_plane(p3(0, 1, 0), -1.f, p3(180, 180, 180));                              // floor
+	scene.add_box(p3(-1.9f, -1, -3.5f), p3(-1.2f, -0.3f, -2.8f), p3(0, 200, 0));        // box
+	scene.add_triangle(p3(1.2f, -1, -3.5f), p3(2.2f, -1, -3.5f), p3(1.7f, 0.2f, -3.8f), p3(255, 200, 0));
+	scene.add_ellipsoid(p3(-0.9f, 0.6f, -2.8f), p3(0.4f, 0.2f, 0.2f), p3(200, 0, 200)); // ellipsoid
+	scene.add_cylinder(p3(1.0f, -1, -2.5f), 0.15f, 0.8f, p3(0, 200, 200));              // open cylinder
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+
+	render_options opt;
+	opt.n_samples = n_samples;
+	opt.sampler = SAMPLER_JITTER;
+
+	auto start = std::chrono::steady_clock::now();
+	render(a, scene, cam, Lp, opt);
+	std::cout << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+	a.save("rendering.ppm"); // save to disk
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include <chrono>
+#include <string>
+#include "raytracer.h"
+#include "probe_baker.h"
+
+/*
+Bakes reflection probes of the scene of main_rt.cpp (with a floor) into a probe file for the
+raster examples (common/reflection_probes.h), and saves the 6 faces of every level of the
+first probe side by side in probe_<level>.ppm for a look.
+usage: code_00_raytracer_probes [face_size (a power of two)] [output]
+*/
+int main(int argc, char** argv) {
+	probe_baker baker;
+	baker.face_size = (argc > 1) ? atoi(argv[1]) : 128;
+	std::string output = (argc > 2) ? argv[2] : "probes.bin";
+	if (!probe_file::valid_size(baker.face_size)) {
+		std::cout << "the face size must be a power of two" << std::endl;
+		return 1;
+	}
+
+	sphere_list scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+	scene.add(sphere(p3(0, -1001, -3), 1000.f, p3(180, 180, 180)));
+
+	p3 positions[] = { p3(0, 0, -1.5f), p3(-1.5f, -0.5f, -3), p3(1.5f, -0.5f, -3) };
+	probe_file pf;
+	pf.face_size = baker.face_size;
+	pf.n_mips = baker.mips();
+	for (p3 pos : positions) {
+		auto start = std::chrono::steady_clock::now();
+		pf.probes.push_back(probe_file::probe());
+		baker.bake(scene, pos, pf.probes.back());
+		std::cout << "probe at (" << pos.x << ", " << pos.y << ", " << pos.z << "): "
+			<< std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+	}
+	if (!pf.save(output)) {
+		std::cout << "cannot write " << output << std::endl;
+		return 1;
+	}
+	std::cout << pf.probes.size() << " probes saved to " << output << std::endl;
+
+	for (int m = 0; m < (int)pf.n_mips; ++m) {
+		int s = probe_file::level_size(pf.face_size, m);
+		image a(6 * s, s);
+		for (int f = 0; f < 6; ++f)
+			for (int j = 0; j < s; ++j)
+				for (int i = 0; i < s; ++i) {
+					float c[3];
+					probe_file::unpack_rgb9e5(pf.probes[0].texels[pf.offset(m, f) + j * s + i], c);
+					a.set_pixel(f * s + i, s - 1 - j, std::min(255.f, c[0] * 255), std::min(255.f, c[1] * 255), std::min(255.f, c[2] * 255));
+				}
+		a.save(("probe_" + std::to_string(m) + ".ppm").c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include <random>
+#include <chrono>
+#include <string>
+#include "raytracer.h"
+#include "progressive.h"
+
+/*
+Progressive preview: renders the same scene of main_rt_AA.cpp at 1/16, 1/8, 1/4, 1/2
+and full resolution, saving an upsampled preview after each level.
+usage: code_00_raytracer_progressive [size] [start_step] [n_samples]
+*/
+int main(int argc, char** argv) {
+	int sx = (argc > 1) ? atoi(argv[1]) : 800;
+	int sy = sx;
+	int start_step = (argc > 2) ? atoi(argv[2]) : 16;
+	int n_samples = (argc > 3) ? atoi(argv[3]) : 10;
+
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+
+	// scene setup: two spheres with colors
+	sphere_list scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+
+	// antialiased color of pixel (i,j)
+	auto shade = [&](int i, int j) {
+		p3 col_avg = p3(0, 0, 0);
+		for (int ir = 0; ir < n_samples; ++ir) {
+			ray r = cam.primary((i + dist(gen) + 0.5f) / sx, (j + dist(gen) + 0.5f) / sy);
+			col_avg = col_avg + ray_color(r, scene, Lp);
+		}
+		return col_avg * (1.f / n_samples);
+	};
+
+	image a(sx, sy);
+	progressive_render pr(sx, sy, start_step);
+
+	auto start = std::chrono::steady_clock::now();
+	while (!pr.done()) {
+		int n = pr.refine(shade);
+		pr.upsample(a);
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "level 1/" << pr.last_step() << ": " << n << " new pixels, " << ms << " ms" << std::endl;
+
+		// the last level is the final image
+		if (!pr.done())
+			a.save(("preview_" + std::to_string(pr.last_step()) + ".ppm").c_str());
+	}
+
+	a.save("rendering.ppm"); // save to disk
+	return 0;
+}
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstring>
+#include "raytracer.h"
+#include "parallel.h"
+#include "sdf.h"
+
+/*
+Procedural scene made of signed distance fields (sdf.h), rendered by sphere tracing.
+By default the tiles are cone marched and the rays traced in packets (render_sdf);
+--naive marches every pixel on its own with ray_color, --no-cone skips the cone march.
+usage: code_00_raytracer_sdf [size] [--naive | --no-cone]
+*/
+int main(int argc, char** argv) {
+	int size = (argc > 1) ? atoi(argv[1]) : 800;
+	bool naive = (argc > 2) && !strcmp(argv[2], "--naive");
+	bool cone = !((argc > 2) && !strcmp(argv[2], "--no-cone"));
+
+	sdf_scene s;
+	p3 red(230, 40, 40), blue(40, 60, 230), green(40, 200, 60), yellow(230, 200, 30), gray(180, 180, 180);
+
+	// a blob: three spheres smoothly blended
+	int blob = s.blend(s.blend(s.sphere(0.45f, red), s.translate(s.sphere(0.3f, yellow), p3(0.45f, 0.25f, 0)), 0.25f),
+		s.translate(s.sphere(0.25f, red), p3(-0.35f, 0.35f, 0.1f)), 0.2f);
+	blob = s.translate(blob, p3(-1.1f, -0.45f, -3.6f));
+
+	// a rounded box with a hole, rotated
+	int holed = s.subtract(s.box(p3(0.4f, 0.4f, 0.4f), 0.06f, blue), s.cylinder(0.22f, 1.f, yellow));
+	holed = s.translate(s.rotate(holed, p3(1, 1, 0), 0.6f), p3(0.1f, -0.5f, -4.2f));
+
+	// a lens: intersection of two spheres, and a torus
+	int lens = s.intersect(s.translate(s.sphere(0.5f, green), p3(0, 0, 0.3f)), s.translate(s.sphere(0.5f, green), p3(0, 0, -0.3f)));
+	lens = s.translate(s.rotate(lens, p3(0, 1, 0), 0.8f), p3(1.2f, -0.6f, -3.4f));
+	int ring = s.translate(s.rotate(s.torus(0.5f, 0.1f, yellow), p3(1, 0, 0), 1.2f), p3(0.3f, 0.55f, -4.5f));
+
+	// the floor and two plain spheres (these are intersected analytically)
+	int scene = s.unite(s.unite(blob, holed), s.unite(lens, ring));
+	scene = s.unite(scene, s.plane(p3(0, 1, 0), 1.f, gray));
+	scene = s.unite(scene, s.translate(s.sphere(0.3f, blue), p3(-0.2f, -0.7f, -2.8f)));
+	scene = s.unite(scene, s.translate(s.scale(s.sphere(1.f, green), 0.25f), p3(0.9f, 0.3f, -2.6f)));
+	if (!s.set_root(scene)) {
+		std::cout << "the scene is too deep (more than " << SDF_MAX_STACK << " pending operands)" << std::endl;
+		return 1;
+	}
+
+	p3 Lp = p3(1, 2, -1); // point light position
+	camera cam;
+	cam.eye = p3(0, 0.3f, 0);
+	cam.pitch = -0.1f;
+	image a(size, size);
+
+	auto start = std::chrono::steady_clock::now();
+	if (naive)
+		parallel_for(size, [&](int j) {
+			for (int i = 0; i < size; ++i) {
+				p3 col = ray_color(cam.primary((i + 0.5f) / size, (j + 0.5f) / size), s, Lp);
+				a.set_pixel(i, j, std::min(255.f, col.x), std::min(255.f, col.y), std::min(255.f, col.z));
+			}
+		});
+	else {
+		float skipped = render_sdf(a, s, cam, Lp, cone);
+		if (cone)
+			std::cout << "cone march: " << skipped << " skipped per tile on average" << std::endl;
+	}
+	std::cout << std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms ("
+		<< s.analytic_spheres().spheres.size() << " analytic spheres)" << std::endl;
+
+	a.save("rendering.ppm"); // save to disk
+	return 0;
+}
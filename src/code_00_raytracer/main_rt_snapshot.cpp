@@ -0,0 +1,72 @@
+#include <random>
+#include <chrono>
+#include <thread>
+#include "raytracer.h"
+#include "render_kernel.h"
+#include "scene_snapshot.h"
+
+/*
+Editing while rendering with scene snapshots (scene_snapshot.h): an editor thread keeps
+moving the small spheres of the scene of main_rt_hybrid.cpp, while the main thread renders
+frames, each one of the version current when it started. Every frame is rendered twice from
+its snapshot to check that the edits published meanwhile do not touch it.
+usage: code_00_raytracer_snapshot [size] [n_frames]
+*/
+int main(int argc, char** argv) {
+	int size = (argc > 1) ? atoi(argv[1]) : 256;
+	int n_frames = (argc > 2) ? atoi(argv[2]) : 10;
+	int n_spheres = 200;
+
+	sphere_list scene;
+	scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+	scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+	scene.add(sphere(p3(0, -1001, -3), 1000.f, p3(180, 180, 180)));
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> u(0.f, 1.f);
+	for (int i = 0; i < n_spheres; ++i) {
+		float r = 0.05f + 0.1f * u(gen);
+		scene.add(sphere(p3(-4 + 8 * u(gen), -1 + r, -2 - 8 * u(gen)), r, p3(55 + 200 * u(gen), 55 + 200 * u(gen), 55 + 200 * u(gen))));
+	}
+	scene_store<sphere_list> store(scene);
+
+	std::atomic<bool> done(false);
+	float max_edit_ms = 0.f;
+	std::thread editor([&]() {
+		std::mt19937 egen(1);
+		while (!done) {
+			auto start = std::chrono::steady_clock::now();
+			store.edit([&](sphere_list& s) {
+				sphere& sp = s.spheres[3 + egen() % n_spheres];
+				sp.center.x += 0.02f * ((egen() % 3) - 1.f);
+				sp.center.z += 0.02f * ((egen() % 3) - 1.f);
+			});
+			max_edit_ms = std::max(max_edit_ms, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+
+	p3 Lp = p3(1, 1, -1); // point light position
+	camera cam;
+	image a(size, size), check(size, size);
+	render_options opt;
+	int renderer = store.add_reader();
+	int n_bad = 0;
+	for (int f = 0; f < n_frames; ++f) {
+		auto snap = store.read(renderer);	// the version of this frame
+		auto start = std::chrono::steady_clock::now();
+		render(a, snap.scene(), cam, Lp, opt);
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		render(check, snap.scene(), cam, Lp, opt);
+		bool same = a.data == check.data;
+		n_bad += !same;
+		std::cout << "frame " << f << ": version " << snap.id() << " (latest " << store.latest_id() << "), " << ms << " ms, "
+			<< (same ? "stable" : "CHANGED while rendering") << std::endl;
+	}
+	done = true;
+	editor.join();
+	std::cout << store.latest_id() << " edits published, longest " << max_edit_ms << " ms, "
+		<< store.n_retired() << " old versions not freed yet" << std::endl;
+
+	a.save("rendering.ppm"); // save to disk
+	return n_bad ? 1 : 0;
+}
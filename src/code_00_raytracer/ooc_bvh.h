@@ -0,0 +1,592 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <cfloat>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include "raytracer.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+Out-of-core BVH over spheres, for scenes that do not fit in memory.
+
+The hierarchy is a binary tree over the spheres sorted along a Morton curve: a leaf holds
+OOC_LEAF consecutive spheres, and every node of level k+1 is the union of two consecutive
+nodes of level k. The tree is implicit (the children of node i of a level are nodes 2i and
+2i+1 of the level below), so a node is just its bounding box, and it is cut in treelets of
+7 levels (127 nodes) each stored in its own 4 KB block: a ray goes down 7 levels inside a
+page before touching another one.
+File layout (all offsets multiple of 4 KB):
+	ooc_header | spheres in leaf order | blocks, top treelet first, then level by level
+ooc_bvh memory maps the whole file and traverses it in place: the OS loads the pages the
+rays touch and drops the least recently used ones when memory is short, so rendering
+slows down as the working set exceeds the RAM instead of failing to allocate.
+
+ooc_bvh_builder builds the file with bounded memory, in streaming passes over temporary
+files next to the output:
+	1. add() appends the spheres to a raw file and tracks their bounds
+	2. chunks of memory_budget bytes are sorted by Morton code into runs
+	3. the runs are merged into the sphere section, computing the boxes of the leaves (at most
+	   OOC_MAX_FAN_IN runs at once: if there are more, groups of them are first merged into
+	   longer runs, in as many passes as needed)
+	4. every level of the tree is computed from the one below
+	5. the levels are cut in treelets and written as blocks
+*/
+
+#define OOC_LEAF 4
+#define OOC_BLOCK 4096
+#define OOC_TREELET_DEPTH 7	// 2^7 - 1 = 127 nodes of 24 bytes in a block
+#define OOC_MAX_FAN_IN 64	// runs merged at once, each with its open file
+
+struct ooc_sphere {
+	float c[3], r, col[3];
+};
+
+struct ooc_node {
+	float bmin[3], bmax[3];	// empty nodes (past the end of a level) have bmin > bmax
+};
+
+struct ooc_header {
+	char magic[8];
+	uint64_t n_spheres;
+	uint32_t n_levels;			// levels of the tree, the root is level n_levels - 1
+	uint32_t n_block_levels;
+	uint64_t level_size[64];	// nodes in each level
+	uint64_t block_base[16];	// first block of each block level
+	int32_t block_top[17];		// level of the roots of the treelets of each block level (then -1)
+	uint64_t spheres_offset, blocks_offset;
+	float bmin[3], bmax[3];
+};
+
+// sizes of the levels and of the block levels of a tree over n spheres (in h)
+inline void ooc_layout(ooc_header& h, uint64_t n) {
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "OOCBVH1", 8);
+	h.n_spheres = n;
+	uint64_t s = std::max<uint64_t>(1, (n + OOC_LEAF - 1) / OOC_LEAF);
+	h.level_size[h.n_levels++] = s;
+	while (s > 1) {
+		s = (s + 1) / 2;
+		h.level_size[h.n_levels++] = s;
+	}
+	// the treelets end at level 0 with all their 7 levels, only the top one can be shallower
+	uint64_t b = 0;
+	for (int L = h.n_levels - 1; L >= 0; L = L / OOC_TREELET_DEPTH * OOC_TREELET_DEPTH - 1) {
+		h.block_top[h.n_block_levels] = L;
+		h.block_base[h.n_block_levels++] = b;
+		b += h.level_size[L];
+	}
+	h.block_top[h.n_block_levels] = -1;
+	h.spheres_offset = OOC_BLOCK;
+	h.blocks_offset = (h.spheres_offset + n * sizeof(ooc_sphere) + OOC_BLOCK - 1) / OOC_BLOCK * OOC_BLOCK;
+}
+
+struct ooc_bvh {
+	ooc_bvh() {}
+	~ooc_bvh() { close(); }
+
+	bool open(const std::string& path) {
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER size;
+		GetFileSizeEx(file, &size);
+		bytes = (size_t)size.QuadPart;
+		mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		base = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+#else
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		fstat(fd, &st);
+		bytes = (size_t)st.st_size;
+		void* p = mmap(0, bytes, PROT_READ, MAP_SHARED, fd, 0);
+		base = (p == MAP_FAILED) ? 0 : (const char*)p;
+		if (base)
+			madvise(p, bytes, MADV_RANDOM);	// no read ahead: rays jump around
+#endif
+		if (!base || bytes < sizeof(ooc_header) || memcmp(base, "OOCBVH1", 8)) {
+			std::cout << "ooc_bvh: cannot map " << path << std::endl;
+			close();
+			return false;
+		}
+		h = *(const ooc_header*)base;
+		spheres = (const ooc_sphere*)(base + h.spheres_offset);
+		blocks = base + h.blocks_offset;
+		return true;
+	}
+
+	void close() {
+#ifdef _WIN32
+		if (base)
+			UnmapViewOfFile(base);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = 0;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (base)
+			munmap((void*)base, bytes);
+		if (fd >= 0)
+			::close(fd);
+		fd = -1;
+#endif
+		base = 0;
+	}
+
+	uint64_t size() const { return h.n_spheres; }
+	size_t file_bytes() const { return bytes; }
+
+	sphere get(uint64_t i) const {
+		const ooc_sphere& s = spheres[i];
+		return sphere(p3(s.c[0], s.c[1], s.c[2]), s.r, p3(s.col[0], s.col[1], s.col[2]));
+	}
+
+	hit_info closest_hit(ray r) const {
+		hit_info best;
+		traverse(r, FAR_AWAY, [&](uint64_t i, float& t_max) {
+			hit_info hi = hit_sphere(r, get(i));
+			if (hi.hit && hi.t < best.t) {
+				best = hi;
+				best.id = (long long)i;
+				t_max = hi.t;
+			}
+			return false;
+		});
+		return best;
+	}
+
+	bool any_hit(ray r, float t_max) const {
+		return traverse(r, t_max, [&](uint64_t i, float& tm) {
+			hit_info hi = hit_sphere(r, get(i));
+			return hi.hit && hi.t < tm;
+		});
+	}
+
+private:
+	ooc_header h;
+	const char* base = 0;
+	size_t bytes = 0;
+	const ooc_sphere* spheres = 0;
+	const char* blocks = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE, mapping = 0;
+#else
+	int fd = -1;
+#endif
+
+	// a node: slot s of treelet i of block level b
+	struct node_ref {
+		uint64_t i;
+		int b, s;
+	};
+
+	const ooc_node& node(node_ref n) const {
+		return ((const ooc_node*)(blocks + (h.block_base[n.b] + n.i) * OOC_BLOCK))[n.s];
+	}
+
+	static float box_entry(const ooc_node& nd, p3 o, p3 inv, float t_max) {
+		float t0 = 0.f, t1 = t_max;
+		for (int a = 0; a < 3; ++a) {
+			float ta = (nd.bmin[a] - o[a]) * inv[a], tb = (nd.bmax[a] - o[a]) * inv[a];
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		}
+		return (t0 <= t1 && nd.bmin[0] <= nd.bmax[0]) ? t0 : -1.f;
+	}
+
+	/* calls leaf(i, t_max) on the spheres of the leaves crossed by r within t_max, near to
+	*  far; leaf can lower t_max, and returning true stops the traversal (returns true)
+	*/
+	template <class LEAF>
+	bool traverse(ray r, float t_max, LEAF leaf) const {
+		if (!base)
+			return false;
+		p3 inv(1.f / r.dir.x, 1.f / r.dir.y, 1.f / r.dir.z);
+		node_ref stack[64 * 2];
+		int sp = 0;
+		node_ref root{ 0, 0, 0 };
+		if (box_entry(node(root), r.orig, inv, t_max) < 0.f)
+			return false;
+		stack[sp++] = root;
+		while (sp) {
+			node_ref n = stack[--sp];
+			int d = 0;	// depth of the slot in its treelet
+			while ((2 << d) - 1 <= n.s)
+				++d;
+			int level = h.block_top[n.b] - d;
+			uint64_t index = (n.i << d) + (n.s - ((1 << d) - 1));	// in its level
+			if (level == 0) {
+				uint64_t first = index * OOC_LEAF, last = std::min<uint64_t>(first + OOC_LEAF, h.n_spheres);
+				for (uint64_t k = first; k < last; ++k)
+					if (leaf(k, t_max))
+						return true;
+				continue;
+			}
+			node_ref c[2];
+			float t[2];
+			for (int k = 0; k < 2; ++k) {
+				c[k] = (level - 1 > h.block_top[n.b + 1]) ? node_ref{ n.i, n.b, 2 * n.s + 1 + k } : node_ref{ 2 * index + k, n.b + 1, 0 };
+				// the missing last node of a level is an empty slot inside a treelet, but it has no treelet of its own
+				bool exists = 2 * index + k < h.level_size[level - 1];
+				t[k] = exists ? box_entry(node(c[k]), r.orig, inv, t_max) : -1.f;
+			}
+			int nearer = (t[1] >= 0.f && (t[0] < 0.f || t[1] < t[0])) ? 1 : 0;
+			if (t[1 - nearer] >= 0.f)
+				stack[sp++] = c[1 - nearer];
+			if (t[nearer] >= 0.f)
+				stack[sp++] = c[nearer];
+		}
+		return false;
+	}
+};
+
+struct ooc_bvh_builder {
+	// path of the file to write, memory_budget: bytes of sphere records kept in memory at once
+	ooc_bvh_builder(const std::string& _path, size_t _memory_budget = size_t(256) << 20) :path(_path), memory_budget(_memory_budget) {
+		input = fopen((path + ".tmp_input").c_str(), "wb");
+		for (int a = 0; a < 3; ++a) {
+			bmin[a] = FLT_MAX;
+			bmax[a] = -FLT_MAX;
+		}
+	}
+
+	~ooc_bvh_builder() {
+		if (input) {	// build() never called
+			fclose(input);
+			remove((path + ".tmp_input").c_str());
+		}
+	}
+
+	std::string path;
+	size_t memory_budget;
+	uint64_t n = 0;
+
+	void add(const sphere& s) {
+		ooc_sphere o = { { s.center.x, s.center.y, s.center.z }, s.radius, { s.color.x, s.color.y, s.color.z } };
+		fwrite(&o, sizeof(o), 1, input);
+		for (int a = 0; a < 3; ++a) {
+			bmin[a] = std::min(bmin[a], o.c[a]);
+			bmax[a] = std::max(bmax[a], o.c[a]);
+		}
+		++n;
+	}
+
+	// builds the file, returns false on I/O errors
+	bool build() {
+		if (!input)
+			return false;
+		fclose(input);
+		input = 0;
+		ooc_header h;
+		ooc_layout(h, n);
+		for (int a = 0; a < 3; ++a) {
+			h.bmin[a] = bmin[a];
+			h.bmax[a] = bmax[a];
+		}
+		FILE* out = fopen(path.c_str(), "wb");
+		if (!out)
+			return false;
+		std::vector<char> block(OOC_BLOCK, 0);
+		fwrite(&block[0], 1, OOC_BLOCK, out);	// header written at the end
+
+		bool ok = sort_runs() && reduce_runs() && merge_runs(h, out);
+		for (uint32_t L = 1; ok && L < h.n_levels; ++L)
+			ok = build_level(L);
+		ok = ok && write_blocks(h, out);
+
+		memcpy(&block[0], &h, sizeof(h));
+		fseek(out, 0, SEEK_SET);
+		fwrite(&block[0], 1, OOC_BLOCK, out);
+		ok = ok && !ferror(out);
+		fclose(out);
+		remove((path + ".tmp_input").c_str());
+		remove((path + ".tmp_runs").c_str());
+		remove((path + ".tmp_runs_next").c_str());
+		for (uint32_t L = 0; L < h.n_levels; ++L)
+			remove(level_path(L).c_str());
+		return ok;
+	}
+
+private:
+	FILE* input;
+	float bmin[3], bmax[3];		// of the centers
+	std::vector<uint64_t> run_size;
+
+	struct record {
+		uint64_t code;
+		ooc_sphere s;
+	};
+
+	std::string level_path(int L) const { return path + ".tmp_lvl" + std::to_string(L); }
+
+	static uint64_t spread21(uint64_t x) {
+		x &= 0x1fffff;
+		x = (x | x << 32) & 0x1f00000000ffffull;
+		x = (x | x << 16) & 0x1f0000ff0000ffull;
+		x = (x | x << 8) & 0x100f00f00f00f00full;
+		x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+		x = (x | x << 2) & 0x1249249249249249ull;
+		return x;
+	}
+
+	uint64_t morton(const ooc_sphere& s) const {
+		uint64_t code = 0;
+		for (int a = 0; a < 3; ++a) {
+			float e = bmax[a] - bmin[a];
+			float u = (e > 0.f) ? (s.c[a] - bmin[a]) / e : 0.f;
+			code |= spread21((uint64_t)std::min(2097151.f, std::max(0.f, u * 2097152.f))) << a;
+		}
+		return code;
+	}
+
+	static void grow(ooc_node& nd, const float* mn, const float* mx) {
+		for (int a = 0; a < 3; ++a) {
+			nd.bmin[a] = std::min(nd.bmin[a], mn[a]);
+			nd.bmax[a] = std::max(nd.bmax[a], mx[a]);
+		}
+	}
+
+	static ooc_node empty_node() {
+		ooc_node nd;
+		for (int a = 0; a < 3; ++a) {
+			nd.bmin[a] = FLT_MAX;
+			nd.bmax[a] = -FLT_MAX;
+		}
+		return nd;
+	}
+
+	// pass 2: sorted runs of memory_budget bytes
+	bool sort_runs() {
+		FILE* in = fopen((path + ".tmp_input").c_str(), "rb");
+		FILE* runs = fopen((path + ".tmp_runs").c_str(), "wb");
+		if (!in || !runs)
+			return false;
+		size_t chunk = std::max<size_t>(1, memory_budget / sizeof(record));
+		std::vector<ooc_sphere> spheres(chunk);
+		std::vector<record> recs;
+		size_t got;
+		while ((got = fread(&spheres[0], sizeof(ooc_sphere), chunk, in)) > 0) {
+			recs.resize(got);
+			for (size_t i = 0; i < got; ++i)
+				recs[i] = record{ morton(spheres[i]), spheres[i] };
+			std::sort(recs.begin(), recs.end(), [](const record& a, const record& b) { return a.code < b.code; });
+			fwrite(&recs[0], sizeof(record), got, runs);
+			run_size.push_back(got);
+		}
+		fclose(in);
+		bool ok = !ferror(runs);
+		fclose(runs);
+		return ok;
+	}
+
+	// k-way merge of count runs of the runs file, from run first (starting at record offset),
+	// calling emit for each record in order. Returns false if a run could not be read whole
+	template <class EMIT>
+	bool merge(size_t first, size_t count, uint64_t offset, EMIT emit) {
+		struct cursor {
+			FILE* f = 0;
+			uint64_t left = 0;
+			std::vector<record> buf;
+			size_t pos = 0;
+			bool next(size_t n) {
+				if (pos < buf.size())
+					return true;
+				size_t want = (size_t)std::min<uint64_t>(left, n);
+				buf.resize(want);
+				pos = 0;
+				if (!want || fread(&buf[0], sizeof(record), want, f) != want)
+					return false;
+				left -= want;
+				return true;
+			}
+		};
+		size_t per_run = std::max<size_t>(1, memory_budget / 2 / sizeof(record) / std::max<size_t>(1, count));
+		std::vector<cursor> cur(count);
+		uint64_t total = 0;
+		bool ok = true;
+		for (size_t k = 0; k < count; ++k) {
+			cur[k].f = fopen((path + ".tmp_runs").c_str(), "rb");
+			if (!cur[k].f) {
+				ok = false;
+				break;
+			}
+			fseek_64(cur[k].f, offset * sizeof(record));
+			offset += run_size[first + k];
+			cur[k].left = run_size[first + k];
+			total += run_size[first + k];
+		}
+		uint64_t done = 0;
+		if (ok) {
+			typedef std::pair<uint64_t, size_t> item;	// code, run
+			std::priority_queue<item, std::vector<item>, std::greater<item>> heap;
+			for (size_t k = 0; k < count; ++k)
+				if (cur[k].next(per_run))
+					heap.push(item(cur[k].buf[0].code, k));
+			while (!heap.empty()) {
+				size_t k = heap.top().second;
+				heap.pop();
+				emit(cur[k].buf[cur[k].pos++]);
+				++done;
+				if (cur[k].next(per_run))
+					heap.push(item(cur[k].buf[cur[k].pos].code, k));
+			}
+		}
+		for (cursor& c : cur)
+			if (c.f)
+				fclose(c.f);
+		return ok && done == total;
+	}
+
+	// pass 3a: while there are more than OOC_MAX_FAN_IN runs, merges groups of them into a
+	// new runs file
+	bool reduce_runs() {
+		std::string runs_path = path + ".tmp_runs", next_path = path + ".tmp_runs_next";
+		while (run_size.size() > OOC_MAX_FAN_IN) {
+			FILE* out = fopen(next_path.c_str(), "wb");
+			if (!out)
+				return false;
+			std::vector<uint64_t> next_size;
+			std::vector<record> outbuf;
+			uint64_t offset = 0;
+			bool ok = true;
+			for (size_t first = 0; ok && first < run_size.size(); first += OOC_MAX_FAN_IN) {
+				size_t count = std::min<size_t>(OOC_MAX_FAN_IN, run_size.size() - first);
+				ok = merge(first, count, offset, [&](const record& r) {
+					outbuf.push_back(r);
+					if (outbuf.size() * sizeof(record) >= (1 << 20)) {
+						fwrite(&outbuf[0], sizeof(record), outbuf.size(), out);
+						outbuf.clear();
+					}
+				});
+				if (!outbuf.empty())
+					fwrite(&outbuf[0], sizeof(record), outbuf.size(), out);
+				outbuf.clear();
+				uint64_t merged = 0;
+				for (size_t k = first; k < first + count; ++k)
+					merged += run_size[k];
+				offset += merged;
+				next_size.push_back(merged);
+			}
+			ok = ok && !ferror(out);
+			fclose(out);
+			if (!ok)
+				return false;
+			remove(runs_path.c_str());
+			if (rename(next_path.c_str(), runs_path.c_str()))
+				return false;
+			run_size.swap(next_size);
+		}
+		return true;
+	}
+
+	// pass 3b: merge of the runs into the sphere section, and the boxes of the leaves
+	bool merge_runs(const ooc_header& h, FILE* out) {
+		FILE* leaves = fopen(level_path(0).c_str(), "wb");
+		if (!leaves)
+			return false;
+		std::vector<ooc_sphere> outbuf;
+		ooc_node leaf = empty_node();
+		uint64_t done = 0;
+		bool ok = merge(0, run_size.size(), 0, [&](const record& r) {
+			const ooc_sphere& s = r.s;
+			outbuf.push_back(s);
+			float mn[3] = { s.c[0] - s.r, s.c[1] - s.r, s.c[2] - s.r }, mx[3] = { s.c[0] + s.r, s.c[1] + s.r, s.c[2] + s.r };
+			grow(leaf, mn, mx);
+			if (++done % OOC_LEAF == 0 || done == h.n_spheres) {
+				fwrite(&leaf, sizeof(leaf), 1, leaves);
+				leaf = empty_node();
+			}
+			if (outbuf.size() * sizeof(ooc_sphere) >= (1 << 20)) {
+				fwrite(&outbuf[0], sizeof(ooc_sphere), outbuf.size(), out);
+				outbuf.clear();
+			}
+		});
+		if (h.n_spheres == 0)
+			fwrite(&leaf, sizeof(leaf), 1, leaves);	// a root, empty
+		if (!outbuf.empty())
+			fwrite(&outbuf[0], sizeof(ooc_sphere), outbuf.size(), out);
+		std::vector<char> pad(h.blocks_offset - h.spheres_offset - h.n_spheres * sizeof(ooc_sphere), 0);
+		if (!pad.empty())
+			fwrite(&pad[0], 1, pad.size(), out);
+		ok = ok && !ferror(leaves) && done == h.n_spheres;
+		fclose(leaves);
+		return ok;
+	}
+
+	// pass 4: level L from level L-1, two nodes at a time
+	bool build_level(int L) {
+		FILE* in = fopen(level_path(L - 1).c_str(), "rb");
+		FILE* out = fopen(level_path(L).c_str(), "wb");
+		if (!in || !out)
+			return false;
+		ooc_node pair[2];
+		size_t got;
+		while ((got = fread(pair, sizeof(ooc_node), 2, in)) > 0) {
+			ooc_node nd = pair[0];
+			if (got == 2)
+				grow(nd, pair[1].bmin, pair[1].bmax);
+			fwrite(&nd, sizeof(nd), 1, out);
+		}
+		fclose(in);
+		bool ok = !ferror(out);
+		fclose(out);
+		return ok;
+	}
+
+	// pass 5: the treelets of every block level; each level file is read sequentially
+	bool write_blocks(const ooc_header& h, FILE* out) {
+		std::vector<char> block(OOC_BLOCK);
+		ooc_node none = empty_node();
+		for (uint32_t b = 0; b < h.n_block_levels; ++b) {
+			int top = h.block_top[b], depth = top - h.block_top[b + 1];
+			FILE* lv[OOC_TREELET_DEPTH] = {};
+			for (int d = 0; d < depth; ++d)
+				if (!(lv[d] = fopen(level_path(top - d).c_str(), "rb")))
+					return false;
+			for (uint64_t i = 0; i < h.level_size[top]; ++i) {
+				memset(&block[0], 0, OOC_BLOCK);
+				ooc_node* nodes = (ooc_node*)&block[0];
+				for (int d = 0; d < depth; ++d)
+					for (int k = 0; k < (1 << d); ++k) {
+						ooc_node& nd = nodes[(1 << d) - 1 + k];
+						uint64_t index = (i << d) + k;
+						if (!lv[d] || index >= h.level_size[top - d] || fread(&nd, sizeof(nd), 1, lv[d]) != 1)
+							nd = none;
+					}
+				fwrite(&block[0], 1, OOC_BLOCK, out);
+			}
+			for (FILE* f : lv)
+				if (f)
+					fclose(f);
+		}
+		return !ferror(out);
+	}
+
+	static void fseek_64(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+		_fseeki64(f, (__int64)offset, SEEK_SET);
+#else
+		fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+	}
+};
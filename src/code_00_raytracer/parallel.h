@@ -0,0 +1,32 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+/*
+Minimal helpers to run the ray tracer on all the cores.
+*/
+
+inline int n_hardware_threads() {
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+/* calls f(i) for every i in [0,n), using n_threads threads (the calling one included).
+*  Iterations are handed out one at a time from a shared counter, so it balances well
+*  also when iterations have very different costs (e.g. tiles or rows of an image).
+*/
+template <class F>
+void parallel_for(int n, F f, int n_threads = n_hardware_threads()) {
+	std::atomic<int> next(0);
+	auto run = [&]() {
+		for (int i = next++; i < n; i = next++)
+			f(i);
+	};
+	std::vector<std::thread> threads;
+	for (int t = 1; t < std::min(n_threads, n); ++t)
+		threads.push_back(std::thread(run));
+	run();
+	for (auto& t : threads)
+		t.join();
+}
@@ -0,0 +1,300 @@
+#pragma once
+#include "raytracer.h"
+
+/*
+Scene made of several kinds of primitives: spheres, planes, axis aligned boxes, triangles
+and general quadrics (ellipsoids, cylinders, cones, ... clipped by a box).
+
+There is no base class with a virtual hit(): each kind of primitive is stored in its own
+structure of arrays (one array per coefficient) and intersected by its own kernel, which
+runs over all the primitives of that type in batches of PRIM_BATCH. Inside a batch the
+kernel only does arithmetic and selects (no branches), so the compiler can vectorize it;
+the closest of the batch is then picked with a short scalar loop.
+Only the primitive finally hit gets its normal and color computed (complete_hit()).
+
+The id of the hit encodes type and index: see prim_id(), prim_type(), prim_index().
+*/
+
+#define PRIM_BATCH 8
+#define PRIM_EPS 1e-4f
+
+enum primitive_type { PRIM_SPHERE, PRIM_PLANE, PRIM_BOX, PRIM_TRIANGLE, PRIM_QUADRIC, PRIM_TYPES };
+
+inline int prim_id(int type, int index) { return (type << 28) | index; }
+inline int prim_type(int id) { return id >> 28; }
+inline int prim_index(int id) { return id & ((1 << 28) - 1); }
+
+/* K arrays of floats, one per coefficient, padded with zeros to a multiple of PRIM_BATCH
+*  so that kernels can always read full batches
+*/
+template <int K>
+struct soa {
+	soa() :n(0) {}
+	std::vector<float> col[K];
+	std::vector<p3> color;
+	int n;
+
+	void push(const float* v, p3 c) {
+		int padded = ((n + 1 + PRIM_BATCH - 1) / PRIM_BATCH) * PRIM_BATCH;
+		for (int j = 0; j < K; ++j) {
+			col[j].resize(padded, 0.f);
+			col[j][n] = v[j];
+		}
+		color.push_back(c);
+		++n;
+	}
+
+	const float* operator[](int j) const { return &col[j][0]; }
+};
+
+// ray data shared by all the kernels
+struct prim_ray {
+	prim_ray(ray r) :o(r.orig), d(r.dir), inv_d(1.f / r.dir.x, 1.f / r.dir.y, 1.f / r.dir.z) {}
+	p3 o, d, inv_d;
+};
+
+/* every kernel fills t[k] for the k-th primitive of the batch starting at i0,
+*  with FAR_AWAY for no intersection (or intersection farther than t_max)
+*/
+inline void sphere_batch(const soa<4>& s, int i0, const prim_ray& r, float t_max, float* t) {
+	const float* cx = s[0] + i0, *cy = s[1] + i0, *cz = s[2] + i0, *rad = s[3] + i0;
+	float a = r.d * r.d;
+	for (int k = 0; k < PRIM_BATCH; ++k) {
+		float ox = r.o.x - cx[k], oy = r.o.y - cy[k], oz = r.o.z - cz[k];
+		float b = ox * r.d.x + oy * r.d.y + oz * r.d.z;
+		float c = ox * ox + oy * oy + oz * oz - rad[k] * rad[k];
+		float disc = b * b - a * c;
+		float sq = sqrtf(std::max(disc, 0.f));
+		float t0 = (-b - sq) / a, t1 = (-b + sq) / a;
+		float tt = (t0 > PRIM_EPS) ? t0 : t1;
+		bool ok = (disc >= 0.f) & (tt > PRIM_EPS) & (tt < t_max) & (i0 + k < s.n);
+		t[k] = ok ? tt : FAR_AWAY;
+	}
+}
+
+// plane: n.p = d
+inline void plane_batch(const soa<4>& s, int i0, const prim_ray& r, float t_max, float* t) {
+	const float* nx = s[0] + i0, *ny = s[1] + i0, *nz = s[2] + i0, *d = s[3] + i0;
+	for (int k = 0; k < PRIM_BATCH; ++k) {
+		float den = nx[k] * r.d.x + ny[k] * r.d.y + nz[k] * r.d.z;
+		float num = d[k] - (nx[k] * r.o.x + ny[k] * r.o.y + nz[k] * r.o.z);
+		float tt = num / ((den == 0.f) ? 1e-30f : den);
+		bool ok = (tt > PRIM_EPS) & (tt < t_max) & (i0 + k < s.n);
+		t[k] = ok ? tt : FAR_AWAY;
+	}
+}
+
+// axis aligned box: min, max (slab test)
+inline void box_batch(const soa<6>& s, int i0, const prim_ray& r, float t_max, float* t) {
+	for (int k = 0; k < PRIM_BATCH; ++k) {
+		float tx0 = (s[0][i0 + k] - r.o.x) * r.inv_d.x, tx1 = (s[3][i0 + k] - r.o.x) * r.inv_d.x;
+		float ty0 = (s[1][i0 + k] - r.o.y) * r.inv_d.y, ty1 = (s[4][i0 + k] - r.o.y) * r.inv_d.y;
+		float tz0 = (s[2][i0 + k] - r.o.z) * r.inv_d.z, tz1 = (s[5][i0 + k] - r.o.z) * r.inv_d.z;
+		float tnear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::min(tz0, tz1));
+		float tfar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1));
+		float tt = (tnear > PRIM_EPS) ? tnear : tfar;
+		bool ok = (tnear <= tfar) & (tt > PRIM_EPS) & (tt < t_max) & (i0 + k < s.n);
+		t[k] = ok ? tt : FAR_AWAY;
+	}
+}
+
+// triangle: v0, e1 = v1-v0, e2 = v2-v0 (Moller-Trumbore)
+inline void triangle_batch(const soa<9>& s, int i0, const prim_ray& r, float t_max, float* t) {
+	for (int k = 0; k < PRIM_BATCH; ++k) {
+		int i = i0 + k;
+		p3 v0(s[0][i], s[1][i], s[2][i]), e1(s[3][i], s[4][i], s[5][i]), e2(s[6][i], s[7][i], s[8][i]);
+		p3 p = cross(r.d, e2);
+		float det = e1 * p;
+		float inv = 1.f / ((det == 0.f) ? 1e-30f : det);
+		p3 so = r.o - v0;
+		float u = (so * p) * inv;
+		p3 q = cross(so, e1);
+		float v = (r.d * q) * inv;
+		float tt = (e2 * q) * inv;
+		bool ok = (fabsf(det) > 1e-12f) & (u >= 0.f) & (v >= 0.f) & (u + v <= 1.f) & (tt > PRIM_EPS) & (tt < t_max) & (i < s.n);
+		t[k] = ok ? tt : FAR_AWAY;
+	}
+}
+
+/* quadric: A x^2 + B y^2 + C z^2 + D xy + E xz + F yz + G x + H y + I z + J = 0
+*  (coefficients 0..9), clipped by the box of coefficients 10..15 (min, max)
+*/
+inline void quadric_batch(const soa<16>& s, int i0, const prim_ray& r, float t_max, float* t) {
+	const p3& o = r.o, & d = r.d;
+	for (int k = 0; k < PRIM_BATCH; ++k) {
+		int i = i0 + k;
+		float A = s[0][i], B = s[1][i], C = s[2][i], D = s[3][i], E = s[4][i];
+		float F = s[5][i], G = s[6][i], H = s[7][i], I = s[8][i], J = s[9][i];
+		float a = A * d.x * d.x + B * d.y * d.y + C * d.z * d.z + D * d.x * d.y + E * d.x * d.z + F * d.y * d.z;
+		float b = 2 * (A * o.x * d.x + B * o.y * d.y + C * o.z * d.z)
+			+ D * (o.x * d.y + o.y * d.x) + E * (o.x * d.z + o.z * d.x) + F * (o.y * d.z + o.z * d.y)
+			+ G * d.x + H * d.y + I * d.z;
+		float c = A * o.x * o.x + B * o.y * o.y + C * o.z * o.z + D * o.x * o.y + E * o.x * o.z + F * o.y * o.z
+			+ G * o.x + H * o.y + I * o.z + J;
+
+		bool linear = fabsf(a) < 1e-12f;
+		float disc = b * b - 4 * a * c;
+		float sq = sqrtf(std::max(disc, 0.f));
+		float inv2a = 0.5f / (linear ? 1.f : a);
+		float ta = (-b - sq) * inv2a, tb = (-b + sq) * inv2a;
+		float tl = -c / ((b == 0.f) ? 1e-30f : b);
+		float t0 = linear ? tl : std::min(ta, tb);
+		float t1 = linear ? tl : std::max(ta, tb);
+		bool real = linear | (disc >= 0.f);
+
+		// a root counts only if it is inside the clipping box
+		p3 p0 = o + d * t0, p1 = o + d * t1;
+		bool in0 = (p0.x >= s[10][i]) & (p0.y >= s[11][i]) & (p0.z >= s[12][i]) & (p0.x <= s[13][i]) & (p0.y <= s[14][i]) & (p0.z <= s[15][i]);
+		bool in1 = (p1.x >= s[10][i]) & (p1.y >= s[11][i]) & (p1.z >= s[12][i]) & (p1.x <= s[13][i]) & (p1.y <= s[14][i]) & (p1.z <= s[15][i]);
+		bool ok0 = real & in0 & (t0 > PRIM_EPS);
+		bool ok1 = real & in1 & (t1 > PRIM_EPS);
+		float tt = ok0 ? t0 : t1;
+		bool ok = (ok0 | ok1) & (tt < t_max) & (i < s.n);
+		t[k] = ok ? tt : FAR_AWAY;
+	}
+}
+
+struct primitive_scene {
+	soa<4> spheres;		// center, radius
+	soa<4> planes;		// normal, d
+	soa<6> boxes;		// min, max
+	soa<9> triangles;	// v0, e1, e2
+	soa<16> quadrics;	// 10 coefficients, clipping box min, max
+
+	void add(sphere s) {
+		float v[4] = { s.center.x, s.center.y, s.center.z, s.radius };
+		spheres.push(v, s.color);
+	}
+	// plane of points p such that n.p = d
+	void add_plane(p3 n, float d, p3 col) {
+		n = normalize(n);
+		float v[4] = { n.x, n.y, n.z, d };
+		planes.push(v, col);
+	}
+	void add_box(p3 bmin, p3 bmax, p3 col) {
+		float v[6] = { bmin.x, bmin.y, bmin.z, bmax.x, bmax.y, bmax.z };
+		boxes.push(v, col);
+	}
+	void add_triangle(p3 a, p3 b, p3 c, p3 col) {
+		p3 e1 = b - a, e2 = c - a;
+		float v[9] = { a.x, a.y, a.z, e1.x, e1.y, e1.z, e2.x, e2.y, e2.z };
+		triangles.push(v, col);
+	}
+	// q: the 10 coefficients A..J, the surface is clipped to the box [bmin,bmax]
+	void add_quadric(const float* q, p3 bmin, p3 bmax, p3 col) {
+		float v[16];
+		for (int i = 0; i < 10; ++i) v[i] = q[i];
+		v[10] = bmin.x; v[11] = bmin.y; v[12] = bmin.z;
+		v[13] = bmax.x; v[14] = bmax.y; v[15] = bmax.z;
+		quadrics.push(v, col);
+	}
+	// ((x-cx)/rx)^2 + ((y-cy)/ry)^2 + ((z-cz)/rz)^2 = 1
+	void add_ellipsoid(p3 c, p3 radii, p3 col) {
+		p3 k(1.f / (radii.x * radii.x), 1.f / (radii.y * radii.y), 1.f / (radii.z * radii.z));
+		float q[10] = { k.x, k.y, k.z, 0, 0, 0, -2 * c.x * k.x, -2 * c.y * k.y, -2 * c.z * k.z,
+			c.x * c.x * k.x + c.y * c.y * k.y + c.z * c.z * k.z - 1 };
+		add_quadric(q, c - radii, c + radii, col);
+	}
+	// open cylinder with the axis parallel to y, from base.y to base.y + height
+	void add_cylinder(p3 base, float radius, float height, p3 col) {
+		float q[10] = { 1, 0, 1, 0, 0, 0, -2 * base.x, 0, -2 * base.z,
+			base.x * base.x + base.z * base.z - radius * radius };
+		add_quadric(q, base - p3(radius, 0, radius), base + p3(radius, height, radius), col);
+	}
+
+	hit_info closest_hit(ray r) const {
+		prim_ray pr(r);
+		float best_t = FAR_AWAY;
+		int best_id = -1;
+		closest(spheres, sphere_batch, PRIM_SPHERE, pr, best_t, best_id);
+		closest(planes, plane_batch, PRIM_PLANE, pr, best_t, best_id);
+		closest(boxes, box_batch, PRIM_BOX, pr, best_t, best_id);
+		closest(triangles, triangle_batch, PRIM_TRIANGLE, pr, best_t, best_id);
+		closest(quadrics, quadric_batch, PRIM_QUADRIC, pr, best_t, best_id);
+		if (best_id < 0)
+			return hit_info();
+		return complete_hit(r, best_t, best_id);
+	}
+
+	bool any_hit(ray r, float t_max) const {
+		prim_ray pr(r);
+		return any(spheres, sphere_batch, pr, t_max) || any(planes, plane_batch, pr, t_max)
+			|| any(boxes, box_batch, pr, t_max) || any(triangles, triangle_batch, pr, t_max)
+			|| any(quadrics, quadric_batch, pr, t_max);
+	}
+
+	// position, normal and color of the hit with primitive `id` at distance t
+	hit_info complete_hit(ray r, float t, int id) const {
+		hit_info hi;
+		hi.hit = true;
+		hi.t = t;
+		hi.id = id;
+		hi.p = r.orig + r.dir * t;
+		int i = prim_index(id);
+		switch (prim_type(id)) {
+		case PRIM_SPHERE:
+			hi.n = hi.p - p3(spheres[0][i], spheres[1][i], spheres[2][i]);
+			hi.color = spheres.color[i];
+			break;
+		case PRIM_PLANE:
+			hi.n = p3(planes[0][i], planes[1][i], planes[2][i]);
+			hi.color = planes.color[i];
+			break;
+		case PRIM_BOX: {
+			// the normal is along the axis where the point is closest to a face
+			p3 c = (p3(boxes[0][i], boxes[1][i], boxes[2][i]) + p3(boxes[3][i], boxes[4][i], boxes[5][i])) * 0.5f;
+			p3 e = p3(boxes[3][i], boxes[4][i], boxes[5][i]) - c;
+			p3 l = hi.p - c;
+			p3 q(fabsf(l.x) / e.x, fabsf(l.y) / e.y, fabsf(l.z) / e.z);
+			if (q.x >= q.y && q.x >= q.z) hi.n = p3(l.x > 0 ? 1.f : -1.f, 0, 0);
+			else if (q.y >= q.z) hi.n = p3(0, l.y > 0 ? 1.f : -1.f, 0);
+			else hi.n = p3(0, 0, l.z > 0 ? 1.f : -1.f);
+			hi.color = boxes.color[i];
+		} break;
+		case PRIM_TRIANGLE:
+			hi.n = cross(p3(triangles[3][i], triangles[4][i], triangles[5][i]), p3(triangles[6][i], triangles[7][i], triangles[8][i]));
+			hi.color = triangles.color[i];
+			break;
+		case PRIM_QUADRIC: {
+			const p3& p = hi.p;
+			float A = quadrics[0][i], B = quadrics[1][i], C = quadrics[2][i], D = quadrics[3][i], E = quadrics[4][i];
+			float F = quadrics[5][i], G = quadrics[6][i], H = quadrics[7][i], I = quadrics[8][i];
+			hi.n = p3(2 * A * p.x + D * p.y + E * p.z + G, 2 * B * p.y + D * p.x + F * p.z + H, 2 * C * p.z + E * p.x + F * p.y + I);
+			hi.color = quadrics.color[i];
+		} break;
+		}
+		hi.n = normalize(hi.n);
+		// planes, triangles and open quadrics are two sided: face the normal toward the ray
+		if (hi.n * r.dir > 0)
+			hi.n = hi.n * -1.f;
+		return hi;
+	}
+
+private:
+	template <class SOA, class KERNEL>
+	static void closest(const SOA& s, KERNEL kernel, int type, const prim_ray& r, float& best_t, int& best_id) {
+		float t[PRIM_BATCH];
+		for (int i0 = 0; i0 < s.n; i0 += PRIM_BATCH) {
+			kernel(s, i0, r, best_t, t);
+			for (int k = 0; k < PRIM_BATCH; ++k)
+				if (t[k] < best_t) {
+					best_t = t[k];
+					best_id = prim_id(type, i0 + k);
+				}
+		}
+	}
+
+	template <class SOA, class KERNEL>
+	static bool any(const SOA& s, KERNEL kernel, const prim_ray& r, float t_max) {
+		float t[PRIM_BATCH];
+		for (int i0 = 0; i0 < s.n; i0 += PRIM_BATCH) {
+			kernel(s, i0, r, t_max, t);
+			bool found = false;
+			for (int k = 0; k < PRIM_BATCH; ++k)
+				found |= (t[k] < t_max);
+			if (found)
+				return true;
+		}
+		return false;
+	}
+};
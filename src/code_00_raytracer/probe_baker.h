@@ -0,0 +1,159 @@
+#pragma once
+#include <vector>
+#include "raytracer.h"
+#include "parallel.h"
+#include "../common/probe_file.h"
+
+/*
+Bakes reflection probes for the raster examples with the ray tracer (file format in
+common/probe_file.h).
+For each probe the 6 faces of a cube map centered in its position are ray traced, in
+parallel over faces and tiles, with the directions of the GL cube map convention; rays that
+miss the scene see sky(). Colors are stored divided by 255 (1 = full intensity).
+The levels m > 0 are prefiltered for the GGX distribution of roughness m / (n_mips - 1),
+assuming view = normal = reflected direction (as in the split sum approximation): each texel
+averages n_samples directions importance sampled around it, each read from a box filtered
+copy of the radiance at a resolution matching the solid angle of the sample (filtered
+importance sampling), so few samples are enough even for rough levels.
+*/
+struct probe_baker {
+	int face_size = 128;	// a power of two
+	int n_mips = 6;			// 128, 64, ..., 4 (at most log2(face_size) + 1)
+	int n_samples = 64;		// per texel of the prefiltered levels
+	p3 Lp = p3(1, 1, -1);	// point light
+
+	// color of the background in direction d
+	static p3 sky(p3 d) {
+		float t = 0.5f * (d.y + 1.f);
+		return p3(60, 60, 70) * (1.f - t) + p3(140, 180, 255) * t;
+	}
+
+	// direction of texel (i,j) of face f of a cube map of size s (GL convention)
+	static p3 texel_dir(int f, int i, int j, int s) {
+		float sc = 2.f * (i + 0.5f) / s - 1.f, tc = 2.f * (j + 0.5f) / s - 1.f;
+		switch (f) {
+		case 0: return p3(1, -tc, -sc);
+		case 1: return p3(-1, -tc, sc);
+		case 2: return p3(sc, 1, tc);
+		case 3: return p3(sc, -1, -tc);
+		case 4: return p3(sc, -tc, 1);
+		default: return p3(-sc, -tc, -1);
+		}
+	}
+
+	// levels baked: n_mips, down to 1x1 at most
+	int mips() const { return (int)std::min<uint32_t>(n_mips, probe_file::max_mips(face_size)); }
+
+	// bakes the probe at pos; false if face_size is not a power of two
+	template <class SCENE>
+	bool bake(const SCENE& scene, p3 pos, probe_file::probe& out) const {
+		if (!probe_file::valid_size(face_size))
+			return false;
+		int n_levels = mips();
+		const int TILE = 16;
+		int tiles = (face_size + TILE - 1) / TILE;
+
+		// 1. radiance, and its box filtered levels
+		std::vector<std::vector<p3>> levels(1, std::vector<p3>(6 * face_size * face_size));
+		parallel_for(6 * tiles * tiles, [&](int t) {
+			int f = t / (tiles * tiles), i0 = (t % tiles) * TILE, j0 = (t / tiles % tiles) * TILE;
+			for (int j = j0; j < std::min(j0 + TILE, face_size); ++j)
+				for (int i = i0; i < std::min(i0 + TILE, face_size); ++i) {
+					ray r(pos, normalize(texel_dir(f, i, j, face_size)));
+					hit_info hi = scene.closest_hit(r);
+					levels[0][(f * face_size + j) * face_size + i] = (hi.hit ? direct_light(hi, scene, Lp) : sky(r.dir)) * (1.f / 255.f);
+				}
+		});
+		for (int s = face_size / 2; s >= 1; s /= 2) {
+			const std::vector<p3>& src = levels.back();
+			std::vector<p3> dst(6 * s * s);
+			for (int f = 0; f < 6; ++f)
+				for (int j = 0; j < s; ++j)
+					for (int i = 0; i < s; ++i) {
+						const p3* a = &src[(f * 2 * s + 2 * j) * 2 * s + 2 * i];
+						dst[(f * s + j) * s + i] = (a[0] + a[1] + a[2 * s] + a[2 * s + 1]) * 0.25f;
+					}
+			levels.push_back(dst);
+		}
+
+		// 2. prefiltered levels
+		probe_file pf;
+		pf.face_size = face_size;
+		pf.n_mips = n_levels;
+		out.pos[0] = pos.x;
+		out.pos[1] = pos.y;
+		out.pos[2] = pos.z;
+		out.texels.resize(pf.probe_texels());
+		for (int m = 0; m < n_levels; ++m) {
+			int s = probe_file::level_size(face_size, m);
+			float roughness = (n_levels > 1) ? float(m) / (n_levels - 1) : 0.f;
+			parallel_for(6 * s, [&](int row) {
+				int f = row / s, j = row % s;
+				for (int i = 0; i < s; ++i) {
+					p3 c = (m == 0) ? levels[0][(f * s + j) * s + i] : prefilter(levels, normalize(texel_dir(f, i, j, s)), roughness);
+					out.texels[pf.offset(m, f) + j * s + i] = probe_file::pack_rgb9e5(c.x, c.y, c.z);
+				}
+			});
+		}
+		return true;
+	}
+
+private:
+	// bilinear lookup in direction d of the box filtered level l (clamped at the face borders)
+	static p3 lookup(const std::vector<std::vector<p3>>& levels, p3 d, int l) {
+		float ax = fabs(d.x), ay = fabs(d.y), az = fabs(d.z);
+		int f;
+		float sc, tc, ma;
+		if (ax >= ay && ax >= az) { f = d.x > 0 ? 0 : 1; ma = ax; sc = d.x > 0 ? -d.z : d.z; tc = -d.y; }
+		else if (ay >= az) { f = d.y > 0 ? 2 : 3; ma = ay; sc = d.x; tc = d.y > 0 ? d.z : -d.z; }
+		else { f = d.z > 0 ? 4 : 5; ma = az; sc = d.z > 0 ? d.x : -d.x; tc = -d.y; }
+		const std::vector<p3>& L = levels[l];
+		int s = (int)sqrt(L.size() / 6);
+		float x = (sc / ma + 1.f) * 0.5f * s - 0.5f, y = (tc / ma + 1.f) * 0.5f * s - 0.5f;
+		x = std::min(std::max(x, 0.f), s - 1.f);
+		y = std::min(std::max(y, 0.f), s - 1.f);
+		int x0 = (int)x, y0 = (int)y;
+		int x1 = std::min(x0 + 1, s - 1), y1 = std::min(y0 + 1, s - 1);
+		float fx = x - x0, fy = y - y0;
+		const p3* face = &L[f * s * s];
+		return (face[y0 * s + x0] * (1 - fx) + face[y0 * s + x1] * fx) * (1 - fy) + (face[y1 * s + x0] * (1 - fx) + face[y1 * s + x1] * fx) * fy;
+	}
+
+	// radiance around n convolved with GGX of the given roughness
+	p3 prefilter(const std::vector<std::vector<p3>>& levels, p3 n, float roughness) const {
+		const float pi = 3.14159265f;
+		float a = roughness * roughness, a2 = a * a;
+		p3 t = normalize(cross(fabs(n.y) < 0.99f ? p3(0, 1, 0) : p3(1, 0, 0), n)), b = cross(n, t);
+		float texel_angle = 4.f * pi / (6.f * face_size * face_size);
+		p3 sum(0, 0, 0);
+		float wsum = 0.f;
+		for (int k = 0; k < n_samples; ++k) {
+			// Hammersley point -> half vector of GGX around n
+			unsigned int bits = k;
+			bits = (bits << 16) | (bits >> 16);
+			bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+			bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+			bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+			bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+			float u1 = (k + 0.5f) / n_samples, u2 = bits * 2.3283064e-10f;
+			float phi = 2 * pi * u1;
+			float cos_t = sqrt((1 - u2) / (1 + (a2 - 1) * u2)), sin_t = sqrt(1 - cos_t * cos_t);
+			p3 h = t * (sin_t * cos(phi)) + b * (sin_t * sin(phi)) + n * cos_t;
+			p3 l = h * (2 * (n * h)) - n;
+			float nl = n * l;
+			if (nl <= 0.f)
+				continue;
+			// level whose texels cover the solid angle of the sample (pdf = D / 4 with v = n)
+			float den = cos_t * cos_t * (a2 - 1) + 1;
+			float pdf = a2 / (pi * den * den) * 0.25f;
+			float sample_angle = 1.f / (n_samples * pdf + 1e-6f);
+			float lev = std::max(0.f, 0.5f * log2(sample_angle / texel_angle) + 1.f);
+			int l0 = std::min((int)lev, (int)levels.size() - 1), l1 = std::min(l0 + 1, (int)levels.size() - 1);
+			float fl = std::min(1.f, lev - l0);
+			p3 c = lookup(levels, l, l0) * (1 - fl) + lookup(levels, l, l1) * fl;
+			sum = sum + c * nl;
+			wsum += nl;
+		}
+		return (wsum > 0.f) ? sum * (1.f / wsum) : lookup(levels, n, 0);
+	}
+};
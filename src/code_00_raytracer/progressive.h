@@ -0,0 +1,82 @@
+#pragma once
+#include "raytracer.h"
+
+/*
+Coarse-to-fine (progressive) rendering for fast previews.
+
+The first level renders one pixel every `start_step` pixels along each axis (e.g. 1/16 of the
+resolution), then every level halves the step. A level only renders the pixels that are on its
+grid but were not on the grid of the coarser levels, so the samples already taken are reused and
+at the end every pixel has been rendered exactly once, as in a plain full resolution render.
+The only extra cost is upsample(), which is linear in the number of pixels and can be skipped
+when no preview is needed.
+*/
+struct progressive_render {
+	// start_step must be a power of two
+	progressive_render(int _w, int _h, int start_step = 16) :w(_w), h(_h), step(start_step), first(true) {
+		samples.resize(w * h);
+	}
+
+	int w, h;
+	int step;                  // step of the level that refine() will render next (0 when done)
+	bool first;                // true until the first level has been rendered
+	std::vector<p3> samples;   // rendered values, valid on the grid of the last level rendered
+
+	bool done() const { return step == 0; }
+
+	// step of the last level rendered
+	int last_step() const { return (step == 0) ? 1 : step * 2; }
+
+	/* render the next level. shade(i,j) returns the color of pixel (i,j), with (0,0) bottom left
+	*  as in the other examples. Returns the number of pixels rendered in this level.
+	*/
+	template <class SHADE>
+	int refine(SHADE shade) {
+		if (done())
+			return 0;
+		int s = step;
+		int n = 0;
+		for (int j = 0; j < h; j += s)
+			for (int i = 0; i < w; i += s) {
+				// already rendered by a coarser level
+				if (!first && (i % (2 * s)) == 0 && (j % (2 * s)) == 0)
+					continue;
+				samples[j * w + i] = shade(i, j);
+				++n;
+			}
+		first = false;
+		step = s / 2;
+		return n;
+	}
+
+	// write in `out` the full resolution image obtained by bilinear interpolation of the samples
+	void upsample(image& out) const {
+		int s = last_step();
+		if (s == 1) {
+			for (int j = 0; j < h; ++j)
+				for (int i = 0; i < w; ++i) {
+					const p3& c = samples[j * w + i];
+					out.set_pixel(i, j, c.x, c.y, c.z);
+				}
+			return;
+		}
+
+		// last column/row on the grid of the current level
+		int last_i = ((w - 1) / s) * s;
+		int last_j = ((h - 1) / s) * s;
+		for (int j = 0; j < h; ++j) {
+			int j0 = (j / s) * s;
+			int j1 = std::min(j0 + s, last_j);
+			float fy = (j1 == j0) ? 0.f : (j - j0) / float(s);
+			for (int i = 0; i < w; ++i) {
+				int i0 = (i / s) * s;
+				int i1 = std::min(i0 + s, last_i);
+				float fx = (i1 == i0) ? 0.f : (i - i0) / float(s);
+
+				p3 c = samples[j0 * w + i0] * ((1 - fx) * (1 - fy)) + samples[j0 * w + i1] * (fx * (1 - fy))
+					+ samples[j1 * w + i0] * ((1 - fx) * fy) + samples[j1 * w + i1] * (fx * fy);
+				out.set_pixel(i, j, c.x, c.y, c.z);
+			}
+		}
+	}
+};
@@ -0,0 +1,211 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <math.h>
+
+/*
+Core types of the CPU ray tracer (the same ones used in main_rt.cpp / main_rt_AA.cpp),
+collected here so that the other ray tracing examples can share them.
+*/
+
+#ifndef FAR_AWAY
+#define FAR_AWAY 10e20
+#endif
+
+/*
+Simple class to implement an image saved in PPM format
+https://netpbm.sourceforge.net/doc/ppm.html
+*/
+struct image {
+	image(int _w, int _h) :w(_w), h(_h) { data.resize(w * h * 3, 0); } // initialize buffer (RGB per pixel)
+	unsigned int w, h;
+
+	std::vector<int>  data;
+
+	// Set a pixel value (values expected in 0..255)
+	template <class S>
+	void set_pixel(int i, int j, S  r, S  g, S  b) {
+		j = h - 1 - j; // flip vertically for image coordinate system
+		data[(j * w + i) * 3] = (unsigned char)r;
+		data[(j * w + i) * 3 + 1] = (unsigned char)g;
+		data[(j * w + i) * 3 + 2] = (unsigned char)b;
+	}
+
+	// Save image as ASCII PPM (P3) file
+	void save(const char* filename) {
+		std::ofstream f;
+		f.open(filename);
+		f << "P3\n";
+		f << w << " " << h << std::endl;
+
+		// max color value (use maximum found in buffer)
+		f << *(std::max_element(data.begin(), data.end())) << std::endl;
+
+		// write each pixel as "R G B" per line
+		for (unsigned int i = 0; i < data.size() / 3; ++i)
+			f << data[i * 3] << " " << data[i * 3 + 1] << " " << data[i * 3 + 2] << std::endl;
+		f.close();
+	}
+};
+
+
+struct p3 {
+	p3():x(0.f), y(0.f), z(0.f) {} // default constructor
+	p3(float _x, float _y, float _z):x(_x), y(_y), z(_z){} // value constructor
+
+	// vector arithmetic helpers
+	p3 operator +(p3 o) const { return p3(o.x + x, o.y + y, o.z + z); } // sum
+	p3 operator -(p3 o) const { return p3(x -o.x , y  - o.y , z - o.z ); } //subtraction
+	float operator *(p3 o) const { return x * o.x + y * o.y + z * o.z; } // dot product
+	p3 operator *(float s) const { return p3(x*s, y * s,z* s); } // scalar multiply
+	float operator [](int i) const { return (&x)[i]; } // component access (0=x, 1=y, 2=z)
+	float x, y, z;
+};
+
+inline p3 cross(p3 a, p3 b) { return p3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline p3 mul(p3 a, p3 b) { return p3(a.x * b.x, a.y * b.y, a.z * b.z); } // component-wise product
+inline float length(p3 a) { return sqrt(a * a); }
+inline p3 normalize(p3 a) { return a * (1.f / length(a)); }
+inline p3 p3_min(p3 a, p3 b) { return p3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+inline p3 p3_max(p3 a, p3 b) { return p3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+
+struct ray {
+	ray(p3 o, p3 d):orig(o),dir(d){} // origin and direction
+
+	p3 orig, dir;
+};
+
+struct sphere {
+	sphere(p3 c, float r, p3 col):center(c),radius(r),color(col){} // center, radius, color
+
+	p3 center, color;
+	float radius;
+};
+
+struct hit_info {
+
+	hit_info() :hit(false), t(FAR_AWAY), id(-1) {} // default: no hit, t very large
+	bool hit;  // whether intersection occured
+	float t;   // distance along ray
+	p3 p;      // hit position
+	p3 n;      // surface normal at hit
+	p3 color;  // object color
+	long long id;    // index of the primitive hit (-1 if none), 64 bit for out of core scenes
+};
+
+// Ray-sphere intersection: returns hit_info with nearest positive t if any
+inline hit_info  hit_sphere(ray r, sphere s) {
+	// coefficients for quadratic equation A t^2 + B t + C = 0
+	float A = r.dir* r.dir;
+	float B = r.dir*(r.orig - s.center) * 2;
+	float C = (r.orig - s.center)*(r.orig - s.center) - s.radius * s.radius;
+
+	float delta = B * B - 4 * A * C;
+
+	// no real roots -> no intersection
+	if (delta < 0)
+		return hit_info();
+
+	hit_info hi;
+	// choose smaller root first (closest intersection)
+	float t = (-B - sqrt(delta)) / (2 * A);
+	if( t <= 0 )
+		t = (-B + sqrt(delta)) / (2 * A);
+	// if still non-positive, intersection is behind ray origin
+	if (t <= 0)
+		return hit_info();
+
+	// fill hit information
+	hi.t = t;
+	hi.p =  r.orig + r.dir * t;
+	hi.n = hi.p - s.center;					 // unnormalized normal
+	hi.n = hi.n * (1.0 / sqrt(hi.n * hi.n)); // normalize normal
+	hi.color = s.color;
+	hi.hit = true;
+	return hi;
+}
+
+/*
+A scene is anything that answers the two queries the renderer needs:
+	hit_info closest_hit(ray r) const;         nearest intersection along r
+	bool     any_hit(ray r, float t_max) const; is there an intersection with t < t_max?
+sphere_list is the plain "test every sphere" version used by the first examples.
+*/
+struct sphere_list {
+	std::vector< sphere > spheres;
+
+	void add(sphere s) { spheres.push_back(s); }
+
+	hit_info closest_hit(ray r) const {
+		hit_info best_hi = hit_info(); // best intersection so far
+		for (int is = 0; is < (int)spheres.size(); ++is) {
+			hit_info hi = hit_sphere(r, spheres[is]); // test intersection
+			if (hi.t < best_hi.t) { // closer hit found
+				best_hi = hi;
+				best_hi.id = is;
+			}
+		}
+		return best_hi;
+	}
+
+	bool any_hit(ray r, float t_max) const {
+		for (int is = 0; is < (int)spheres.size(); ++is) {
+			hit_info hi = hit_sphere(r, spheres[is]);
+			if (hi.hit && hi.t < t_max)
+				return true;
+		}
+		return false;
+	}
+};
+
+/*
+Pinhole camera. With the default values it is the same camera of main_rt.cpp:
+eye in the origin, looking down -z, image plane at z=-1 covering [-1,1]x[-1,1].
+yaw rotates around the y axis, pitch around the (rotated) x axis.
+*/
+struct camera {
+	camera() :eye(0, 0, 0), yaw(0.f), pitch(0.f) {}
+	p3 eye;
+	float yaw, pitch;
+
+	// camera axes in world space
+	p3 right() const { return p3(cos(yaw), 0, -sin(yaw)); }
+	p3 up() const { return cross(right(), forward()); }
+	p3 forward() const { return p3(-sin(yaw) * cos(pitch), sin(pitch), -cos(yaw) * cos(pitch)); }
+
+	// primary ray through the point (u,v) of the image plane, u and v in [0,1]
+	ray primary(float u, float v) const {
+		p3 d = right() * (-1 + 2 * u) + up() * (-1 + 2 * v) + forward();
+		return ray(eye, d);
+	}
+};
+
+// Direct lighting at the hit point hi from a single point light Lp, with hard shadows
+template <class SCENE>
+p3 direct_light(const hit_info& hi, const SCENE& scene, p3 Lp) {
+	p3 L = Lp - hi.p; // vector to light
+	float dist = sqrt(L * L);
+	L = L * (1.f / dist); // normalize L
+
+	// offset origin slightly to avoid self-intersection (shadow acne)
+	ray shadow_ray = ray(hi.p + L * 0.001f, L);
+
+	// check for occlusion: only objects between the point and the light count
+	if (scene.any_hit(shadow_ray, dist))
+		return p3(0, 0, 0);
+
+	float cosLN = hi.n * L;
+	float al = std::max(0.f, cosLN); // clamp negative values
+	return hi.color * al; // scale object color by diffuse term
+}
+
+// Color seen along the ray r
+template <class SCENE>
+p3 ray_color(ray r, const SCENE& scene, p3 Lp) {
+	hit_info hi = scene.closest_hit(r);
+	if (!hi.hit)
+		return p3(0, 0, 0); // background color (black)
+	return direct_light(hi, scene, Lp);
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <random>
+#include "raytracer.h"
+#include "parallel.h"
+
+/*
+The pixel loop of the ray tracer as a template: the options that used to be checked in the
+inner loops (or copied in different versions of main) are template parameters, so every
+combination is compiled on its own, with the branches removed and, for a fixed number of
+samples, the sample loop unrolled.
+	N_SAMPLES	rays per pixel (0: given at run time)
+	SHADOWS		trace shadow rays or not
+	SAMPLER		where the rays go inside the pixel (sampler_kind)
+	SCENE		the primitive set: any type with closest_hit / any_hit (sphere_list,
+				primitive_scene, uniform_grid, ...)
+render() is the run time entry point: it picks the variant compiled for the options given
+(render_options), and falls back to the run time sample count for unusual values.
+*/
+
+enum sampler_kind {
+	SAMPLER_CENTER,		// the center of the pixel (every sample is the same ray)
+	SAMPLER_JITTER,		// uniform random points in the pixel
+	SAMPLER_STRATIFIED	// one random point in each cell of a grid over the pixel
+};
+
+struct render_options {
+	int n_samples = 1;
+	bool shadows = true;
+	sampler_kind sampler = SAMPLER_CENTER;
+	unsigned int seed = 0;	// the same seed gives the same image, whatever the number of threads
+};
+
+// color along r: as ray_color, without the shadow ray if !SHADOWS
+template <bool SHADOWS, class SCENE>
+inline p3 shade(ray r, const SCENE& scene, p3 Lp) {
+	hit_info hi = scene.closest_hit(r);
+	if (!hi.hit)
+		return p3(0, 0, 0); // background color (black)
+	if constexpr (SHADOWS)
+		return direct_light(hi, scene, Lp);
+	else {
+		p3 L = normalize(Lp - hi.p);
+		return hi.color * std::max(0.f, hi.n * L);
+	}
+}
+
+// offset (du, dv) in [-0.5,0.5]^2 of sample s of n from the center of the pixel
+template <sampler_kind SAMPLER>
+inline void pixel_sample(int s, int n, std::mt19937& gen, float& du, float& dv) {
+	std::uniform_real_distribution<float> U(0.f, 1.f);
+	if constexpr (SAMPLER == SAMPLER_CENTER) {
+		du = dv = 0.f;
+	}
+	else if constexpr (SAMPLER == SAMPLER_JITTER) {
+		du = U(gen) - 0.5f;
+		dv = U(gen) - 0.5f;
+	}
+	else {
+		int side = (int)ceil(sqrt((float)n));
+		du = ((s % side) + U(gen)) / side - 0.5f;
+		dv = ((s / side) + U(gen)) / ((n + side - 1) / side) - 0.5f;
+	}
+}
+
+template <int N_SAMPLES, bool SHADOWS, sampler_kind SAMPLER, class SCENE>
+void render_kernel(image& a, const SCENE& scene, const camera& cam, p3 Lp, int n_samples, unsigned int seed) {
+	const int n = N_SAMPLES ? N_SAMPLES : n_samples;
+	parallel_for(a.h, [&](int j) {
+		std::mt19937 gen(seed * 7919u + j);	// one sequence per row
+		for (int i = 0; i < (int)a.w; ++i) {
+			p3 col(0, 0, 0);
+			if constexpr (SAMPLER == SAMPLER_CENTER)
+				col = shade<SHADOWS>(cam.primary((i + 0.5f) / a.w, (j + 0.5f) / a.h), scene, Lp);
+			else {
+				for (int s = 0; s < (N_SAMPLES ? N_SAMPLES : n); ++s) {
+					float du, dv;
+					pixel_sample<SAMPLER>(s, n, gen, du, dv);
+					col = col + shade<SHADOWS>(cam.primary((i + du + 0.5f) / a.w, (j + dv + 0.5f) / a.h), scene, Lp);
+				}
+				col = col * (1.f / n);
+			}
+			a.set_pixel(i, j, std::min(255.f, col.x), std::min(255.f, col.y), std::min(255.f, col.z));
+		}
+	});
+}
+
+template <int N_SAMPLES, class SCENE>
+void render_variant(image& a, const SCENE& scene, const camera& cam, p3 Lp, const render_options& o) {
+	switch (o.sampler) {
+	case SAMPLER_CENTER:
+		if (o.shadows) render_kernel<N_SAMPLES, true, SAMPLER_CENTER>(a, scene, cam, Lp, o.n_samples, o.seed);
+		else render_kernel<N_SAMPLES, false, SAMPLER_CENTER>(a, scene, cam, Lp, o.n_samples, o.seed);
+		break;
+	case SAMPLER_JITTER:
+		if (o.shadows) render_kernel<N_SAMPLES, true, SAMPLER_JITTER>(a, scene, cam, Lp, o.n_samples, o.seed);
+		else render_kernel<N_SAMPLES, false, SAMPLER_JITTER>(a, scene, cam, Lp, o.n_samples, o.seed);
+		break;
+	case SAMPLER_STRATIFIED:
+		if (o.shadows) render_kernel<N_SAMPLES, true, SAMPLER_STRATIFIED>(a, scene, cam, Lp, o.n_samples, o.seed);
+		else render_kernel<N_SAMPLES, false, SAMPLER_STRATIFIED>(a, scene, cam, Lp, o.n_samples, o.seed);
+		break;
+	}
+}
+
+// renders scene into a with the variant compiled for the options o
+template <class SCENE>
+void render(image& a, const SCENE& scene, const camera& cam, p3 Lp, const render_options& o) {
+	if (o.sampler == SAMPLER_CENTER) {
+		render_variant<1>(a, scene, cam, Lp, o);	// more samples would all be the same ray
+		return;
+	}
+	switch (o.n_samples) {
+	case 1: render_variant<1>(a, scene, cam, Lp, o); break;
+	case 4: render_variant<4>(a, scene, cam, Lp, o); break;
+	case 10: render_variant<10>(a, scene, cam, Lp, o); break;
+	case 16: render_variant<16>(a, scene, cam, Lp, o); break;
+	case 64: render_variant<64>(a, scene, cam, Lp, o); break;
+	case 200: render_variant<200>(a, scene, cam, Lp, o); break;
+	default: render_variant<0>(a, scene, cam, Lp, o); break;
+	}
+}
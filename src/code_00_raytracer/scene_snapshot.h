@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+/*
+Versioned, immutable snapshots of a scene, for editing while rendering.
+Editors never change the scene the renderer is reading: publish() (or edit()) installs a new
+copy with an atomic pointer swap (read-copy-update), and the render threads pick it up the
+next time they call read(), i.e. at the frame or pass boundary of their choice. Nobody waits
+on anybody: readers only do atomic loads and stores, editors only take a mutex among
+themselves.
+The old versions are freed with epoch based reclamation: a reader announces the epoch it
+started in (in its own slot, registered with add_reader()), a replaced version is retired
+with the epoch of its replacement, and it is deleted by a later publish() once every active
+reader has started after that epoch.
+	scene_store<sphere_list> store(scene);
+	int me = store.add_reader();
+	...
+	{
+		auto snap = store.read(me);	// the current version, until snap goes out of scope
+		render(img, snap.scene(), cam, Lp, opts);
+	}
+	// in an editor thread
+	store.edit([&](sphere_list& s) { s.spheres[id].center = p; });
+*/
+template <class SCENE>
+struct scene_store {
+	static constexpr int MAX_READERS = 64;
+
+	explicit scene_store(const SCENE& initial) :current(new version{ initial, 0 }), epoch(1) {
+		for (auto& s : slots)
+			s.store(0);
+	}
+	~scene_store() {
+		delete current.load();
+		for (auto& r : retired)
+			delete r.v;
+	}
+
+	struct version {
+		SCENE scene;
+		unsigned long long id;	// 0 for the initial scene, then +1 every publish
+	};
+
+	// a version held by a reader: it stays valid until the snapshot is destroyed
+	struct snapshot {
+		snapshot(std::atomic<unsigned long long>* _slot, const version* _v) :slot(_slot), v(_v) {}
+		snapshot(snapshot&& o) :slot(o.slot), v(o.v) { o.slot = 0; }
+		snapshot(const snapshot&) = delete;
+		~snapshot() {
+			if (slot)
+				slot->store(0);
+		}
+		const SCENE& scene() const { return v->scene; }
+		unsigned long long id() const { return v->id; }
+	private:
+		std::atomic<unsigned long long>* slot;
+		const version* v;
+	};
+
+	// every reading thread needs its own slot; returns -1 if they are all taken
+	int add_reader() {
+		int r = n_readers.load();
+		while (r < MAX_READERS && !n_readers.compare_exchange_weak(r, r + 1))
+			;
+		return (r < MAX_READERS) ? r : -1;
+	}
+
+	// the current version, reader a slot returned by add_reader. A reader can hold one
+	// snapshot at a time
+	snapshot read(int reader) {
+		assert(reader >= 0 && reader < MAX_READERS);
+		std::atomic<unsigned long long>& slot = slots[reader];
+		slot.store(epoch.load());
+		return snapshot(&slot, current.load());
+	}
+
+	// the latest version published (for editors: not protected against reclamation)
+	unsigned long long latest_id() const { return current.load()->id; }
+
+	// replaces the scene with next
+	void publish(const SCENE& next) {
+		std::lock_guard<std::mutex> lock(editors);
+		replace(next);
+	}
+
+	// publishes a copy of the latest version changed by f(SCENE&)
+	template <class F>
+	void edit(F f) {
+		std::lock_guard<std::mutex> lock(editors);
+		SCENE next = current.load()->scene;	// only editors replace it, and they hold the lock
+		f(next);
+		replace(next);
+	}
+
+	// versions replaced but still possibly in use
+	int n_retired() {
+		std::lock_guard<std::mutex> lock(editors);
+		return (int)retired.size();
+	}
+
+private:
+	struct retired_version {
+		const version* v;
+		unsigned long long epoch;	// readers that started at this epoch or earlier may hold v
+	};
+
+	std::atomic<const version*> current;
+	std::atomic<unsigned long long> epoch;
+	std::atomic<unsigned long long> slots[MAX_READERS];	// epoch of each active reader, 0 if idle
+	std::atomic<int> n_readers{ 0 };
+	std::mutex editors;
+	std::vector<retired_version> retired;
+
+	void replace(const SCENE& next) {
+		const version* old = current.load();
+		current.store(new version{ next, old->id + 1 });
+		// a reader that loaded old read the epoch before this increment
+		retired.push_back(retired_version{ old, epoch.fetch_add(1) });
+
+		unsigned long long oldest = ~0ull;
+		for (int r = 0; r < n_readers.load(); ++r) {
+			unsigned long long e = slots[r].load();
+			if (e)
+				oldest = std::min(oldest, e);
+		}
+		auto keep = std::partition(retired.begin(), retired.end(), [&](const retired_version& rv) { return rv.epoch >= oldest; });
+		for (auto it = keep; it != retired.end(); ++it)
+			delete it->v;
+		retired.erase(keep, retired.end());
+	}
+};
@@ -0,0 +1,546 @@
+#pragma once
+#include <vector>
+#include "raytracer.h"
+#include "parallel.h"
+
+/*
+Signed distance fields (SDF) and sphere tracing.
+
+A shape is described by a function d(p) that returns the distance from p to its surface
+(negative inside). Primitives (sphere, box, torus, cylinder, plane) are combined with
+union / intersection / subtraction / smooth blend and moved with rigid transforms and
+uniform scales, building a tree of nodes:
+	sdf_scene s;
+	int body = s.blend(s.sphere(0.5f, red), s.translate(s.box(p3(.3f,.3f,.3f), 0.05f, blue), p3(0.4f,0,0)), 0.2f);
+	s.set_root(s.unite(body, s.plane(p3(0,1,0), 1.f, gray)));
+A ray is intersected by sphere tracing: from t, the distance d(o + t*dir) is a step that
+cannot cross the surface, so t += d until d is tiny.
+
+set_root() compiles the tree into a flat postfix program with the transforms folded into
+the primitives, and evaluates it for SDF_LANES points at a time: every instruction runs a
+branch-free loop over the lanes, which the compiler vectorizes, so a packet of 8 rays is
+marched together (trace_packet).
+Spheres that are only united to the rest of the scene are taken out of the program and
+intersected analytically with hit_sphere: they cost nothing to the march, which stops at
+the nearest of them.
+render_sdf() marches a cone through each tile of pixels first (cone_march), skipping the
+empty space in front of the tile once for all its rays.
+*/
+
+#define SDF_LANES 8
+#define SDF_MAX_STACK 32
+#define SDF_SHADOW_OFFSET 0.002f	// shadow rays start this far from the surface, along the normal
+
+enum sdf_op { SDF_SPHERE, SDF_BOX, SDF_TORUS, SDF_CYLINDER, SDF_PLANE, SDF_UNION, SDF_INTERSECT, SDF_SUBTRACT, SDF_BLEND, SDF_TRANSFORM };
+
+/* rotation R, uniform scale s and translation c: p_world = R * (p_local * s) + c.
+*  Distances in the local frame are multiplied by s
+*/
+struct sdf_xform {
+	sdf_xform() :r{ 1,0,0, 0,1,0, 0,0,1 }, s(1.f), c(0, 0, 0) {}
+	float r[9];	// row major
+	float s;
+	p3 c;
+
+	p3 rotate(p3 p) const { return p3(r[0] * p.x + r[1] * p.y + r[2] * p.z, r[3] * p.x + r[4] * p.y + r[5] * p.z, r[6] * p.x + r[7] * p.y + r[8] * p.z); }
+	p3 to_local(p3 p) const {
+		p3 q = p - c;	// R^T (p - c) / s
+		float inv_s = 1.f / s;
+		return p3(r[0] * q.x + r[3] * q.y + r[6] * q.z, r[1] * q.x + r[4] * q.y + r[7] * q.z, r[2] * q.x + r[5] * q.y + r[8] * q.z) * inv_s;
+	}
+	// this transform applied after child
+	sdf_xform operator *(const sdf_xform& child) const {
+		sdf_xform x;
+		for (int i = 0; i < 3; ++i)
+			for (int j = 0; j < 3; ++j)
+				x.r[i * 3 + j] = r[i * 3] * child.r[j] + r[i * 3 + 1] * child.r[3 + j] + r[i * 3 + 2] * child.r[6 + j];
+		x.s = s * child.s;
+		x.c = rotate(child.c) * s + c;
+		return x;
+	}
+};
+
+struct sdf_scene {
+	int max_steps = 256;
+	float max_distance = 100.f;
+	float hit_eps = 5e-4f;		// a march stops when d < hit_eps * t
+
+	// primitives, centered in the origin; they return the id of the node
+	int sphere(float radius, p3 col) { return prim(SDF_SPHERE, col, radius); }
+	int box(p3 half_size, float rounding, p3 col) { return prim(SDF_BOX, col, half_size.x, half_size.y, half_size.z, rounding); }
+	int torus(float R, float r, p3 col) { return prim(SDF_TORUS, col, R, r); }	// in the xz plane
+	int cylinder(float radius, float half_height, p3 col) { return prim(SDF_CYLINDER, col, radius, half_height); }	// capped, along y
+	int plane(p3 n, float d, p3 col) { n = normalize(n); return prim(SDF_PLANE, col, n.x, n.y, n.z, d); }	// n.p + d = 0
+
+	// operators
+	int unite(int a, int b) { return op(SDF_UNION, a, b); }
+	int intersect(int a, int b) { return op(SDF_INTERSECT, a, b); }
+	int subtract(int a, int b) { return op(SDF_SUBTRACT, a, b); }	// a minus b
+	int blend(int a, int b, float k) { int n = op(SDF_BLEND, a, b); nodes[n].k = k; return n; }	// smooth union, k = blend radius
+
+	// transforms
+	int translate(int a, p3 t) { sdf_xform x; x.c = t; return xform(a, x); }
+	int scale(int a, float s) { sdf_xform x; x.s = s; return xform(a, x); }
+	int rotate(int a, p3 axis, float angle) {
+		axis = normalize(axis);
+		float c = cos(angle), s = sin(angle), t = 1 - c;
+		sdf_xform x;
+		float r[9] = { t * axis.x * axis.x + c, t * axis.x * axis.y - s * axis.z, t * axis.x * axis.z + s * axis.y,
+			t * axis.x * axis.y + s * axis.z, t * axis.y * axis.y + c, t * axis.y * axis.z - s * axis.x,
+			t * axis.x * axis.z - s * axis.y, t * axis.y * axis.z + s * axis.x, t * axis.z * axis.z + c };
+		std::copy(r, r + 9, x.r);
+		return xform(a, x);
+	}
+
+	// compile the tree under node `root`: this is what is rendered. Returns false (and the scene
+	// is empty) if the tree needs more than SDF_MAX_STACK pending operands
+	bool set_root(int root) {
+		program.clear();
+		prims.clear();
+		analytic.spheres.clear();
+		std::vector<std::pair<int, sdf_xform>> parts;
+		collect_union(root, sdf_xform(), parts);
+		int depth = 0, max_depth = 0;
+		for (size_t i = 0; i < parts.size(); ++i) {
+			compile(parts[i].first, parts[i].second, depth, max_depth);
+			if (i > 0)
+				emit(SDF_UNION, -1, 0.f, depth);
+		}
+		if (max_depth > SDF_MAX_STACK) {
+			program.clear();
+			return false;
+		}
+		return true;
+	}
+
+	// spheres taken out of the program (intersected with hit_sphere)
+	const sphere_list& analytic_spheres() const { return analytic; }
+
+	/* distance at SDF_LANES points (x, y, z arrays) */
+	void eval(const float* x, const float* y, const float* z, float* d) const {
+		float stack[SDF_MAX_STACK][SDF_LANES];
+		int sp = 0;
+		if (program.empty()) {
+			for (int k = 0; k < SDF_LANES; ++k)
+				d[k] = (float)FAR_AWAY;
+			return;
+		}
+		for (const instr& in : program) {
+			if (in.op <= SDF_PLANE) {
+				eval_prim<SDF_LANES>(prims[in.prim], x, y, z, stack[sp++]);
+				continue;
+			}
+			float* a = stack[sp - 2];
+			const float* b = stack[sp - 1];
+			--sp;
+			switch (in.op) {
+			case SDF_UNION:
+				for (int k = 0; k < SDF_LANES; ++k) a[k] = std::min(a[k], b[k]);
+				break;
+			case SDF_INTERSECT:
+				for (int k = 0; k < SDF_LANES; ++k) a[k] = std::max(a[k], b[k]);
+				break;
+			case SDF_SUBTRACT:
+				for (int k = 0; k < SDF_LANES; ++k) a[k] = std::max(a[k], -b[k]);
+				break;
+			case SDF_BLEND:
+				for (int k = 0; k < SDF_LANES; ++k) {
+					float h = std::min(1.f, std::max(0.f, 0.5f + 0.5f * (b[k] - a[k]) / in.k));
+					a[k] = b[k] + (a[k] - b[k]) * h - in.k * h * (1 - h);
+				}
+				break;
+			}
+		}
+		std::copy(stack[0], stack[0] + SDF_LANES, d);
+	}
+
+	// distance and color at one point
+	float eval(p3 p, p3* color = NULL) const {
+		float d[SDF_MAX_STACK];
+		p3 col[SDF_MAX_STACK];
+		int sp = 0;
+		if (program.empty())
+			return (float)FAR_AWAY;
+		for (const instr& in : program) {
+			if (in.op <= SDF_PLANE) {
+				eval_prim<1>(prims[in.prim], &p.x, &p.y, &p.z, &d[sp]);
+				col[sp++] = prims[in.prim].color;
+				continue;
+			}
+			float& a = d[sp - 2];
+			float b = d[sp - 1];
+			p3& ca = col[sp - 2];
+			p3 cb = col[sp - 1];
+			--sp;
+			switch (in.op) {
+			case SDF_UNION:
+				if (b < a) { a = b; ca = cb; }
+				break;
+			case SDF_INTERSECT:
+				if (b > a) { a = b; ca = cb; }
+				break;
+			case SDF_SUBTRACT:
+				if (-b > a) { a = -b; ca = cb; }	// the cut takes the color of b
+				break;
+			case SDF_BLEND: {
+				float h = std::min(1.f, std::max(0.f, 0.5f + 0.5f * (b - a) / in.k));
+				a = b + (a - b) * h - in.k * h * (1 - h);
+				ca = cb + (ca - cb) * h;
+			} break;
+			}
+		}
+		if (color)
+			*color = col[0];
+		return d[0];
+	}
+
+	/* march SDF_LANES rays together, each from t_min[k] to t_max[k] (distances along the
+	*  normalized directions dx, dy, dz). Returns t[k] at the hit or FAR_AWAY
+	*/
+	void march(const float* ox, const float* oy, const float* oz, const float* dx, const float* dy, const float* dz,
+		const float* t_min, const float* t_max, float* t) const {
+		float x[SDF_LANES], y[SDF_LANES], z[SDF_LANES], d[SDF_LANES];
+		bool active[SDF_LANES], hit[SDF_LANES];
+		for (int k = 0; k < SDF_LANES; ++k) {
+			t[k] = t_min[k];
+			active[k] = t_min[k] < t_max[k];
+			hit[k] = false;
+		}
+		for (int step = 0; step < max_steps; ++step) {
+			bool any = false;
+			for (int k = 0; k < SDF_LANES; ++k) {
+				x[k] = ox[k] + dx[k] * t[k];
+				y[k] = oy[k] + dy[k] * t[k];
+				z[k] = oz[k] + dz[k] * t[k];
+				any |= active[k];
+			}
+			if (!any)
+				break;
+			eval(x, y, z, d);
+			for (int k = 0; k < SDF_LANES; ++k) {
+				bool close = d[k] < hit_eps * std::max(t[k], 1.f);
+				hit[k] = hit[k] | (active[k] & close);
+				t[k] += active[k] ? d[k] : 0.f;
+				active[k] = active[k] & !close & (t[k] < t_max[k]);
+			}
+		}
+		for (int k = 0; k < SDF_LANES; ++k)
+			t[k] = hit[k] ? t[k] : (float)FAR_AWAY;
+	}
+
+	/* farthest distance, along the axis of the cone (apex o, normalized axis, half angle
+	*  atan(tan_a)), that every ray in the cone can skip. The sphere of radius d around the
+	*  point at distance t is empty, and it contains the whole section of the cone between t
+	*  and (t + d) / (1 + tan_a)
+	*/
+	float cone_march(p3 o, p3 axis, float tan_a, float t_max) const {
+		float t = 0.f;
+		for (int step = 0; step < max_steps && t < t_max; ++step) {
+			float d = eval(o + axis * t);
+			float t_next = (d + t) / (1.f + tan_a);
+			if (t_next - t < hit_eps * std::max(t, 1.f))
+				break;
+			t = t_next;
+		}
+		return std::min(t, t_max);
+	}
+
+	/* closest hits of SDF_LANES rays (any origins and directions), the march of ray k
+	*  starting at distance t_min[k] from its origin: the analytic spheres first, then the
+	*  march up to them. Normals and colors of the marched hits are computed together too
+	*/
+	void trace_packet(const ray* r, const float* t_min, hit_info* hi) const {
+		float ox[SDF_LANES], oy[SDF_LANES], oz[SDF_LANES], dx[SDF_LANES], dy[SDF_LANES], dz[SDF_LANES];
+		float t0[SDF_LANES], t1[SDF_LANES], t[SDF_LANES], len[SDF_LANES];
+		for (int k = 0; k < SDF_LANES; ++k) {
+			hi[k] = analytic.closest_hit(r[k]);
+			len[k] = length(r[k].dir);
+			ox[k] = r[k].orig.x; oy[k] = r[k].orig.y; oz[k] = r[k].orig.z;
+			dx[k] = r[k].dir.x / len[k]; dy[k] = r[k].dir.y / len[k]; dz[k] = r[k].dir.z / len[k];
+			t0[k] = t_min[k];
+			t1[k] = std::min(max_distance, hi[k].t * len[k]);
+		}
+		march(ox, oy, oz, dx, dy, dz, t0, t1, t);
+
+		// gradient with the tetrahedron of central differences, all lanes at once
+		const float K[4][3] = { { 1, -1, -1 }, { -1, -1, 1 }, { -1, 1, -1 }, { 1, 1, 1 } };
+		float px[SDF_LANES], py[SDF_LANES], pz[SDF_LANES], h[SDF_LANES], nx[SDF_LANES] = { 0 }, ny[SDF_LANES] = { 0 }, nz[SDF_LANES] = { 0 };
+		for (int k = 0; k < SDF_LANES; ++k) {
+			float tk = (t[k] < t1[k]) ? t[k] : 0.f;
+			px[k] = ox[k] + dx[k] * tk; py[k] = oy[k] + dy[k] * tk; pz[k] = oz[k] + dz[k] * tk;
+			h[k] = 1e-4f * std::max(tk, 1.f);
+		}
+		for (int i = 0; i < 4; ++i) {
+			float x[SDF_LANES], y[SDF_LANES], z[SDF_LANES], d[SDF_LANES];
+			for (int k = 0; k < SDF_LANES; ++k) {
+				x[k] = px[k] + K[i][0] * h[k]; y[k] = py[k] + K[i][1] * h[k]; z[k] = pz[k] + K[i][2] * h[k];
+			}
+			eval(x, y, z, d);
+			for (int k = 0; k < SDF_LANES; ++k) {
+				nx[k] += K[i][0] * d[k]; ny[k] += K[i][1] * d[k]; nz[k] += K[i][2] * d[k];
+			}
+		}
+		for (int k = 0; k < SDF_LANES; ++k)
+			if (t[k] < t1[k]) {
+				hi[k].hit = true;
+				hi[k].t = t[k] / len[k];
+				hi[k].p = p3(px[k], py[k], pz[k]);
+				hi[k].n = normalize(p3(nx[k], ny[k], nz[k]));
+				hi[k].id = -1;
+				eval(hi[k].p, &hi[k].color);
+			}
+	}
+
+	// the scene queries of raytracer.h, one ray at a time
+	hit_info closest_hit(ray r) const {
+		hit_info hi = analytic.closest_hit(r);
+		float len = length(r.dir);
+		p3 d = r.dir * (1.f / len);
+		float t = march(r.orig, d, std::min(max_distance, hi.t * len));
+		if (t == (float)FAR_AWAY)
+			return hi;
+		hi.hit = true;
+		hi.t = t / len;
+		hi.p = r.orig + d * t;
+		hi.id = -1;
+		const float h = 1e-4f * std::max(t, 1.f);
+		p3 k0(1, -1, -1), k1(-1, -1, 1), k2(-1, 1, -1), k3(1, 1, 1);
+		hi.n = normalize(k0 * eval(hi.p + k0 * h) + k1 * eval(hi.p + k1 * h) + k2 * eval(hi.p + k2 * h) + k3 * eval(hi.p + k3 * h));
+		eval(hi.p, &hi.color);
+		return hi;
+	}
+
+	bool any_hit(ray r, float t_max) const {
+		if (analytic.any_hit(r, t_max))
+			return true;
+		float len = length(r.dir);
+		return march(r.orig, r.dir * (1.f / len), std::min(max_distance, t_max * len)) != (float)FAR_AWAY;
+	}
+
+	// march a single ray (d normalized) up to t_max. Returns the distance of the hit or FAR_AWAY
+	float march(p3 o, p3 d, float t_max) const {
+		float t = 0.f;
+		for (int step = 0; step < max_steps && t < t_max; ++step) {
+			float dist = eval(o + d * t);
+			if (dist < hit_eps * std::max(t, 1.f))
+				return t;
+			t += dist;
+		}
+		return (float)FAR_AWAY;
+	}
+
+private:
+	struct node {
+		int op, a, b;
+		float param[4];
+		float k;
+		p3 color;
+		sdf_xform x;
+	};
+	struct primitive {
+		int type;
+		float param[4];
+		sdf_xform x;
+		p3 color;
+	};
+	struct instr {
+		int op, prim;
+		float k;
+	};
+
+	std::vector<node> nodes;
+	std::vector<instr> program;
+	std::vector<primitive> prims;
+	sphere_list analytic;
+
+	int prim(int type, p3 col, float p0 = 0, float p1 = 0, float p2 = 0, float p3_ = 0) {
+		node n;
+		n.op = type; n.a = n.b = -1; n.k = 0.f; n.color = col;
+		n.param[0] = p0; n.param[1] = p1; n.param[2] = p2; n.param[3] = p3_;
+		nodes.push_back(n);
+		return (int)nodes.size() - 1;
+	}
+	int op(int type, int a, int b) {
+		node n;
+		n.op = type; n.a = a; n.b = b; n.k = 0.f;
+		nodes.push_back(n);
+		return (int)nodes.size() - 1;
+	}
+	int xform(int a, const sdf_xform& x) {
+		int n = op(SDF_TRANSFORM, a, -1);
+		nodes[n].x = x;
+		return n;
+	}
+
+	/* the operands of the unions at the top of the tree, with their transforms: spheres
+	*  among them go to the analytic list, the others will be compiled
+	*/
+	void collect_union(int n, const sdf_xform& x, std::vector<std::pair<int, sdf_xform>>& parts) {
+		const node& nd = nodes[n];
+		if (nd.op == SDF_UNION) {
+			collect_union(nd.a, x, parts);
+			collect_union(nd.b, x, parts);
+		}
+		else if (nd.op == SDF_TRANSFORM)
+			collect_union(nd.a, x * nd.x, parts);
+		else if (nd.op == SDF_SPHERE)
+			analytic.add(::sphere(x.c, nd.param[0] * x.s, nd.color));
+		else
+			parts.push_back(std::make_pair(n, x));
+	}
+
+	void emit(int op, int prim, float k, int& depth) {
+		program.push_back(instr{ op, prim, k });
+		depth += (op <= SDF_PLANE) ? 1 : -1;
+	}
+
+	void compile(int n, const sdf_xform& x, int& depth, int& max_depth) {
+		const node& nd = nodes[n];
+		if (nd.op == SDF_TRANSFORM) {
+			compile(nd.a, x * nd.x, depth, max_depth);
+			return;
+		}
+		if (nd.op <= SDF_PLANE) {
+			primitive p;
+			p.type = nd.op;
+			std::copy(nd.param, nd.param + 4, p.param);
+			p.x = x;
+			p.color = nd.color;
+			prims.push_back(p);
+			emit(nd.op, (int)prims.size() - 1, 0.f, depth);
+			max_depth = std::max(max_depth, depth);
+			return;
+		}
+		compile(nd.a, x, depth, max_depth);
+		compile(nd.b, x, depth, max_depth);
+		emit(nd.op, -1, nd.k * x.s, depth);
+	}
+
+	template <int N>
+	static void eval_prim(const primitive& pr, const float* x, const float* y, const float* z, float* d) {
+		// to the local frame
+		float lx[N], ly[N], lz[N];
+		const float* r = pr.x.r;
+		float inv_s = 1.f / pr.x.s;
+		for (int k = 0; k < N; ++k) {
+			float qx = x[k] - pr.x.c.x, qy = y[k] - pr.x.c.y, qz = z[k] - pr.x.c.z;
+			lx[k] = (r[0] * qx + r[3] * qy + r[6] * qz) * inv_s;
+			ly[k] = (r[1] * qx + r[4] * qy + r[7] * qz) * inv_s;
+			lz[k] = (r[2] * qx + r[5] * qy + r[8] * qz) * inv_s;
+		}
+		const float* p = pr.param;
+		switch (pr.type) {
+		case SDF_SPHERE:
+			for (int k = 0; k < N; ++k)
+				d[k] = sqrtf(lx[k] * lx[k] + ly[k] * ly[k] + lz[k] * lz[k]) - p[0];
+			break;
+		case SDF_BOX:
+			for (int k = 0; k < N; ++k) {
+				float qx = fabsf(lx[k]) - p[0] + p[3], qy = fabsf(ly[k]) - p[1] + p[3], qz = fabsf(lz[k]) - p[2] + p[3];
+				float mx = std::max(qx, 0.f), my = std::max(qy, 0.f), mz = std::max(qz, 0.f);
+				d[k] = sqrtf(mx * mx + my * my + mz * mz) + std::min(std::max(qx, std::max(qy, qz)), 0.f) - p[3];
+			}
+			break;
+		case SDF_TORUS:
+			for (int k = 0; k < N; ++k) {
+				float q = sqrtf(lx[k] * lx[k] + lz[k] * lz[k]) - p[0];
+				d[k] = sqrtf(q * q + ly[k] * ly[k]) - p[1];
+			}
+			break;
+		case SDF_CYLINDER:
+			for (int k = 0; k < N; ++k) {
+				float qx = sqrtf(lx[k] * lx[k] + lz[k] * lz[k]) - p[0], qy = fabsf(ly[k]) - p[1];
+				float mx = std::max(qx, 0.f), my = std::max(qy, 0.f);
+				d[k] = std::min(std::max(qx, qy), 0.f) + sqrtf(mx * mx + my * my);
+			}
+			break;
+		case SDF_PLANE:
+			for (int k = 0; k < N; ++k)
+				d[k] = p[0] * lx[k] + p[1] * ly[k] + p[2] * lz[k] + p[3];
+			break;
+		}
+		for (int k = 0; k < N; ++k)
+			d[k] *= pr.x.s;
+	}
+};
+
+/* direct light at a hit of the sdf scene, as the generic direct_light() but with the shadow ray
+*  starting off the surface along the normal, as in direct_light_packet (so that the two agree)
+*/
+inline p3 direct_light(const hit_info& hi, const sdf_scene& scene, p3 Lp) {
+	p3 L = Lp - hi.p;
+	float dist = length(L);
+	L = L * (1.f / dist);
+	if (hi.n * L <= 0.f || scene.any_hit(ray(hi.p + hi.n * SDF_SHADOW_OFFSET, L), dist))
+		return p3(0, 0, 0);
+	return hi.color * (hi.n * L);
+}
+
+/* direct light of a packet of hits, as direct_light() but with the shadow rays of the
+*  packet marched together
+*/
+inline void direct_light_packet(const hit_info* hi, const sdf_scene& scene, p3 Lp, p3* col) {
+	float ox[SDF_LANES], oy[SDF_LANES], oz[SDF_LANES], dx[SDF_LANES], dy[SDF_LANES], dz[SDF_LANES];
+	float t0[SDF_LANES], t1[SDF_LANES], t[SDF_LANES];
+	p3 L[SDF_LANES];
+	for (int k = 0; k < SDF_LANES; ++k) {
+		L[k] = Lp - hi[k].p;
+		float dist = length(L[k]);
+		L[k] = L[k] * (1.f / dist);
+		// start away from the surface, or the march would stop right there
+		p3 o = hi[k].p + hi[k].n * SDF_SHADOW_OFFSET;
+		ox[k] = o.x; oy[k] = o.y; oz[k] = o.z;
+		dx[k] = L[k].x; dy[k] = L[k].y; dz[k] = L[k].z;
+		t0[k] = 0.f;
+		bool lit = hi[k].hit && (hi[k].n * L[k] > 0.f) && !scene.analytic_spheres().any_hit(ray(o, L[k]), dist);
+		t1[k] = lit ? std::min(dist, scene.max_distance) : 0.f;
+	}
+	scene.march(ox, oy, oz, dx, dy, dz, t0, t1, t);
+	for (int k = 0; k < SDF_LANES; ++k)
+		col[k] = (t1[k] > 0.f && t[k] == (float)FAR_AWAY) ? hi[k].color * (hi[k].n * L[k]) : p3(0, 0, 0);
+}
+
+/* renders the scene in tiles of SDF_LANES x SDF_LANES pixels, in parallel: a cone around
+*  the rays of the tile is marched first, then every row of the tile is a packet of rays
+*  that starts where the cone stopped. Returns the average distance skipped by the cones
+*/
+inline float render_sdf(image& img, const sdf_scene& scene, const camera& cam, p3 Lp, bool cone = true) {
+	int tiles_x = (img.w + SDF_LANES - 1) / SDF_LANES, tiles_y = (img.h + SDF_LANES - 1) / SDF_LANES;
+	std::vector<float> skipped(tiles_x * tiles_y, 0.f);
+	parallel_for(tiles_x * tiles_y, [&](int tile) {
+		int i0 = (tile % tiles_x) * SDF_LANES, j0 = (tile / tiles_x) * SDF_LANES;
+		auto dir = [&](float i, float j) { return normalize(cam.primary(i / img.w, j / img.h).dir); };
+
+		// cone with the apex in the eye through the corners of the tile
+		float t_start = 0.f;
+		if (cone) {
+			p3 axis = dir(i0 + SDF_LANES * 0.5f, j0 + SDF_LANES * 0.5f);
+			float cos_a = 1.f;
+			for (int c = 0; c < 4; ++c)
+				cos_a = std::min(cos_a, axis * dir(i0 + (c & 1) * SDF_LANES, j0 + (c >> 1) * SDF_LANES));
+			float tan_a = sqrt(std::max(0.f, 1.f - cos_a * cos_a)) / cos_a;
+			t_start = scene.cone_march(cam.eye, axis, tan_a, scene.max_distance);
+			skipped[tile] = t_start;
+		}
+
+		std::vector<ray> rays;
+		float t_min[SDF_LANES];
+		hit_info hi[SDF_LANES];
+		p3 col[SDF_LANES];
+		for (int j = j0; j < std::min(j0 + SDF_LANES, (int)img.h); ++j) {
+			rays.clear();
+			for (int k = 0; k < SDF_LANES; ++k) {
+				rays.push_back(cam.primary((i0 + k + 0.5f) / img.w, (j + 0.5f) / img.h));
+				t_min[k] = t_start;
+			}
+			scene.trace_packet(&rays[0], t_min, hi);
+			direct_light_packet(hi, scene, Lp, col);
+			for (int k = 0; k < SDF_LANES && i0 + k < (int)img.w; ++k)
+				img.set_pixel(i0 + k, j, std::min(255.f, col[k].x), std::min(255.f, col[k].y), std::min(255.f, col[k].z));
+		}
+	});
+	float sum = 0.f;
+	for (float s : skipped)
+		sum += s;
+	return sum / skipped.size();
+}
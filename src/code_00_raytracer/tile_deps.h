@@ -0,0 +1,163 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include "raytracer.h"
+#include "parallel.h"
+
+/*
+Incremental re-rendering of a sphere_list after edits.
+While a tile is rendered it records what its rays depended on:
+ - the ids of the spheres hit by its primary rays and of the first occluder found by each
+   of its shadow rays (a sorted list per tile)
+ - a cone from the eye around its primary rays, cut at the farthest primary hit (if all
+   of them hit something, nothing behind can be seen)
+ - a cone from the light around its hit points, cut at the farthest of them: every shadow
+   ray of the tile is inside it.
+When sphere id changes from `before` to `after` (invalidate()), a tile must be rendered again
+if id is in its list, or if before or after touches one of its cones (a sphere can appear,
+cast a new shadow, or stop hiding something). render_invalid() renders only those tiles.
+*/
+struct tile_deps_renderer {
+	tile_deps_renderer(int _w, int _h, int _tile = 16) :w(_w), h(_h), tile(_tile) {
+		tiles_x = (w + tile - 1) / tile;
+		tiles_y = (h + tile - 1) / tile;
+		tiles.resize(tiles_x * tiles_y);
+	}
+
+	int w, h, tile;
+	int tiles_x, tiles_y;
+
+	int n_tiles() const { return (int)tiles.size(); }
+
+	// everything must be rendered again (e.g. the camera or the light moved)
+	void invalidate_all() {
+		for (tile_state& t : tiles)
+			t.dirty = true;
+	}
+
+	// sphere id changed from before to after. Returns the number of tiles invalidated
+	int invalidate(int id, const sphere& before, const sphere& after) {
+		int n = 0;
+		for (tile_state& t : tiles) {
+			if (t.dirty)
+				continue;
+			t.dirty = std::binary_search(t.deps.begin(), t.deps.end(), id)
+				|| t.view.touches(before) || t.view.touches(after)
+				|| t.light.touches(before) || t.light.touches(after);
+			n += t.dirty;
+		}
+		return n;
+	}
+
+	// renders the invalid tiles (all of them the first time). Returns how many were rendered
+	int render_invalid(image& img, const sphere_list& scene, const camera& cam, p3 Lp) {
+		std::vector<int> todo;
+		for (int i = 0; i < (int)tiles.size(); ++i)
+			if (tiles[i].dirty)
+				todo.push_back(i);
+		parallel_for((int)todo.size(), [&](int k) {
+			render_tile(todo[k], img, scene, cam, Lp);
+		});
+		return (int)todo.size();
+	}
+
+private:
+	// cone with apex o, unit axis and half angle atan(tan_a), cut at distance len along the axis
+	struct cone {
+		p3 o, axis;
+		float tan_a, len;
+		bool all;	// covers every direction (apex inside the region to bound)
+
+		// conservative sphere-cone overlap: the sphere center is within r of the cone
+		bool touches(const sphere& s) const {
+			if (all)
+				return true;
+			p3 d = s.center - o;
+			float t = d * axis;
+			if (t < -s.radius || t > len + s.radius)
+				return false;
+			float e = length(d - axis * t);
+			float cos_a = 1.f / sqrt(1.f + tan_a * tan_a);
+			return e <= std::max(t, 0.f) * tan_a + s.radius / cos_a;
+		}
+	};
+
+	struct tile_state {
+		tile_state() :dirty(true) {}
+		bool dirty;
+		std::vector<int> deps;	// sorted ids of the spheres hit or found occluding
+		cone view, light;
+	};
+	std::vector<tile_state> tiles;
+
+	// same test as sphere_list::any_hit, but it returns who is in the way (-1 if nobody)
+	static int first_occluder(const sphere_list& scene, ray r, float t_max) {
+		for (int is = 0; is < (int)scene.spheres.size(); ++is) {
+			hit_info hi = hit_sphere(r, scene.spheres[is]);
+			if (hi.hit && hi.t < t_max)
+				return is;
+		}
+		return -1;
+	}
+
+	void render_tile(int ti, image& img, const sphere_list& scene, const camera& cam, p3 Lp) {
+		tile_state& ts = tiles[ti];
+		int i0 = (ti % tiles_x) * tile, j0 = (ti / tiles_x) * tile;
+		int i1 = std::min(i0 + tile, w), j1 = std::min(j0 + tile, h);
+		ts.deps.clear();
+
+		p3 bmin(FAR_AWAY, FAR_AWAY, FAR_AWAY), bmax(-FAR_AWAY, -FAR_AWAY, -FAR_AWAY);
+		float max_t = 0.f;
+		bool all_hit = true;
+		for (int j = j0; j < j1; ++j)
+			for (int i = i0; i < i1; ++i) {
+				ray r = cam.primary((i + 0.5f) / w, (j + 0.5f) / h);
+				hit_info hi = scene.closest_hit(r);
+				p3 col(0, 0, 0);
+				if (hi.hit) {
+					ts.deps.push_back((int)hi.id);	// an index of a sphere_list
+					bmin = p3_min(bmin, hi.p);
+					bmax = p3_max(bmax, hi.p);
+					max_t = std::max(max_t, hi.t * length(r.dir));
+
+					// as direct_light(), remembering the occluder
+					p3 L = Lp - hi.p;
+					float dist = sqrt(L * L);
+					L = L * (1.f / dist);
+					int occ = first_occluder(scene, ray(hi.p + L * 0.001f, L), dist);
+					if (occ >= 0)
+						ts.deps.push_back(occ);
+					else
+						col = hi.color * std::max(0.f, hi.n * L);
+				}
+				else
+					all_hit = false;
+				img.set_pixel(i, j, col.x, col.y, col.z);
+			}
+		std::sort(ts.deps.begin(), ts.deps.end());
+		ts.deps.erase(std::unique(ts.deps.begin(), ts.deps.end()), ts.deps.end());
+
+		// cone of the primary rays: through the corners of the tile
+		p3 axis = normalize(cam.primary((i0 + i1) * 0.5f / w, (j0 + j1) * 0.5f / h).dir);
+		float cos_a = 1.f;
+		for (int c = 0; c < 4; ++c) {
+			p3 d = normalize(cam.primary(float((c & 1) ? i1 : i0) / w, float((c & 2) ? j1 : j0) / h).dir);
+			cos_a = std::min(cos_a, axis * d);
+		}
+		ts.view = cone{ cam.eye, axis, sqrt(std::max(0.f, 1.f - cos_a * cos_a)) / cos_a, all_hit ? max_t : (float)FAR_AWAY, false };
+
+		// cone of the shadow rays: from the light around the bounding sphere of the hit points
+		if (bmin.x > bmax.x)
+			ts.light = cone{ Lp, p3(0, 0, 1), 0.f, -FAR_AWAY, false };	// no hit points, no shadow rays
+		else {
+			p3 c = (bmin + bmax) * 0.5f;
+			float rad = length(bmax - c);
+			float dist = length(c - Lp);
+			if (dist <= rad * 1.01f)
+				ts.light = cone{ Lp, p3(0, 0, 1), 0.f, FAR_AWAY, true };
+			else
+				ts.light = cone{ Lp, (c - Lp) * (1.f / dist), rad / sqrt(dist * dist - rad * rad), dist + rad, false };
+		}
+		ts.dirty = false;
+	}
+};
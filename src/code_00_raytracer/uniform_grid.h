@@ -0,0 +1,292 @@
+#pragma once
+#include "raytracer.h"
+#include "parallel.h"
+
+/*
+Uniform grid over a set of spheres, for scenes where many spheres move every frame.
+It answers the same queries of sphere_list (closest_hit / any_hit) so the renderer can
+use either one; the grid is traversed with a 3D-DDA (Amanatides & Woo), visiting only
+the cells crossed by the ray, front to back.
+
+Unlike a hierarchy it does not need to be rebuilt when things move: insert(), remove()
+and move() only touch the cells overlapped by the sphere, which is O(1) for spheres that
+are small compared to a cell. Each cell keeps the ids of its spheres in a vector and each
+sphere remembers its position in those vectors, so removal is a swap with the last element.
+Spheres that are not completely inside the grid bounds are kept in a separate list that is
+tested by every ray.
+build() fills the grid with many spheres at once, using all the cores.
+*/
+struct uniform_grid {
+	uniform_grid(p3 _bmin, p3 _bmax, int rx, int ry, int rz) :bmin(_bmin), bmax(_bmax) {
+		res[0] = rx; res[1] = ry; res[2] = rz;
+		cell_size = p3((bmax.x - bmin.x) / rx, (bmax.y - bmin.y) / ry, (bmax.z - bmin.z) / rz);
+		cells.resize(size_t(rx) * ry * rz);
+	}
+
+	p3 bmin, bmax, cell_size;
+	int res[3];
+
+	// sphere of a given id (ids stay valid until removed)
+	const sphere& get(int id) const { return spheres[id]; }
+	int size() const { return (int)spheres.size() - (int)free_ids.size(); }
+
+	// add a sphere, returns its id
+	int insert(sphere s) {
+		int id;
+		if (!free_ids.empty()) {
+			id = free_ids.back();
+			free_ids.pop_back();
+			spheres[id] = s;
+		}
+		else {
+			id = (int)spheres.size();
+			spheres.push_back(s);
+			info.push_back(sphere_info());
+		}
+		info[id].alive = true;
+		link(id);
+		return id;
+	}
+
+	void remove(int id) {
+		unlink(id);
+		info[id].alive = false;
+		free_ids.push_back(id);
+	}
+
+	// move (and possibly resize) sphere id. Cheap when it stays in the same cells
+	void move(int id, sphere s) {
+		sphere_info& si = info[id];
+		int r[6];
+		bool inside = cell_range(s, r);
+		spheres[id] = s;
+		if (inside == (si.outside_slot < 0) && std::equal(r, r + 6, si.range))
+			return;
+		unlink(id);
+		link(id);
+	}
+
+	// remove everything and insert all the spheres, computing the cells in parallel. Ids are 0..n-1
+	void build(const std::vector<sphere>& all, int n_threads = n_hardware_threads()) {
+		for (auto& c : cells)
+			c.clear();
+		outside.clear();
+		free_ids.clear();
+		spheres = all;
+		info.assign(all.size(), sphere_info());
+
+		// 1. cells overlapped by each sphere
+		int n = (int)all.size();
+		std::vector<char> inside(n);
+		parallel_for(n, [&](int id) {
+			info[id].alive = true;
+			inside[id] = cell_range(spheres[id], info[id].range);
+			if (inside[id])
+				info[id].slots.resize(range_cells(info[id].range));
+		}, n_threads);
+
+		for (int id = 0; id < n; ++id)
+			if (!inside[id]) {
+				info[id].outside_slot = (int)outside.size();
+				outside.push_back(id);
+			}
+
+		// 2. each thread fills its own slab of z-slices, so no cell is touched by two threads.
+		//    A sphere stores the slot of each cell at a fixed position, so no conflicts there either.
+		//    The spheres are put in the buckets of the slabs they overlap first (in order of id)
+		int n_slabs = std::min(res[2], n_threads * 4);
+		auto slab_of = [&](int iz) { return ((iz + 1) * n_slabs + res[2] - 1) / res[2] - 1; };
+		std::vector<std::vector<int>> buckets(n_slabs);
+		for (int id = 0; id < n; ++id)
+			if (inside[id])
+				for (int slab = slab_of(info[id].range[2]); slab <= slab_of(info[id].range[5]); ++slab)
+					buckets[slab].push_back(id);
+		parallel_for(n_slabs, [&](int slab) {
+			int z0 = res[2] * slab / n_slabs, z1 = res[2] * (slab + 1) / n_slabs;
+			for (int id : buckets[slab]) {
+				const int* r = info[id].range;
+				int nx = r[3] - r[0] + 1, ny = r[4] - r[1] + 1;
+				for (int iz = std::max(r[2], z0); iz <= std::min(r[5], z1 - 1); ++iz) {
+					int k = (iz - r[2]) * ny * nx;
+					for (int iy = r[1]; iy <= r[4]; ++iy)
+						for (int ix = r[0]; ix <= r[3]; ++ix, ++k) {
+							int c = cell_index(ix, iy, iz);
+							info[id].slots[k] = slot_ref{ c, (int)cells[c].size() };
+							cells[c].push_back(id);
+						}
+				}
+			}
+		}, n_threads);
+	}
+
+	hit_info closest_hit(ray r) const {
+		hit_info best = hit_info();
+		for (int id : outside)
+			test(r, id, best);
+
+		traverse(r, best.t, [&](const std::vector<int>& cell, float t_exit) {
+			for (int id : cell)
+				test(r, id, best);
+			return best.t <= t_exit; // nothing in the next cells can be closer
+		});
+		return best;
+	}
+
+	bool any_hit(ray r, float t_max) const {
+		for (int id : outside) {
+			hit_info hi = hit_sphere(r, spheres[id]);
+			if (hi.hit && hi.t < t_max)
+				return true;
+		}
+		bool found = false;
+		traverse(r, t_max, [&](const std::vector<int>& cell, float) {
+			for (int id : cell) {
+				hit_info hi = hit_sphere(r, spheres[id]);
+				if (hi.hit && hi.t < t_max)
+					return found = true;
+			}
+			return false;
+		});
+		return found;
+	}
+
+private:
+	struct slot_ref {
+		int cell, slot;	// spheres[id] is cells[cell][slot]
+	};
+	struct sphere_info {
+		sphere_info() :alive(false), outside_slot(-1) {}
+		bool alive;
+		int range[6];					// cells overlapped: min x,y,z, max x,y,z (inclusive)
+		int outside_slot;				// position in outside (-1 if inside the grid)
+		std::vector<slot_ref> slots;	// position in each overlapped cell
+	};
+
+	std::vector<sphere> spheres;
+	std::vector<sphere_info> info;
+	std::vector<int> free_ids;
+	std::vector<std::vector<int>> cells;
+	std::vector<int> outside;		// spheres not completely inside the grid bounds
+
+	int cell_index(int ix, int iy, int iz) const { return (iz * res[1] + iy) * res[0] + ix; }
+	static int range_cells(const int* r) { return (r[3] - r[0] + 1) * (r[4] - r[1] + 1) * (r[5] - r[2] + 1); }
+
+	// cells overlapped by the bounding box of s. Returns false if s is not completely inside the grid
+	bool cell_range(const sphere& s, int* r) const {
+		p3 lo = s.center - p3(s.radius, s.radius, s.radius);
+		p3 hi = s.center + p3(s.radius, s.radius, s.radius);
+		bool inside = true;
+		for (int a = 0; a < 3; ++a) {
+			inside = inside && lo[a] >= bmin[a] && hi[a] <= bmax[a];
+			r[a] = std::min(res[a] - 1, std::max(0, (int)floor((lo[a] - bmin[a]) / cell_size[a])));
+			r[a + 3] = std::min(res[a] - 1, std::max(0, (int)floor((hi[a] - bmin[a]) / cell_size[a])));
+		}
+		return inside;
+	}
+
+	void link(int id) {
+		sphere_info& si = info[id];
+		if (!cell_range(spheres[id], si.range)) {
+			si.outside_slot = (int)outside.size();
+			outside.push_back(id);
+			return;
+		}
+		si.outside_slot = -1;
+		si.slots.clear();
+		const int* r = si.range;
+		for (int iz = r[2]; iz <= r[5]; ++iz)
+			for (int iy = r[1]; iy <= r[4]; ++iy)
+				for (int ix = r[0]; ix <= r[3]; ++ix) {
+					int c = cell_index(ix, iy, iz);
+					si.slots.push_back(slot_ref{ c, (int)cells[c].size() });
+					cells[c].push_back(id);
+				}
+	}
+
+	void unlink(int id) {
+		sphere_info& si = info[id];
+		if (si.outside_slot >= 0) {
+			int last = outside.back();
+			outside[si.outside_slot] = last;
+			info[last].outside_slot = si.outside_slot;
+			outside.pop_back();
+			si.outside_slot = -1;
+			return;
+		}
+		for (const slot_ref& s : si.slots) {
+			std::vector<int>& cell = cells[s.cell];
+			int last = cell.back();
+			cell[s.slot] = last;
+			cell.pop_back();
+			// tell the moved sphere where it is now
+			if (last != id)
+				for (slot_ref& ls : info[last].slots)
+					if (ls.cell == s.cell) {
+						ls.slot = s.slot;
+						break;
+					}
+		}
+		si.slots.clear();
+	}
+
+	void test(ray r, int id, hit_info& best) const {
+		hit_info hi = hit_sphere(r, spheres[id]);
+		if (hi.t < best.t) {
+			best = hi;
+			best.id = id;
+		}
+	}
+
+	/* 3D-DDA: calls visit(cell, t_exit) for the non empty cells crossed by r, front to back,
+	*  until visit returns true or the ray goes beyond t_max
+	*/
+	template <class VISIT>
+	void traverse(ray r, float t_max, VISIT visit) const {
+		// clip the ray against the grid bounds
+		float t0 = 0.f, t1 = t_max;
+		for (int a = 0; a < 3; ++a) {
+			float inv = 1.f / r.dir[a];
+			float ta = (bmin[a] - r.orig[a]) * inv, tb = (bmax[a] - r.orig[a]) * inv;
+			t0 = std::max(t0, std::min(ta, tb));
+			t1 = std::min(t1, std::max(ta, tb));
+		}
+		if (t0 > t1)
+			return;
+
+		p3 p = r.orig + r.dir * t0;
+		int c[3], step[3], out[3];
+		float t_next[3], t_delta[3];
+		for (int a = 0; a < 3; ++a) {
+			c[a] = std::min(res[a] - 1, std::max(0, (int)floor((p[a] - bmin[a]) / cell_size[a])));
+			if (r.dir[a] > 0) {
+				step[a] = 1; out[a] = res[a];
+				t_next[a] = t0 + (bmin[a] + (c[a] + 1) * cell_size[a] - p[a]) / r.dir[a];
+				t_delta[a] = cell_size[a] / r.dir[a];
+			}
+			else if (r.dir[a] < 0) {
+				step[a] = -1; out[a] = -1;
+				t_next[a] = t0 + (bmin[a] + c[a] * cell_size[a] - p[a]) / r.dir[a];
+				t_delta[a] = -cell_size[a] / r.dir[a];
+			}
+			else {
+				step[a] = 0; out[a] = -1;
+				t_next[a] = FAR_AWAY;
+				t_delta[a] = FAR_AWAY;
+			}
+		}
+
+		for (;;) {
+			// axis of the next cell boundary crossed
+			int a = (t_next[0] < t_next[1]) ? ((t_next[0] < t_next[2]) ? 0 : 2) : ((t_next[1] < t_next[2]) ? 1 : 2);
+			const std::vector<int>& cell = cells[cell_index(c[0], c[1], c[2])];
+			if (!cell.empty() && visit(cell, t_next[a]))
+				return;
+			if (t_next[a] > t1)
+				return;
+			c[a] += step[a];
+			if (c[a] == out[a])
+				return;
+			t_next[a] += t_delta[a];
+		}
+	}
+};
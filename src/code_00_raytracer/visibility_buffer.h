@@ -0,0 +1,146 @@
+#pragma once
+#include <vector>
+#include "raytracer.h"
+#include "parallel.h"
+
+/*
+Visibility buffer: for each pixel, the distance t along its primary ray and the id of the
+sphere seen (-1 for none), found by rasterizing the spheres instead of tracing the rays.
+The primary rays of the pinhole camera all start in the eye and are perfectly coherent, so
+there is no need to look for what they hit: every sphere is projected on the screen, a
+conservative rectangle around its projection is binned into tiles of TILE x TILE pixels,
+and then each tile (in parallel) only tests the pixels inside the rectangles of its
+spheres. The depth of a covered pixel is computed with the same formula of hit_sphere, so
+the hit points rebuilt from the buffer (hit()) are the ones ray tracing would find.
+Only the shadow rays (and any later secondary rays) are then traced, from these points.
+*/
+struct visibility_buffer {
+	static const int TILE = 16;
+
+	visibility_buffer(int _w, int _h) :w(_w), h(_h), t(_w * _h, (float)FAR_AWAY), id(_w * _h, -1) {
+		tiles_x = (w + TILE - 1) / TILE;
+		tiles_y = (h + TILE - 1) / TILE;
+		bins.resize(tiles_x * tiles_y);
+	}
+
+	int w, h;
+	std::vector<float> t;	// distance along the primary ray (in units of its direction, as hit_info::t)
+	std::vector<int> id;	// index of the sphere seen, -1 if none
+
+	void rasterize(const std::vector<sphere>& spheres, const camera& cam) {
+		std::fill(t.begin(), t.end(), (float)FAR_AWAY);
+		std::fill(id.begin(), id.end(), -1);
+
+		// 1. screen rectangle of every sphere, binned into the tiles it overlaps
+		for (auto& b : bins)
+			b.clear();
+		rects.resize(spheres.size());
+		for (int s = 0; s < (int)spheres.size(); ++s) {
+			int* r = rects[s].r;
+			if (!screen_rect(spheres[s], cam, r))
+				continue;
+			for (int ty = r[1] / TILE; ty <= r[3] / TILE; ++ty)
+				for (int tx = r[0] / TILE; tx <= r[2] / TILE; ++tx)
+					bins[ty * tiles_x + tx].push_back(s);
+		}
+
+		// 2. every tile depth tests the pixels of its spheres
+		parallel_for(tiles_x * tiles_y, [&](int tile) {
+			int x0 = (tile % tiles_x) * TILE, y0 = (tile / tiles_x) * TILE;
+			int x1 = std::min(x0 + TILE, w) - 1, y1 = std::min(y0 + TILE, h) - 1;
+			for (int s : bins[tile]) {
+				const int* r = rects[s].r;
+				for (int j = std::max(y0, r[1]); j <= std::min(y1, r[3]); ++j)
+					for (int i = std::max(x0, r[0]); i <= std::min(x1, r[2]); ++i) {
+						float d = depth(primary(cam, i, j), spheres[s]);
+						if (d < t[j * w + i]) {
+							t[j * w + i] = d;
+							id[j * w + i] = s;
+						}
+					}
+			}
+		});
+	}
+
+	// the primary ray of pixel (i,j)
+	ray primary(const camera& cam, int i, int j) const {
+		return cam.primary((i + 0.5f) / w, (j + 0.5f) / h);
+	}
+
+	// the hit of the primary ray of pixel (i,j), as sphere_list::closest_hit would return it
+	hit_info hit(int i, int j, const camera& cam, const std::vector<sphere>& spheres) const {
+		hit_info hi;
+		int s = id[j * w + i];
+		if (s < 0)
+			return hi;
+		ray r = primary(cam, i, j);
+		hi.hit = true;
+		hi.t = t[j * w + i];
+		hi.id = s;
+		hi.p = r.orig + r.dir * hi.t;
+		hi.n = hi.p - spheres[s].center;
+		hi.n = hi.n * (1.0 / sqrt(hi.n * hi.n));
+		hi.color = spheres[s].color;
+		return hi;
+	}
+
+private:
+	struct rect {
+		int r[4];	// min x, min y, max x, max y (inclusive)
+	};
+	int tiles_x, tiles_y;
+	std::vector<std::vector<int>> bins;
+	std::vector<rect> rects;
+
+	// t of the first intersection of r with s (FAR_AWAY if none), the same computed by hit_sphere
+	static float depth(ray r, const sphere& s) {
+		float A = r.dir * r.dir;
+		float B = r.dir * (r.orig - s.center) * 2;
+		float C = (r.orig - s.center) * (r.orig - s.center) - s.radius * s.radius;
+		float delta = B * B - 4 * A * C;
+		if (delta < 0)
+			return (float)FAR_AWAY;
+		float t = (-B - sqrt(delta)) / (2 * A);
+		if (t <= 0)
+			t = (-B + sqrt(delta)) / (2 * A);
+		return (t <= 0) ? (float)FAR_AWAY : t;
+	}
+
+	/* pixels covered by the projection of s: in camera space every point of the sphere has
+	*  x in [cx-r, cx+r] and depth in [cz-r, cz+r], so x/depth is between the extremes of
+	*  the four combinations (same for y). Returns false if s is not visible
+	*/
+	bool screen_rect(const sphere& s, const camera& cam, int* r) const {
+		p3 c = s.center - cam.eye;
+		float cx = c * cam.right(), cy = c * cam.up(), cz = c * cam.forward();
+		float rad = s.radius;
+		float lo[2], hi[2];
+		if (cz - rad <= 1e-4f) {
+			// the sphere reaches behind the image plane of the eye: take the whole screen
+			lo[0] = lo[1] = -FAR_AWAY;
+			hi[0] = hi[1] = FAR_AWAY;
+			if (cz + rad <= 0.f)
+				return false;
+		}
+		else {
+			float cc[2] = { cx, cy };
+			for (int a = 0; a < 2; ++a) {
+				float v0 = (cc[a] - rad) / (cz - rad), v1 = (cc[a] - rad) / (cz + rad);
+				float v2 = (cc[a] + rad) / (cz - rad), v3 = (cc[a] + rad) / (cz + rad);
+				lo[a] = std::min(std::min(v0, v1), std::min(v2, v3));
+				hi[a] = std::max(std::max(v0, v1), std::max(v2, v3));
+			}
+		}
+		// screen coordinate v in [-1,1] is pixel (v+1)/2*size - 0.5
+		int size[2] = { w, h };
+		for (int a = 0; a < 2; ++a) {
+			float p0 = (std::max(-2.f, lo[a]) + 1) * 0.5f * size[a] - 0.5f;
+			float p1 = (std::min(2.f, hi[a]) + 1) * 0.5f * size[a] - 0.5f;
+			r[a] = std::max(0, (int)floor(p0));
+			r[a + 2] = std::min(size[a] - 1, (int)ceil(p1));
+			if (r[a] > r[a + 2])
+				return false;
+		}
+		return true;
+	}
+};
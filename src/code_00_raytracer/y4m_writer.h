@@ -0,0 +1,220 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "raytracer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define Y4M_SSE2
+#endif
+
+/*
+Streaming writer for animations: all the frames go into a single YUV4MPEG2 stream (which
+ffmpeg and most players read directly), or into raw RGB24 frames
+(ffmpeg -f rawvideo -pixel_format rgb24 -video_size WxH -i ...).
+The output is a file, "-" for stdout, or "|command" to pipe the frames into a program,
+e.g. "|ffmpeg -y -i - out.mp4".
+
+The writer owns two images: the renderer draws into frame(), then submit() hands it to an
+encoder thread, which converts it (RGB to YUV 4:2:0 with SSE2 when available) and writes it,
+while the renderer goes on with the next frame in the other image. submit() only waits if the
+encoder is still busy with the frame before, so as long as encoding a frame is faster than
+rendering one the output costs nothing on the rendering thread.
+The YUV values are the full range BT.601 of JPEG (C420jpeg), in 8 bit fixed point:
+	Y =  ( 77 R + 150 G +  29 B + 128) >> 8
+	U = ((-43 R -  85 G + 128 B + 128) >> 8) + 128
+	V = ((128 R - 107 G -  21 B + 128) >> 8) + 128
+with the chroma of the average of each 2x2 block of pixels.
+*/
+struct y4m_writer {
+	enum format {
+		Y4M,		// YUV4MPEG2, 4:2:0
+		RAW_RGB		// frames of w*h*3 bytes, no header
+	};
+
+	y4m_writer(int _w, int _h) :w(_w), h(_h), buffers{ image(_w, _h), image(_w, _h) } {}
+	~y4m_writer() { close(); }
+
+	int w, h;
+	float wait_ms = 0.f;	// total time spent by submit() waiting for the encoder
+	int n_frames = 0;
+
+	bool open(const std::string& name, format _fmt = Y4M, int fps = 25) {
+		close();
+		fmt = _fmt;
+		if (name == "-") {
+			out = stdout;
+			out_kind = OUT_STDOUT;
+		}
+		else if (!name.empty() && name[0] == '|') {
+#ifdef _WIN32
+			out = _popen(name.c_str() + 1, "wb");
+#else
+			out = popen(name.c_str() + 1, "w");
+#endif
+			out_kind = OUT_PIPE;
+		}
+		else {
+			out = fopen(name.c_str(), "wb");
+			out_kind = OUT_FILE;
+		}
+		if (!out) {
+			std::cout << "y4m_writer: cannot open " << name << std::endl;
+			return false;
+		}
+		if (fmt == Y4M)
+			fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, fps);
+		quit = false;
+		job = -1;
+		cur = 0;
+		encoder = std::thread([this]() { encode_loop(); });
+		return true;
+	}
+
+	// the image to render the next frame into
+	image& frame() { return buffers[cur]; }
+
+	// queues frame() for output and switches to the other image
+	void submit() {
+		auto start = std::chrono::steady_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(m);
+			cv.wait(lock, [this]() { return job < 0; });
+			job = cur;
+		}
+		cv.notify_all();
+		wait_ms += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		cur = 1 - cur;
+		++n_frames;
+	}
+
+	// waits for the frames queued and closes the output
+	void close() {
+		if (!out)
+			return;
+		{
+			std::unique_lock<std::mutex> lock(m);
+			cv.wait(lock, [this]() { return job < 0; });
+			quit = true;
+		}
+		cv.notify_all();
+		encoder.join();
+		if (out_kind == OUT_FILE)
+			fclose(out);
+		else if (out_kind == OUT_PIPE) {
+#ifdef _WIN32
+			_pclose(out);
+#else
+			pclose(out);
+#endif
+		}
+		else
+			fflush(out);
+		out = 0;
+	}
+
+	// rgb: w*h*3 values in 0..255, top row first (as image::data). yuv: w*h + 2*cw*ch bytes
+	static void rgb_to_yuv420(const int* rgb, int w, int h, uint8_t* yuv) {
+		int cw = (w + 1) / 2, ch = (h + 1) / 2;
+		uint8_t* Y = yuv, * U = yuv + w * h, * V = U + cw * ch;
+		std::vector<int16_t> r(w), g(w), b(w), cr(cw), cg(cw), cb(cw);
+		for (int j = 0; j < h; ++j) {
+			const int* row = rgb + j * w * 3;
+			for (int i = 0; i < w; ++i) {
+				r[i] = (int16_t)row[i * 3];
+				g[i] = (int16_t)row[i * 3 + 1];
+				b[i] = (int16_t)row[i * 3 + 2];
+			}
+			convert(&r[0], &g[0], &b[0], w, 77, 150, 29, 0, Y + j * w);
+			if (j % 2)
+				continue;
+
+			// average of the 2x2 block (the last row and column are repeated when odd)
+			const int* row1 = rgb + std::min(j + 1, h - 1) * w * 3;
+			for (int i = 0; i < cw; ++i) {
+				int i0 = 2 * i * 3, i1 = std::min(2 * i + 1, w - 1) * 3;
+				cr[i] = (int16_t)((row[i0] + row[i1] + row1[i0] + row1[i1] + 2) >> 2);
+				cg[i] = (int16_t)((row[i0 + 1] + row[i1 + 1] + row1[i0 + 1] + row1[i1 + 1] + 2) >> 2);
+				cb[i] = (int16_t)((row[i0 + 2] + row[i1 + 2] + row1[i0 + 2] + row1[i1 + 2] + 2) >> 2);
+			}
+			convert(&cr[0], &cg[0], &cb[0], cw, -43, -85, 128, 128, U + j / 2 * cw);
+			convert(&cr[0], &cg[0], &cb[0], cw, 128, -107, -21, 128, V + j / 2 * cw);
+		}
+	}
+
+	// out[i] = clamp(((kr r[i] + kg g[i] + kb b[i] + 128) >> 8) + bias, 0, 255)
+	static void convert(const int16_t* r, const int16_t* g, const int16_t* b, int n,
+		int kr, int kg, int kb, int bias, uint8_t* out) {
+		int i = 0;
+#ifdef Y4M_SSE2
+		// 8 values at a time: (r,g) and (b,1) pairs multiplied and summed by madd
+		const __m128i k_rg = _mm_set1_epi32((kg << 16) | (kr & 0xffff));
+		const __m128i k_b1 = _mm_set1_epi32((128 << 16) | (kb & 0xffff));
+		const __m128i one = _mm_set1_epi16(1), vbias = _mm_set1_epi16((short)bias);
+		for (; i + 8 <= n; i += 8) {
+			__m128i vr = _mm_loadu_si128((const __m128i*)(r + i));
+			__m128i vg = _mm_loadu_si128((const __m128i*)(g + i));
+			__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+			__m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(vr, vg), k_rg), _mm_madd_epi16(_mm_unpacklo_epi16(vb, one), k_b1));
+			__m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(vr, vg), k_rg), _mm_madd_epi16(_mm_unpackhi_epi16(vb, one), k_b1));
+			__m128i v = _mm_add_epi16(_mm_packs_epi32(_mm_srai_epi32(lo, 8), _mm_srai_epi32(hi, 8)), vbias);
+			_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(v, v));
+		}
+#endif
+		for (; i < n; ++i) {
+			int v = ((kr * r[i] + kg * g[i] + kb * b[i] + 128) >> 8) + bias;
+			out[i] = (uint8_t)std::min(255, std::max(0, v));
+		}
+	}
+
+private:
+	enum out_kind_t { OUT_FILE, OUT_STDOUT, OUT_PIPE };
+
+	format fmt = Y4M;
+	FILE* out = 0;
+	out_kind_t out_kind = OUT_FILE;
+	image buffers[2];
+	int cur = 0;				// buffer the renderer is drawing into
+	int job = -1;				// buffer being encoded, -1 if none
+	bool quit = false;
+	std::mutex m;
+	std::condition_variable cv;
+	std::thread encoder;
+
+	void encode_loop() {
+		std::vector<uint8_t> bytes;
+		for (;;) {
+			int b;
+			{
+				std::unique_lock<std::mutex> lock(m);
+				cv.wait(lock, [this]() { return job >= 0 || quit; });
+				if (job < 0)
+					return;
+				b = job;
+			}
+			const std::vector<int>& data = buffers[b].data;
+			if (fmt == Y4M) {
+				bytes.resize(w * h + 2 * ((w + 1) / 2) * ((h + 1) / 2));
+				rgb_to_yuv420(&data[0], w, h, &bytes[0]);
+				fputs("FRAME\n", out);
+			}
+			else {
+				bytes.resize(data.size());
+				for (size_t i = 0; i < data.size(); ++i)
+					bytes[i] = (uint8_t)data[i];
+			}
+			fwrite(&bytes[0], 1, bytes.size(), out);
+			{
+				std::unique_lock<std::mutex> lock(m);
+				job = -1;
+			}
+			cv.notify_all();
+		}
+	}
+};
@@ -2,11 +2,15 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 #include "../common/debugging.h"
+#include "../common/headless.h"
 
 int main(int argc, char** argv) {
 
 	GLFWwindow* window;
 
+    headless hl(argc, argv);
+    hl.init_hints();
+
     /* Initialize the library */
     if (!glfwInit())
         return -1;
@@ -23,6 +27,8 @@ int main(int argc, char** argv) {
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
 
+    hl.window_hints();
+
     /* Create a windowed mode window and its OpenGL context */
     window = glfwCreateWindow(512, 512, "code_02_my_first_triangle", NULL, NULL);
 
@@ -37,7 +43,7 @@ int main(int argc, char** argv) {
     glfwMakeContextCurrent(window); 
 
     // Load GL symbols *after* the context is current
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    if (!gladLoadGLLoader(hl.loader())) {
         std::fprintf(stderr, "Failed to initialize GLAD\n");
         glfwDestroyWindow(window);
         glfwTerminate();
@@ -47,6 +53,8 @@ int main(int argc, char** argv) {
     /* query for the hardware and software specs and print the result on the console*/
     printout_opengl_glsl_info();
 
+    hl.create(512, 512);
+
     ///* create render data in RAM */
     GLuint positionAttribIndex = 0;
     float positions[] = { 0.0, 0.0,  // 1st vertex
@@ -162,8 +170,10 @@ int main(int argc, char** argv) {
     float delta = 0;
 
     glClearColor(0.2, 0.2, 0.2, 1);
-    while (!glfwWindowShouldClose(window))
+    while (hl.running(window))
     {
+        hl.begin_frame();
+
         if (delta < 0 || delta > 0.5)
             d = -d;
         delta += d;
@@ -177,6 +187,8 @@ int main(int argc, char** argv) {
         // glDrawArrays(GL_TRIANGLES, 0, 6);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, NULL);
 
+        hl.end_frame();
+
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
 
@@ -184,6 +196,7 @@ int main(int argc, char** argv) {
         glfwPollEvents();
     }
 
+    hl.finish();
     glfwTerminate();
 
 	return 0;
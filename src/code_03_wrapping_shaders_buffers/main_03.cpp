@@ -1,15 +1,78 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <cstring>
+#include <chrono>
 #include "../common/debugging.h"
+#include "../common/headless.h"
 #include "../common/renderable.h"
 #include "../common/shaders.h"
+#include "../common/simple_shapes.h"
+#include "../common/soft_rasterizer.h"
 
 
 int main(int argc, char** argv) {
 
+    ///* vertex position */
+    GLuint positionAttribIndex = 0;
+    float positions[] = { 0.0, 0.0,  // 1st vertex
+                          0.5, 0.0,  // 2nd vertex
+                          0.5, 0.5,
+                          0.0, 0.5
+    };
+
+    ///* Color attribute */
+    GLuint colorAttribIndex = 1;
+    float colors[] = { 1.0, 0.0, 0.0,    // 1st vertex's color
+                        0.0, 1.0, 0.0,   // 2nd vertex's color
+                        0.0, 0.0, 1.0,
+                        1.0, 1.0, 1.0
+    };
+
+    //* indices */
+    GLuint indices[] = { 0,1,2,0,2,3 };
+
+    // the same quad as a shape
+    shape q;
+    q.vn = 4;
+    for (int v = 0; v < 4; ++v) {
+        q.positions.insert(q.positions.end(), { positions[2 * v], positions[2 * v + 1], 0.f });
+        q.colors.insert(q.colors.end(), { colors[3 * v], colors[3 * v + 1], colors[3 * v + 2] });
+    }
+    q.indices_triangles.assign(indices, indices + 6);
+
+    // --soft [n_frames]: no window, the moving quad is drawn by the CPU rasterizer (uDelta is
+    // added to the position and to the red of the vertices, as the shaders do), and the last
+    // frame is saved to quad_soft.ppm
+    if (argc > 1 && !strcmp(argv[1], "--soft")) {
+        int n_frames = (argc > 2) ? atoi(argv[2]) : 100;
+        soft_rasterizer raster(512, 512);
+        shape moved = q;
+        float d = 0.01f, delta = 0.f;
+        double total_ms = 0.0;
+        for (int f = 0; f < n_frames; ++f) {
+            if (delta < 0 || delta > 0.5)
+                d = -d;
+            delta += d;
+            for (int v = 0; v < 4; ++v)
+                moved.colors[3 * v] = q.colors[3 * v] + delta;
+            auto t0 = std::chrono::steady_clock::now();
+            raster.clear(glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+            raster.draw(moved, glm::translate(glm::mat4(1.0f), glm::vec3(delta, 0.0f, 0.0f)));
+            raster.flush();
+            total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        std::cout << n_frames << " frames, " << total_ms / std::max(1, n_frames) << " ms per frame ("
+            << raster.n_threads << " threads)" << std::endl;
+        raster.save_ppm("quad_soft.ppm");
+        return 0;
+    }
+
     GLFWwindow* window;
 
+    headless hl(argc, argv);
+    hl.init_hints();
+
     /* Initialize the library */
     if (!glfwInit())
         return -1;
@@ -24,6 +87,8 @@ int main(int argc, char** argv) {
     // macOS requires this for 3.2+ contexts
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
+    hl.window_hints();
+
     /* Create a windowed mode window and its OpenGL context */
     window = glfwCreateWindow(512, 512, "code_03_wrapping_shaders_buffers", NULL, NULL);
 
@@ -38,7 +103,7 @@ int main(int argc, char** argv) {
     glfwMakeContextCurrent(window);
 
     // Load GL symbols *after* the context is current
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    if (!gladLoadGLLoader(hl.loader())) {
         std::fprintf(stderr, "Failed to initialize GLAD\n");
         glfwDestroyWindow(window);
         glfwTerminate();
@@ -48,30 +113,33 @@ int main(int argc, char** argv) {
     /* query for the hardware and software specs and print the result on the console*/
     printout_opengl_glsl_info();
 
-    ///* vertex position */
-    GLuint positionAttribIndex = 0;
-    float positions[] = { 0.0, 0.0,  // 1st vertex
-                          0.5, 0.0,  // 2nd vertex
-                          0.5, 0.5,
-                          0.0, 0.5
-    };
+    hl.create(512, 512);
 
-    ///* Color attribute */
-    GLuint colorAttribIndex = 1;
-    float colors[] = { 1.0, 0.0, 0.0,    // 1st vertex's color
-                        0.0, 1.0, 0.0,   // 2nd vertex's color
-                        0.0, 0.0, 1.0,
-                        1.0, 1.0, 1.0
-    };
-
-    //* indices */
-    GLuint indices[] = { 0,1,2,0,2,3 };
     check_gl_errors(__LINE__, __FILE__);
     renderable r;
-    r.create();
-    r.add_vertex_attribute(positions, 8, positionAttribIndex, 2);
-    r.add_vertex_attribute(colors, 12, colorAttribIndex, 3);
-    r.add_indices<int>(indices, 6, GL_TRIANGLES);
+
+    // --vertex-format float|half|compact: the quad as a shape, packed in one
+    // interleaved buffer with these encodings (see vertex_format), instead of a buffer per attribute
+    const char* format_name = NULL;
+    for (int i = 1; i + 1 < argc; ++i)
+        if (!strcmp(argv[i], "--vertex-format"))
+            format_name = argv[i + 1];
+    if (format_name) {
+        vertex_format f;
+        if (!strcmp(format_name, "half"))
+            f = vertex_format{ vertex_format::POS_HALF, vertex_format::COL_RGBA8, vertex_format::NORM_INT_2_10_10_10 };
+        else if (!strcmp(format_name, "compact"))
+            f = vertex_format::compact();
+        shape::encoding_error e = q.to_renderable(r, f);
+        std::cout << "vertex format " << format_name << ": " << f.size() << " bytes per vertex, max error position "
+            << e.position << " color " << e.color << std::endl;
+    }
+    else {
+        r.create();
+        r.add_vertex_attribute(positions, 8, positionAttribIndex, 2);
+        r.add_vertex_attribute(colors, 12, colorAttribIndex, 3);
+        r.add_indices<int>(indices, 6, GL_TRIANGLES);
+    }
 
 
     shader s;
@@ -89,13 +157,17 @@ int main(int argc, char** argv) {
 
     float d = 0.01;
     float delta = 0;
-    while (!glfwWindowShouldClose(window))
+    while (hl.running(window))
     {
+        hl.begin_frame();
+
         if (delta < 0 || delta > 0.5)
             d = -d;
         delta += d;
 
         glUniform1f(s["uDelta"], delta);
+        // decodes the quantized positions (the identity for float positions)
+        glUniformMatrix4fv(s["uM"], 1, GL_FALSE, &r.position_transform[0][0]);
         /* Render here */
         glClearColor(0.2, 0.2, 0.2, 1);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -104,6 +176,8 @@ int main(int argc, char** argv) {
         r.bind();
         glDrawElements(r().mode, r().count, r().itype, NULL);
 
+        hl.end_frame();
+
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
 
@@ -111,6 +185,10 @@ int main(int argc, char** argv) {
         glfwPollEvents();
     }
 
+    /* the GL objects must be deleted while the context exists */
+    r.release();
+    s.release();
+    hl.finish();
     glfwTerminate();
 
     return 0;
@@ -3,8 +3,9 @@ in vec2 aPosition;
 in vec3 aColor;
 out vec3 vColor;
 uniform float uDelta;
+uniform mat4 uM;
 void main(void)
 {
- gl_Position = vec4(aPosition+vec2(uDelta,0.0), 0.0, 1.0);
+ gl_Position = uM * vec4(aPosition, 0.0, 1.0) + vec4(uDelta, 0.0, 0.0, 0.0);
  vColor = aColor;
 }
\ No newline at end of file
@@ -1,13 +1,28 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cmath>
 #include "../common/debugging.h"
+#include "../common/headless.h"
 #include "../common/renderable.h"
 #include "../common/simple_shapes.h"
 #include "../common/matrix_stack.h"
 #include "../common/shaders.h"
+#include "../common/instance_batch.h"
+#include "../common/render_queue.h"
+#include "../common/stream_buffer.h"
+#include "../common/geometry_arena.h"
+#include "../common/soft_rasterizer.h"
+#include "../common/ao_baker.h"
+#include "../common/reflection_probes.h"
 
 float alpha_S, alpha_E, alpha_W;
+bool instanced = false;
+bool queued = false;
+bool streamed = false;
+bool arena_meshes = false;
 
 void keyboard_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     if (action == GLFW_PRESS || action == GLFW_REPEAT) {
@@ -30,6 +45,14 @@ void keyboard_callback(GLFWwindow* window, int key, int scancode, int action, in
         case GLFW_KEY_H:
             alpha_W -= 0.04;
             break;
+        case GLFW_KEY_I:
+            instanced = !instanced;
+            std::cout << (instanced ? "instanced" : "one draw per part") << std::endl;
+            break;
+        case GLFW_KEY_Q:
+            queued = !queued;
+            std::cout << (queued ? "draws through the render queue" : "draws issued directly") << std::endl;
+            break;
         default:
             break;
         }
@@ -38,8 +61,172 @@ void keyboard_callback(GLFWwindow* window, int key, int scancode, int action, in
 
 int main(int argc, char** argv) {
 
+    glm::mat4 glob = glm::scale(glm::mat4(1.0f), glm::vec3(0.01f, 0.01f, 1.0f));
+
+    glm::mat4 s_s = glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 10.0f, 1.0f));
+    glm::mat4 s_a = glm::scale(glm::mat4(1.0f), glm::vec3(15.0f, 5.0f, 1.0f));
+    glm::mat4 t_a = glm::translate(glm::mat4(1.0f), glm::vec3(25.0f, 0.0f, 0.0f));
+
+    glm::mat4 s_e = glm::scale(glm::mat4(1.0f), glm::vec3(8.0f, 8.0f, 1.0f));
+    glm::mat4 s_f = glm::scale(glm::mat4(1.0f), glm::vec3(12.0f, 4.0f, 1.0f));
+    glm::mat4 t_f = glm::translate(glm::mat4(1.0f), glm::vec3(20.0f, 0.0f, 0.0f));
+
+    glm::mat4 s_w = glm::scale(glm::mat4(1.0f), glm::vec3(6.0f, 6.0f, 1.0f));
+
+    glm::mat4 W = glm::translate(glm::mat4(1.0f), glm::vec3(30.0f, 0.0f, 0.0f));
+
+    glm::mat4 E = glm::translate(glm::mat4(1.0f), glm::vec3(40.0f, 0.0f, 0.0f));
+    alpha_S = alpha_E = alpha_W = 0.0f;
+
+    // --instanced: all the parts in one draw call (also toggled with I)
+    // --queue: the draws of the parts go through the sorted render queue, with a transparent halo
+    //   around each part in a second pass (also toggled with Q)
+    // --stream [subdata]: the vertices of the parts are transformed on the CPU and uploaded each
+    //   frame in a stream buffer, and drawn with one call (subdata: without the persistent mapping)
+    // --arena: each part is its own mesh in a geometry arena (compact vertices), drawn with
+    //   the arena bound once
+    // --probes file: loads the reflection probes baked by code_00_raytracer_probes as cube
+    //   map textures and checks them against the file
+    // --arms n: n arms in a grid, to see the cost of many parts
+    int n_arms = 1;
+    const char* probes_path = NULL;
+    bool stream_persistent = true;
+    for (int i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], "--instanced"))
+            instanced = true;
+        else if (!strcmp(argv[i], "--queue"))
+            queued = true;
+        else if (!strcmp(argv[i], "--stream")) {
+            streamed = true;
+            if (i + 1 < argc && !strcmp(argv[i + 1], "subdata")) {
+                stream_persistent = false;
+                ++i;
+            }
+        }
+        else if (!strcmp(argv[i], "--arena"))
+            arena_meshes = true;
+        else if (!strcmp(argv[i], "--probes") && i + 1 < argc)
+            probes_path = argv[++i];
+        else if (!strcmp(argv[i], "--arms") && i + 1 < argc)
+            n_arms = std::max(1, atoi(argv[++i]));
+    int grid = (int)ceil(sqrt((double)n_arms));
+
+    // draws the arm with the transformations on top of stack, calling draw_quad(M, color) for each part
+    auto draw_arm = [&](matrix_stack& stack, auto draw_quad) {
+        glm::mat4 r_S = glm::rotate(glm::mat4(1.0f), alpha_S, glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat4 r_E = glm::rotate(glm::mat4(1.0f), alpha_E, glm::vec3(0.0f, 0.0f, 1.0f));
+        glm::mat4 r_W = glm::rotate(glm::mat4(1.0f), alpha_W, glm::vec3(0.0f, 0.0f, 1.0f));
+
+        stack.push();
+
+        stack.mult(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -30.0f, 0.0f)));
+
+        stack.mult(r_S);
+
+        // Shoulder
+        stack.push();
+        stack.mult(s_s);
+        draw_quad(stack.m(), glm::vec3(0.3, 0.3, 0.6));
+        stack.pop();
+
+        // Arm
+        stack.push();
+        stack.mult(t_a * s_a);
+        draw_quad(stack.m(), glm::vec3(0.2, 0.3, 0.6));
+        stack.pop();
+
+        // Elbow frame
+        stack.mult(E * r_E);
+
+        // Elbow
+        stack.push();
+        stack.mult(s_e);
+        draw_quad(stack.m(), glm::vec3(0.4, 0.3, 0.5));
+        stack.pop();
+
+        // forearm
+        stack.push();
+        stack.mult(t_f * s_f);
+        draw_quad(stack.m(), glm::vec3(0.4, 0.2, 0.5));
+        stack.pop();
+
+        // wrist
+        stack.push();
+        stack.mult(W * r_W * s_w);
+        draw_quad(stack.m(), glm::vec3(0.4, 0.5, 0.0));
+        stack.pop();
+
+        stack.pop();
+    };
+
+    // --soft [n_frames]: no window, the arm is drawn by the CPU rasterizer while it moves,
+    // and the last frame is saved to arm_soft.ppm
+    if (argc > 1 && !strcmp(argv[1], "--soft")) {
+        int n_frames = (argc > 2) ? atoi(argv[2]) : 100;
+        soft_rasterizer raster(1024, 1024);
+        shape quad;
+        shape_maker::quad(quad);
+        matrix_stack stack;
+        stack.mult(glob);
+        double total_ms = 0.0;
+        for (int f = 0; f < n_frames; ++f) {
+            alpha_S = 0.02f * f;
+            alpha_E = -0.03f * f;
+            alpha_W = 0.05f * f;
+            auto t0 = std::chrono::steady_clock::now();
+            raster.clear(glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+            draw_arm(stack, [&](const glm::mat4& M, glm::vec3 col) { raster.draw(quad, M, col); });
+            raster.flush();
+            total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        }
+        std::cout << n_frames << " frames, " << total_ms / std::max(1, n_frames) << " ms per frame ("
+            << raster.n_threads << " threads)" << std::endl;
+        raster.save_ppm("arm_soft.ppm");
+        return 0;
+    }
+
+    // --ao [n]: no window, bakes the ambient occlusion of a ground of n x n quads (default 1000,
+    // about a million vertices) with a sphere and a box on it, prints the time it takes and
+    // saves the baked shapes drawn by the CPU rasterizer to ao_soft.ppm
+    if (argc > 1 && !strcmp(argv[1], "--ao")) {
+        int n = (argc > 2) ? std::max(1, atoi(argv[2])) : 1000;
+        shape ground, ball, box;
+        shape_maker::rectangle(ground, n, n);
+        shape_maker::sphere(ball, 4);
+        shape_maker::cube(box, 0.8f, 0.5f, 0.3f);
+        auto place = [](shape& sh, const glm::mat4& T) {
+            for (unsigned int i = 0; i < sh.vn; ++i)
+                sh.set_pos(i, glm::vec3(T * glm::vec4(sh.get_pos(i), 1.0f)));
+            sh.normals.clear();    // the baker computes them from the triangles
+        };
+        place(ball, glm::translate(glm::mat4(1.0f), glm::vec3(-0.4f, 0.3f, 0.0f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.3f)));
+        place(box, glm::translate(glm::mat4(1.0f), glm::vec3(0.4f, 0.25f, 0.2f)) * glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(0.0f, 1.0f, 0.0f))
+            * glm::scale(glm::mat4(1.0f), glm::vec3(0.25f)));
+
+        ao_baker baker;
+        auto t0 = std::chrono::steady_clock::now();
+        baker.bake({ &ground, &ball, &box });
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "ambient occlusion of " << ground.vn + ball.vn + box.vn << " vertices (" << baker.n_rays << " rays each) baked in "
+            << seconds << " s (" << baker.n_threads << " threads)" << std::endl;
+
+        soft_rasterizer raster(1024, 1024);
+        raster.depth_test = true;
+        glm::mat4 VP = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f)
+            * glm::lookAt(glm::vec3(0.0f, 1.6f, 2.4f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        raster.clear(glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+        for (const shape* sh : { &ground, &ball, &box })
+            raster.draw(*sh, VP);
+        raster.flush();
+        raster.save_ppm("ao_soft.ppm");
+        return 0;
+    }
+
     GLFWwindow* window;
 
+    headless hl(argc, argv);
+    hl.init_hints();
+
     /* Initialize the library */
     if (!glfwInit())
         return -1;
@@ -54,6 +241,8 @@ int main(int argc, char** argv) {
     // macOS requires this for 3.2+ contexts
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
+    hl.window_hints();
+
     /* Create a windowed mode window and its OpenGL context */
     window = glfwCreateWindow(1024, 1024, "code_04_robotic_arm_transformations", NULL, NULL);
 
@@ -71,7 +260,7 @@ int main(int argc, char** argv) {
     glfwSetKeyCallback(window, keyboard_callback);
 
     // Load GL symbols *after* the context is current
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    if (!gladLoadGLLoader(hl.loader())) {
         std::fprintf(stderr, "Failed to initialize GLAD\n");
         glfwDestroyWindow(window);
         glfwTerminate();
@@ -81,6 +270,8 @@ int main(int argc, char** argv) {
     /* query for the hardware and software specs and print the result on the console*/
     printout_opengl_glsl_info();
 
+    hl.create(1024, 1024);
+
     check_gl_errors(__LINE__, __FILE__);
 
     renderable quad, frame;
@@ -93,7 +284,90 @@ int main(int argc, char** argv) {
     // Shader files are located in the source tree; when running from the
     // VS_CG_PROJECT working directory the correct relative path is ../src/...
     s.create_program("../src/code_04_robotic_arm_transformations/shaders/basic.vert", "../src/code_04_robotic_arm_transformations/shaders/basic.frag");
-    glUseProgram(s.program);
+
+    /* the instanced path: the matrix and the color of each part are per-instance attributes */
+    shader s_inst;
+    s_inst.bind_attribute("aPosition", 0);
+    s_inst.bind_attribute("aColor", 3);
+    s_inst.bind_attribute("aM", 4);
+    s_inst.create_program("../src/code_04_robotic_arm_transformations/shaders/instanced.vert", "../src/code_04_robotic_arm_transformations/shaders/instanced.frag");
+
+    instance_batch quads;
+    quads.attach(quad);
+
+    /* the queued path: each part of an arm is nearer than the one before, so with the depth
+    *  test the opaque pass, sorted front to back, looks like the parts drawn in order. A second
+    *  pass draws a transparent halo around each part, blended back to front */
+    shader s_queue;
+    s_queue.bind_attribute("aPosition", 0);
+    s_queue.create_program("../src/code_04_robotic_arm_transformations/shaders/basic.vert", "../src/code_04_robotic_arm_transformations/shaders/queue.frag");
+    render_queue queue;
+    int q_basic = queue.add_program(s_queue, "uM", "uCol");
+    queue.set_back_to_front(1);
+    queue.on_pass[0] = [] {
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+    };
+    queue.on_pass[1] = [] {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_FALSE);
+    };
+
+    /* the streamed path: 6 vertices (x, y, r, g, b) per part written each frame */
+    struct stream_vertex { float x, y, r, g, b; };
+    std::vector<stream_vertex> stream_vertices;
+    shape quad_shape;
+    shape_maker::quad(quad_shape);
+    shader s_stream;
+    s_stream.bind_attribute("aPosition", 0);
+    s_stream.bind_attribute("aColor", 1);
+    s_stream.create_program("../src/code_04_robotic_arm_transformations/shaders/stream.vert", "../src/code_04_robotic_arm_transformations/shaders/instanced.frag");
+    stream_buffer sb;
+    renderable stream_va;
+    if (streamed) {
+        sb.create(n_arms * 5 * 6 * sizeof(stream_vertex), stream_persistent);
+        stream_va.create();
+        std::cout << "stream buffer: " << (sb.persistent ? "persistently mapped" : "glBufferSubData and orphaning") << std::endl;
+    }
+
+    /* the arena path: a mesh for each of the 5 parts. The arena starts too small for them, and
+    *  a grid added and removed between them leaves free ranges to merge and reuse */
+    geometry_arena arena;
+    geometry_arena::mesh part_meshes[5];
+    if (arena_meshes) {
+        arena.create(vertex_format::compact(), 4, 6);
+        shape grid_shape;
+        shape_maker::rectangle(grid_shape, 4, 4);
+        for (int i = 0; i < 5; ++i) {
+            geometry_arena::mesh tmp = arena.add(grid_shape);
+            part_meshes[i] = arena.add(quad_shape);
+            arena.remove(tmp);
+        }
+        std::cout << "arena: " << arena.meshes() << " meshes, " << arena.vertex_capacity() - arena.free_vertices() << "/" << arena.vertex_capacity()
+            << " vertices and " << arena.index_capacity() - arena.free_indices() << "/" << arena.index_capacity() << " indices used" << std::endl;
+    }
+
+    reflection_probes probes;
+    if (probes_path) {
+        if (!probes.load(probes_path))
+            std::cout << "cannot read the probes from " << probes_path << std::endl;
+        else {
+            // the largest level of the first face of each probe, read back as uploaded
+            int n_wrong = 0;
+            std::vector<uint32_t> texels(probes.file.face_size * probes.file.face_size);
+            for (size_t i = 0; i < probes.textures.size(); ++i) {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, probes.textures[i]);
+                glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV, texels.data());
+                if (memcmp(texels.data(), &probes.file.probes[i].texels[probes.file.offset(0, 0)], texels.size() * sizeof(uint32_t)))
+                    ++n_wrong;
+            }
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+            std::cout << probes.textures.size() << " probes of " << probes.file.face_size << "x" << probes.file.face_size << " with "
+                << probes.file.n_mips << " levels: " << probes.textures.size() * probes.texture_bytes() << " bytes of textures, "
+                << n_wrong << " read back different" << std::endl;
+        }
+    }
 
     /* cal glGetError and print out the result in a more verbose style
     * __LINE__ and __FILE__ are precompiler directive that replace the value with the
@@ -101,105 +375,89 @@ int main(int argc, char** argv) {
     */
     check_gl_errors(__LINE__, __FILE__);
 
-    glm::mat4 glob = glm::scale(glm::mat4(1.0f), glm::vec3(0.01f, 0.01f, 1.0f));
-
-    glm::mat4 s_s = glm::scale(glm::mat4(1.0f), glm::vec3(10.0f, 10.0f, 1.0f));
-    glm::mat4 s_a = glm::scale(glm::mat4(1.0f), glm::vec3(15.0f, 5.0f, 1.0f));
-    glm::mat4 t_a = glm::translate(glm::mat4(1.0f), glm::vec3(25.0f, 0.0f, 0.0f));
-
-    glm::mat4 s_e = glm::scale(glm::mat4(1.0f), glm::vec3(8.0f, 8.0f, 1.0f));
-    glm::mat4 s_f = glm::scale(glm::mat4(1.0f), glm::vec3(12.0f, 4.0f, 1.0f));
-    glm::mat4 t_f = glm::translate(glm::mat4(1.0f), glm::vec3(20.0f, 0.0f, 0.0f));
-
-    glm::mat4 s_w = glm::scale(glm::mat4(1.0f), glm::vec3(6.0f, 6.0f, 1.0f));
-
-    glm::mat4 W = glm::translate(glm::mat4(1.0f), glm::vec3(30.0f, 0.0f, 0.0f));
-
-    glm::mat4 E = glm::translate(glm::mat4(1.0f), glm::vec3(40.0f, 0.0f, 0.0f));
-    alpha_S = alpha_E = alpha_W = 0.0f;
-
     matrix_stack stack;
 
     stack.mult(glob);
 
     glDisable(GL_DEPTH_TEST);
-    while (!glfwWindowShouldClose(window))
+    while (hl.running(window))
     {
-        glm::mat4 r_S = glm::rotate(glm::mat4(1.0f), alpha_S, glm::vec3(0.0f, 0.0f, 1.0f));
-        glm::mat4 r_E = glm::rotate(glm::mat4(1.0f), alpha_E, glm::vec3(0.0f, 0.0f, 1.0f));
-        glm::mat4 r_W = glm::rotate(glm::mat4(1.0f), alpha_W, glm::vec3(0.0f, 0.0f, 1.0f));
+        hl.begin_frame();
 
         /* Render here */
         glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        stack.push();
-
-        stack.mult(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -30.0f, 0.0f)));
-
-        stack.mult(r_S);
-
-        stack.push();
-        stack.mult(s_s);
-
-        // Shoulder frame
-
-        // Shoulder
-        glUniformMatrix4fv(s["uM"], 1, GL_FALSE, glm::value_ptr(stack.m()));
-        stack.pop();
-        glUniform3f(s["uCol"], 0.3, 0.3, 0.6);
-        quad.bind();
-        glDrawElements(quad().mode, quad().count, quad().itype, NULL);
-
-        // Arm
-        stack.push();
-        stack.mult(t_a * s_a);
-        glUniformMatrix4fv(s["uM"], 1, GL_FALSE, glm::value_ptr(stack.m()));
-        stack.pop();
-        glUniform3f(s["uCol"], 0.2, 0.3, 0.6);
-        quad.bind();
-        glDrawElements(quad().mode, quad().count, quad().itype, NULL);
-
-
-        // Elbow frame
-        stack.mult(E * r_E);
-        stack.push();
-
-        // Elbow
-        stack.mult(s_e);
-
-        glUniformMatrix4fv(s["uM"], 1, GL_FALSE, glm::value_ptr(stack.m()));
-        stack.pop();
-
-        glUniform3f(s["uCol"], 0.4, 0.3, 0.5);
-        quad.bind();
-        glDrawElements(quad().mode, quad().count, quad().itype, NULL);
-
-
-        stack.push();
-
-        // forearm
-        stack.mult(t_f * s_f);
-
-        glUniformMatrix4fv(s["uM"], 1, GL_FALSE, glm::value_ptr(stack.m()));
-        stack.pop();
-        glUniform3f(s["uCol"], 0.4, 0.2, 0.5);
-        quad.bind();
-        glDrawElements(quad().mode, quad().count, quad().itype, NULL);
-
-
-        stack.push();
-        // wrist
-        stack.mult(W * r_W * s_w);
-        glUniformMatrix4fv(s["uM"], 1, GL_FALSE, glm::value_ptr(stack.m()));
-        stack.pop();
-
-        glUniform3f(s["uCol"], 0.4, 0.5, 0.0);
-        quad.bind();
-        glDrawElements(quad().mode, quad().count, quad().itype, NULL);
-
+        glUseProgram(instanced ? s_inst.program : streamed ? s_stream.program : s.program);
+        quads.clear();
+        stream_vertices.clear();
+        if (arena_meshes)
+            arena.bind();
+        for (int a = 0; a < n_arms; ++a) {
+            // the cell of the grid of the arm
+            stack.push();
+            stack.mult(glm::translate(glm::mat4(1.0f), glm::vec3(-100.0f + (a % grid + 0.5f) * 200.0f / grid, -100.0f + (a / grid + 0.5f) * 200.0f / grid, 0.0f)));
+            stack.mult(glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / grid, 1.0f / grid, 1.0f)));
+            if (instanced)
+                draw_arm(stack, [&](const glm::mat4& M, glm::vec3 col) { quads.add(M, col); });
+            else if (streamed)
+                draw_arm(stack, [&](const glm::mat4& M, glm::vec3 col) {
+                    for (unsigned int i : quad_shape.indices_triangles) {
+                        glm::vec4 p = M * glm::vec4(quad_shape.positions[3 * i], quad_shape.positions[3 * i + 1], 0.0f, 1.0f);
+                        stream_vertices.push_back({ p.x, p.y, col.r, col.g, col.b });
+                    }
+                    });
+            else if (queued) {
+                int part = 0;
+                draw_arm(stack, [&](const glm::mat4& M, glm::vec3 col) {
+                    glm::mat4 Mz = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.5f - 0.1f * part++)) * M;
+                    float depth = render_queue::depth(glm::mat4(1.0f), Mz);
+                    queue.submit(q_basic, quad, Mz, col, depth);
+                    queue.submit(q_basic, quad, Mz * glm::scale(glm::mat4(1.0f), glm::vec3(1.3f, 1.3f, 1.0f)), glm::vec4(1.0f, 1.0f, 0.8f, 0.25f), depth, 1);
+                    });
+            }
+            else if (arena_meshes) {
+                int part = 0;
+                draw_arm(stack, [&](const glm::mat4& M, glm::vec3 col) {
+                    const geometry_arena::mesh& m = part_meshes[part++];
+                    glUniformMatrix4fv(s["uM"], 1, GL_FALSE, glm::value_ptr(M * m.position_transform));
+                    glUniform3f(s["uCol"], col.r, col.g, col.b);
+                    arena.draw(m);
+                    });
+            }
+            else
+                draw_arm(stack, [&](const glm::mat4& M, glm::vec3 col) {
+                    glUniformMatrix4fv(s["uM"], 1, GL_FALSE, glm::value_ptr(M));
+                    glUniform3f(s["uCol"], col.r, col.g, col.b);
+                    quad.bind();
+                    glDrawElements(quad().mode, quad().count, quad().itype, NULL);
+                    });
+            stack.pop();
+        }
+        if (instanced)
+            quads.draw();
+        else if (streamed) {
+            sb.begin_frame();
+            GLintptr offset = sb.upload(stream_vertices);
+            stream_va.bind();
+            glBindBuffer(GL_ARRAY_BUFFER, sb.id);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(stream_vertex), (void*)offset);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(stream_vertex), (void*)(offset + 2 * sizeof(float)));
+            glDrawArrays(GL_TRIANGLES, 0, (GLsizei)stream_vertices.size());
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            sb.end_frame();
+        }
+        else if (queued) {
+            queue.flush();
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+        }
 
-        stack.pop();
+        hl.end_frame();
 
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
@@ -208,6 +466,22 @@ int main(int argc, char** argv) {
         glfwPollEvents();
     }
 
+    if (streamed)
+        std::cout << "stream buffer: " << sb.n_waits << " waits, " << sb.n_orphans << " orphans" << std::endl;
+
+    /* the GL objects must be deleted while the context exists */
+    sb.release();
+    arena.release();
+    probes.release();
+    stream_va.release();
+    s_stream.release();
+    quads.release();
+    quad.release();
+    frame.release();
+    s.release();
+    s_inst.release();
+    s_queue.release();
+    hl.finish();
     glfwTerminate();
 
     return 0;
@@ -0,0 +1,9 @@
+#version 410
+layout(location = 0) out vec4 color;
+in vec3 vColor;
+
+void main(void)
+{
+    color = vec4(vColor, 1.0);
+
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 410
+in vec2 aPosition;
+in vec4 aColor;
+in mat4 aM;
+out vec3 vColor;
+
+void main(void)
+{
+ gl_Position =  aM * vec4(aPosition, 0.0, 1.0);
+ vColor = aColor.rgb;
+}
\ No newline at end of file
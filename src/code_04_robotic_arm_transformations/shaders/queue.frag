@@ -0,0 +1,8 @@
+#version 410
+layout(location = 0) out vec4 color;
+
+uniform vec4 uCol;
+void main(void)
+{
+    color = uCol;
+}
@@ -0,0 +1,10 @@
+#version 410
+in vec2 aPosition;
+in vec3 aColor;
+out vec3 vColor;
+
+void main(void)
+{
+ gl_Position = vec4(aPosition, 0.0, 1.0);
+ vColor = aColor;
+}
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <climits>
+#include "../common/debugging.h"
+#include "../common/headless.h"
+#include "../common/renderable.h"
+#include "../common/simple_shapes.h"
+#include "../common/shaders.h"
+#include "tile_renderer.h"
+
+/*
+Interactive viewer for the CPU ray tracer of code_00_raytracer.
+Tiles are rendered by worker threads (tile_renderer) and streamed into a texture through
+two pixel buffer objects: while the GL copies the tiles of the previous frame from one PBO
+to the texture, the tiles finished in the meantime are written into the other one.
+
+keys: W/S forward/backward, A/D left/right, Q/E down/up, arrows rotate the camera
+
+usage: code_05_rt_viewer [--spheres N] [--size S] [--spp N] [--out out.ppm] [--headless [n_frames]]
+--headless (see common/headless.h, also without a display) runs until the --spp samples per
+pixel (default 16) are rendered, or for n_frames if given, then saves the image to --out
+(default viewer.ppm) and exits, e.g. ./code_05_rt_viewer --headless --spp 16.
+Run it from src/code_05_rt_viewer so that the shaders are found.
+*/
+
+camera cam;
+bool camera_moved = false;
+
+void keyboard_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS && action != GLFW_REPEAT)
+        return;
+    const float step = 0.1f, angle = 0.03f;
+    switch (key) {
+    case GLFW_KEY_W: cam.eye = cam.eye + cam.forward() * step; break;
+    case GLFW_KEY_S: cam.eye = cam.eye - cam.forward() * step; break;
+    case GLFW_KEY_D: cam.eye = cam.eye + cam.right() * step; break;
+    case GLFW_KEY_A: cam.eye = cam.eye - cam.right() * step; break;
+    case GLFW_KEY_E: cam.eye = cam.eye + p3(0, step, 0); break;
+    case GLFW_KEY_Q: cam.eye = cam.eye - p3(0, step, 0); break;
+    case GLFW_KEY_LEFT:  cam.yaw += angle; break;
+    case GLFW_KEY_RIGHT: cam.yaw -= angle; break;
+    case GLFW_KEY_UP:    cam.pitch += angle; break;
+    case GLFW_KEY_DOWN:  cam.pitch -= angle; break;
+    default: return;
+    }
+    camera_moved = true;
+}
+
+// a field of random spheres on top of a huge "ground" sphere
+void make_scene(sphere_list& scene, int n_spheres) {
+    scene.add(sphere(p3(0, -1001, -3), 1000, p3(200, 200, 200)));
+    scene.add(sphere(p3(0, 0, -3), 1.0, p3(255, 0, 0)));
+    scene.add(sphere(p3(0.6, 0.6, -2.0), 0.2, p3(0, 0, 255)));
+
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> u(0.f, 1.f);
+    for (int i = 0; i < n_spheres; ++i) {
+        float r = 0.05f + 0.15f * u(gen);
+        p3 c(-20 + 40 * u(gen), -1 + r, -40 + 38 * u(gen));
+        scene.add(sphere(c, r, p3(55 + 200 * u(gen), 55 + 200 * u(gen), 55 + 200 * u(gen))));
+    }
+}
+
+int main(int argc, char** argv) {
+    int n_spheres = 200;
+    int size = 768;
+    int headless_spp = 16;
+    bool n_frames_given = false;
+    std::string out_name = "viewer.ppm";
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--spheres") && i + 1 < argc) n_spheres = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc) size = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--spp") && i + 1 < argc) headless_spp = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--out") && i + 1 < argc) out_name = argv[++i];
+        else if (!strcmp(argv[i], "--headless")) n_frames_given = i + 1 < argc && argv[i + 1][0] != '-';
+    }
+
+    GLFWwindow* window;
+
+    headless hl(argc, argv);
+    hl.init_hints();
+    bool headless = hl.enabled;
+    if (headless && !n_frames_given)
+        hl.n_frames = INT_MAX;  // until all the samples are rendered
+
+    /* Initialize the library */
+    if (!glfwInit())
+        return -1;
+
+    // Request OpenGL 4.1
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+
+    // Ask specifically for the core profile (recommended)
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    // macOS requires this for 3.2+ contexts
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+
+    hl.window_hints();
+
+    /* Create a windowed mode window and its OpenGL context */
+    window = glfwCreateWindow(size, size, "code_05_rt_viewer", NULL, NULL);
+
+    if (!window)
+    {
+        glfwTerminate();
+        return -1;
+    }
+
+    /* Make the window's context current */
+    glfwMakeContextCurrent(window);
+
+    glfwSetKeyCallback(window, keyboard_callback);
+
+    // Load GL symbols *after* the context is current
+    if (!gladLoadGLLoader(hl.loader())) {
+        std::fprintf(stderr, "Failed to initialize GLAD\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return EXIT_FAILURE;
+    }
+
+    /* query for the hardware and software specs and print the result on the console*/
+    printout_opengl_glsl_info();
+
+    hl.create(size, size);
+
+    sphere_list scene;
+    make_scene(scene, n_spheres);
+    p3 Lp = p3(1, 3, -1); // point light position
+
+    const int W = size, H = size;
+
+    // the texture showing the ray traced image
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, W, H, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    /* two pixel buffer objects as large as the image: a tile is written at the same offset
+    *  it has in the image, so it can be copied to the texture with GL_UNPACK_ROW_LENGTH = W
+    */
+    GLuint pbo[2];
+    std::vector<tile_result> pending[2]; // tiles written in each PBO and not yet copied to the texture
+    glGenBuffers(2, pbo);
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, W * H * 4, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    renderable quad = shape_maker::quad();
+
+    shader s;
+    s.bind_attribute("aPosition", 0);
+    s.create_program("shaders/viewer.vert", "shaders/viewer.frag");
+    glUseProgram(s.program);
+    glUniform1i(s["uImage"], 0);
+
+    check_gl_errors(__LINE__, __FILE__);
+
+    tile_renderer<sphere_list> renderer(W, H, 32, scene, Lp, headless ? headless_spp : 1024);
+    renderer.set_camera(cam);
+    renderer.start();
+
+    int frame = 0;
+    int tiles_uploaded = 0;
+    auto t_start = std::chrono::steady_clock::now();
+    while (hl.running(window))
+    {
+        hl.begin_frame();
+
+        if (camera_moved) {
+            renderer.set_camera(cam);
+            camera_moved = false;
+        }
+
+        int fill = frame % 2;       // PBO written by the CPU in this frame
+        int upload = 1 - fill;      // PBO written in the previous frame, copied to the texture now
+
+        // 1. start the copy of the tiles of the previous frame to the texture (no wait: the copy
+        //    is performed by the GL asynchronously)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[upload]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, W);
+        for (const tile_result& t : pending[upload])
+            glTexSubImage2D(GL_TEXTURE_2D, 0, t.x0, t.y0, t.w, t.h, GL_RGBA, GL_UNSIGNED_BYTE,
+                (void*)(size_t)((t.y0 * W + t.x0) * 4));
+        tiles_uploaded += (int)pending[upload].size();
+        pending[upload].clear();
+
+        // 2. write the tiles finished since the last frame in the other PBO. Orphaning the buffer
+        //    makes sure we never wait for a copy still in progress from it
+        tile_result t{};
+        while (renderer.pop_finished(t))
+            pending[fill].push_back(std::move(t));
+        if (!pending[fill].empty()) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[fill]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, W * H * 4, NULL, GL_STREAM_DRAW);
+            unsigned char* ptr = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, W * H * 4,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            for (const tile_result& pt : pending[fill])
+                for (int y = 0; y < pt.h; ++y)
+                    memcpy(ptr + ((pt.y0 + y) * W + pt.x0) * 4, &pt.rgba[y * pt.w * 4], pt.w * 4);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        /* Render here */
+        glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        quad.bind();
+        glDrawElements(quad().mode, quad().count, quad().itype, NULL);
+
+        check_gl_errors(__LINE__, __FILE__);
+
+        hl.end_frame();
+
+        /* Swap front and back buffers */
+        glfwSwapBuffers(window);
+
+        /* Poll for and process events */
+        glfwPollEvents();
+        ++frame;
+
+        // headless: done when all the passes are rendered and both PBOs are copied to the texture
+        if (headless && renderer.idle() && pending[0].empty() && pending[1].empty())
+            break;
+    }
+
+    float secs = std::chrono::duration<float>(std::chrono::steady_clock::now() - t_start).count();
+    std::cout << frame << " frames in " << secs << " s (" << frame / secs << " fps), "
+        << tiles_uploaded << " tiles uploaded, " << renderer.passes_completed() << " spp" << std::endl;
+
+    renderer.stop();
+
+    if (headless) {
+        // read back the texture and save it, for regression tests
+        std::vector<unsigned char> pixels(W * H * 4);
+        glBindTexture(GL_TEXTURE_2D, tex);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+        image out(W, H);
+        for (int y = 0; y < H; ++y)
+            for (int x = 0; x < W; ++x) {
+                unsigned char* p = &pixels[(y * W + x) * 4];
+                out.set_pixel(x, y, p[0], p[1], p[2]);
+            }
+        out.save(out_name.c_str());
+    }
+
+    glDeleteBuffers(2, pbo);
+    glDeleteTextures(1, &tex);
+    quad.release();
+    s.release();
+    hl.finish();
+    glfwTerminate();
+
+    return 0;
+}
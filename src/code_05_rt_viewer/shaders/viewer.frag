@@ -0,0 +1,9 @@
+#version 410
+layout(location = 0) out vec4 color;
+in vec2 vTexCoord;
+
+uniform sampler2D uImage;
+void main(void)
+{
+    color = texture(uImage, vTexCoord);
+}
\ No newline at end of file
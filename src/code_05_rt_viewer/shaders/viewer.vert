@@ -0,0 +1,9 @@
+#version 410
+in vec3 aPosition;
+out vec2 vTexCoord;
+
+void main(void)
+{
+ gl_Position = vec4(aPosition.xy, 0.0, 1.0);
+ vTexCoord = aPosition.xy * 0.5 + 0.5;
+}
\ No newline at end of file
@@ -0,0 +1,229 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <random>
+#include "../code_00_raytracer/raytracer.h"
+
+/*
+Progressive tile renderer running on a pool of worker threads.
+The image is split in tiles; each pass adds one sample per pixel to every tile and
+every finished tile is made available (as RGBA8) through pop_finished(), so that the
+main thread can upload it while the workers keep rendering.
+Moving the camera starts a new "generation": the accumulation restarts from scratch
+and the tiles of the previous generation are dropped.
+*/
+
+// a rendered tile, ready to be uploaded
+struct tile_result {
+	int x0, y0, w, h;			// position and size in pixels (y0 = 0 is the bottom row)
+	unsigned int generation;	// camera generation the tile has been rendered with
+	int pass;					// number of samples per pixel accumulated so far
+	std::vector<unsigned char> rgba;
+};
+
+template <class SCENE>
+struct tile_renderer {
+	tile_renderer(int _w, int _h, int _tile_size, const SCENE& _scene, p3 _Lp, int _max_passes = 256)
+		:w(_w), h(_h), tile_size(_tile_size), scene(_scene), Lp(_Lp), max_passes(_max_passes),
+		generation(0), next_tile(0), pass(0), in_flight(0), quit(false) {
+		for (int y = 0; y < h; y += tile_size)
+			for (int x = 0; x < w; x += tile_size)
+				tiles.push_back(tile_rect{ x, y, std::min(tile_size, w - x), std::min(tile_size, h - y), 0, 0 });
+
+		// render from the center of the image outward, so the interesting part shows up first
+		std::sort(tiles.begin(), tiles.end(), [this](const tile_rect& a, const tile_rect& b) {
+			return dist2_from_center(a) < dist2_from_center(b); });
+
+		accum.resize(w * h);
+	}
+
+	~tile_renderer() { stop(); }
+
+	void start(int n_threads = std::thread::hardware_concurrency()) {
+		for (int i = 0; i < std::max(1, n_threads); ++i)
+			workers.push_back(std::thread(&tile_renderer::worker, this, i));
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(sched_mutex);
+			quit = true;
+		}
+		sched_cv.notify_all();
+		for (auto& t : workers)
+			t.join();
+		workers.clear();
+	}
+
+	// set a new camera and restart the progressive accumulation
+	void set_camera(const camera& c) {
+		{
+			std::lock_guard<std::mutex> lock(sched_mutex);
+			cam = c;
+			++generation;
+			next_tile = 0;
+			pass = 0;
+		}
+		sched_cv.notify_all();
+	}
+
+	// non blocking: returns false if no tile of the current generation is ready
+	bool pop_finished(tile_result& res) {
+		std::lock_guard<std::mutex> lock(done_mutex);
+		while (!done.empty()) {
+			bool current = (done.front().generation == generation);
+			if (current)
+				res = std::move(done.front());
+			done.pop_front();
+			if (current)
+				return true;
+		}
+		return false;
+	}
+
+	// number of passes completed for the current camera
+	int passes_completed() {
+		std::lock_guard<std::mutex> lock(sched_mutex);
+		return (next_tile == (int)tiles.size() && in_flight == 0) ? pass + 1 : pass;
+	}
+
+	// true when max_passes have been rendered and all the tiles have been popped
+	bool idle() {
+		std::lock_guard<std::mutex> lock(done_mutex);
+		return done.empty() && passes_completed() >= max_passes;
+	}
+
+	int w, h, tile_size;
+
+private:
+	struct tile_rect {
+		int x0, y0, w, h;
+		unsigned int generation;	// generation of the samples accumulated in this tile
+		int spp;					// samples per pixel accumulated in this tile
+	};
+
+	struct job {
+		int tile, pass;
+		unsigned int generation;
+		camera cam;
+	};
+
+	float dist2_from_center(const tile_rect& t) const {
+		float dx = t.x0 + t.w * 0.5f - w * 0.5f, dy = t.y0 + t.h * 0.5f - h * 0.5f;
+		return dx * dx + dy * dy;
+	}
+
+	// blocks until there is something to do. Returns false when the renderer is stopped
+	bool next_job(job& j) {
+		std::unique_lock<std::mutex> lock(sched_mutex);
+		for (;;) {
+			if (quit)
+				return false;
+
+			// all the tiles of this pass are done: start the next one
+			if (next_tile == (int)tiles.size() && in_flight == 0 && pass + 1 < max_passes) {
+				next_tile = 0;
+				++pass;
+			}
+
+			// a new generation starts only when the tiles of the old one are out of the way,
+			// so that a tile is never rendered by two workers at the same time
+			bool old_in_flight = (in_flight > 0 && in_flight_generation != generation);
+			if (next_tile < (int)tiles.size() && !old_in_flight) {
+				j.tile = next_tile++;
+				j.pass = pass;
+				j.generation = generation;
+				j.cam = cam;
+				in_flight_generation = generation;
+				++in_flight;
+				return true;
+			}
+			sched_cv.wait(lock);
+		}
+	}
+
+	void job_done() {
+		{
+			std::lock_guard<std::mutex> lock(sched_mutex);
+			--in_flight;
+		}
+		sched_cv.notify_all();
+	}
+
+	void worker(int id) {
+		std::mt19937 gen(id * 7919 + 1);
+		std::uniform_real_distribution<float> dist(0.f, 1.f);
+		job j;
+		while (next_job(j)) {
+			tile_rect& t = tiles[j.tile];
+			if (t.generation != j.generation || j.pass == 0) {
+				for (int y = t.y0; y < t.y0 + t.h; ++y)
+					std::fill(accum.begin() + y * w + t.x0, accum.begin() + y * w + t.x0 + t.w, p3(0, 0, 0));
+				t.generation = j.generation;
+				t.spp = 0;
+			}
+
+			bool aborted = false;
+			for (int y = t.y0; y < t.y0 + t.h && !aborted; ++y) {
+				for (int x = t.x0; x < t.x0 + t.w; ++x) {
+					// first pass through the pixel center, then jittered
+					float du = (j.pass == 0) ? 0.5f : dist(gen);
+					float dv = (j.pass == 0) ? 0.5f : dist(gen);
+					ray r = j.cam.primary((x + du) / w, (y + dv) / h);
+					accum[y * w + x] = accum[y * w + x] + ray_color(r, scene, Lp);
+				}
+				// the camera moved: the rest of this tile is useless
+				aborted = (generation != j.generation);
+			}
+
+			if (!aborted) {
+				t.spp++;
+				tile_result res;
+				res.x0 = t.x0; res.y0 = t.y0; res.w = t.w; res.h = t.h;
+				res.generation = j.generation;
+				res.pass = t.spp;
+				res.rgba.resize(t.w * t.h * 4);
+				float inv = 1.f / t.spp;
+				unsigned char* dst = &res.rgba[0];
+				for (int y = t.y0; y < t.y0 + t.h; ++y)
+					for (int x = t.x0; x < t.x0 + t.w; ++x) {
+						p3 c = accum[y * w + x] * inv;
+						*dst++ = (unsigned char)std::min(255.f, c.x);
+						*dst++ = (unsigned char)std::min(255.f, c.y);
+						*dst++ = (unsigned char)std::min(255.f, c.z);
+						*dst++ = 255;
+					}
+				std::lock_guard<std::mutex> lock(done_mutex);
+				done.push_back(std::move(res));
+			}
+			else
+				t.generation = (unsigned int)-1; // partially accumulated: reset on next use
+
+			job_done();
+		}
+	}
+
+	const SCENE& scene;
+	p3 Lp;
+	int max_passes;
+
+	std::vector<tile_rect> tiles;
+	std::vector<p3> accum;		// sum of the samples of each pixel
+	std::vector<std::thread> workers;
+
+	// scheduler state, protected by sched_mutex
+	std::mutex sched_mutex;
+	std::condition_variable sched_cv;
+	camera cam;
+	std::atomic<unsigned int> generation;
+	int next_tile, pass, in_flight;
+	unsigned int in_flight_generation = 0;
+	bool quit;
+
+	// finished tiles, protected by done_mutex
+	std::mutex done_mutex;
+	std::deque<tile_result> done;
+};
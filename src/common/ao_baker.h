@@ -0,0 +1,116 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <../../external/glm/glm.hpp>
+#include "simple_shapes.h"
+#include "triangle_bvh.h"
+
+/*
+Ambient occlusion baked into the vertex colors of shapes, so that it costs nothing at
+rendering time (the colors are already attribute 1 of shape::to_renderable).
+For each vertex n_rays cosine distributed rays are cast on the hemisphere around the
+normal; the occlusion is the fraction of them that hit a triangle within max_distance.
+The color of the vertex is multiplied by (1 - occlusion) (it is set to gray if the shape
+has no colors).
+The triangles of all the shapes baked together go in one triangle_bvh, so they occlude
+each other, and the vertices are split among all the cores.
+*/
+struct ao_baker {
+	int n_rays = 32;
+	float max_distance = 0.f;	// 0: a tenth of the diagonal of the bounding box
+	int n_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	void bake(shape& s) {
+		std::vector<shape*> shapes(1, &s);
+		bake(shapes);
+	}
+
+	// all the shapes must be in the same frame
+	void bake(const std::vector<shape*>& shapes) {
+		triangle_bvh bvh;
+		for (shape* s : shapes)
+			bvh.add(*s);
+		bvh.build();
+		float diag = glm::length(bvh.bbox_max() - bvh.bbox_min());
+		float dist = (max_distance > 0.f) ? max_distance : 0.1f * diag;
+		float eps = 1e-4f * diag;
+
+		for (shape* s : shapes) {
+			std::vector<glm::vec3> nrm = vertex_normals(*s);
+			if (s->colors.size() < 3 * s->vn)
+				s->colors.assign(3 * s->vn, 0.8f);
+
+			// chunks of vertices taken by the threads as they go
+			const int CHUNK = 256;
+			int n_chunks = (s->vn + CHUNK - 1) / CHUNK;
+			std::atomic<int> next(0);
+			auto work = [&]() {
+				for (int c = next++; c < n_chunks; c = next++)
+					for (unsigned int v = c * CHUNK; v < std::min(s->vn, (unsigned int)(c + 1) * CHUNK); ++v) {
+						float ao = visibility(bvh, s->get_pos(v), nrm[v], dist, eps, v);
+						for (int k = 0; k < 3; ++k)
+							s->colors[3 * v + k] *= ao;
+					}
+			};
+			std::vector<std::thread> threads;
+			for (int t = 1; t < n_threads; ++t)
+				threads.push_back(std::thread(work));
+			work();
+			for (std::thread& t : threads)
+				t.join();
+		}
+	}
+
+private:
+	// normals of the shape, or area weighted averages of the face normals if it has none
+	static std::vector<glm::vec3> vertex_normals(const shape& s) {
+		std::vector<glm::vec3> nrm(s.vn, glm::vec3(0.f));
+		if (s.normals.size() >= 3 * s.vn) {
+			for (unsigned int v = 0; v < s.vn; ++v)
+				nrm[v] = glm::vec3(s.normals[3 * v], s.normals[3 * v + 1], s.normals[3 * v + 2]);
+			return nrm;
+		}
+		for (size_t i = 0; i + 2 < s.indices_triangles.size(); i += 3) {
+			const unsigned int* t = &s.indices_triangles[i];
+			glm::vec3 fn = glm::cross(s.get_pos(t[1]) - s.get_pos(t[0]), s.get_pos(t[2]) - s.get_pos(t[0]));
+			for (int k = 0; k < 3; ++k)
+				nrm[t[k]] += fn;
+		}
+		for (glm::vec3& n : nrm) {
+			float l = glm::length(n);
+			n = (l > 0.f) ? n / l : glm::vec3(0, 0, 1);
+		}
+		return nrm;
+	}
+
+	// fraction of unoccluded rays at p. The rays are a Hammersley set, rotated around the normal
+	// by an angle that changes with the vertex so that neighbours do not show the same pattern
+	float visibility(const triangle_bvh& bvh, glm::vec3 p, glm::vec3 n, float dist, float eps, unsigned int v) const {
+		const float PI = 3.14159265358979f;
+		glm::vec3 t = (std::fabs(n.x) > 0.9f) ? glm::vec3(0, 1, 0) : glm::vec3(1, 0, 0);
+		glm::vec3 u = glm::normalize(glm::cross(t, n));
+		glm::vec3 w = glm::cross(n, u);
+		float rot = 2 * PI * ((v * 2654435761u) >> 8) / float(1 << 24);
+		glm::vec3 o = p + n * eps;
+
+		int free = 0;
+		for (int i = 0; i < n_rays; ++i) {
+			// cosine distributed direction from the 2D point (i/n, radical inverse of i)
+			float r1 = (i + 0.5f) / n_rays;
+			unsigned int bits = i;
+			bits = (bits << 16) | (bits >> 16);
+			bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+			bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+			bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+			bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+			float phi = 2 * PI * (bits * 2.3283064365386963e-10f) + rot;
+			float sin_theta = std::sqrt(r1), cos_theta = std::sqrt(1.f - r1);
+			glm::vec3 d = (u * std::cos(phi) + w * std::sin(phi)) * sin_theta + n * cos_theta;
+			if (!bvh.occluded(o, d, dist))
+				++free;
+		}
+		return float(free) / n_rays;
+	}
+};
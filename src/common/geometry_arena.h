@@ -0,0 +1,245 @@
+#pragma once
+#include <glad/glad.h>
+#include <map>
+#include <vector>
+#include "simple_shapes.h"
+
+/*
+The vertices and indices of many shapes in two large buffers, one vertex buffer and one
+index buffer, with a single VAO for all of them: a scene of many small meshes binds the VAO
+once and then only draws, without changing buffers.
+A shape added to the arena becomes a mesh, that is the ranges of its vertices and of its
+indices in the shared buffers. The indices are those of the shape (starting from 0) and are
+drawn with glDrawElementsBaseVertex, with the first vertex of the mesh as base vertex.
+All the vertices are in the same format (see vertex_format; shapes without colors or
+normals get gray and +z). With quantized positions each mesh has its position_transform,
+to apply before the model matrix as for renderable.
+The arena owns its buffers and vertex array (deleted with release() or when it is destroyed,
+see renderable), and can be moved but not copied.
+The ranges are allocated first fit from lists of free ranges, merged when adjacent when a
+mesh is removed. When there is no room the buffer is replaced by one twice as large (the
+content is copied on the GPU, the meshes keep their ranges).
+	geometry_arena arena;
+	arena.create(vertex_format::compact());
+	geometry_arena::mesh m = arena.add(s);
+	arena.bind();
+	... for each object: set uM = M * m.position_transform; arena.draw(m);
+*/
+struct geometry_arena {
+	// a shape in the arena
+	struct mesh {
+		GLuint first_vertex = 0, n_vertices = 0;
+		GLuint first_index = 0, n_indices = 0;
+		GLenum mode = GL_TRIANGLES;
+		glm::mat4 position_transform = glm::mat4(1.f);
+	};
+
+	vertex_format format;
+	GLuint vao = 0, vertex_buffer = 0, index_buffer = 0;
+
+	geometry_arena() {}
+	geometry_arena(const geometry_arena&) = delete;
+	geometry_arena& operator=(const geometry_arena&) = delete;
+	geometry_arena(geometry_arena&& a) noexcept { swap(a); }
+	geometry_arena& operator=(geometry_arena&& a) noexcept { swap(a); return *this; }
+	~geometry_arena() { release(); }
+
+	// capacities in vertices and indices (they grow as needed)
+	void create(vertex_format f = vertex_format(), GLuint vertex_capacity = 1 << 16, GLuint index_capacity = 1 << 18) {
+		release();
+		format = f;
+		shape no_vertices;	// for the layout
+		no_vertices.vn = 0;
+		std::vector<unsigned char> no_data;
+		glm::mat4 no_transform;
+		no_vertices.encode(format, true, no_data, attributes, no_transform);
+		glGenVertexArrays(1, &vao);
+		gpu_memory::add_vertex_arrays(1);
+		vertex_buffer = new_buffer((size_t)vertex_capacity * format.size(), gpu_memory::VERTEX_BUFFER);
+		index_buffer = new_buffer((size_t)index_capacity * sizeof(GLuint), gpu_memory::INDEX_BUFFER);
+		bind_buffers();
+		vertices.reset(vertex_capacity);
+		indices.reset(index_capacity);
+	}
+
+	void release() {
+		if (vao) {
+			glDeleteVertexArrays(1, &vao);
+			gpu_memory::add_vertex_arrays(-1);
+			delete_buffer(vertex_buffer, (size_t)vertices.capacity * format.size(), gpu_memory::VERTEX_BUFFER);
+			delete_buffer(index_buffer, (size_t)indices.capacity * sizeof(GLuint), gpu_memory::INDEX_BUFFER);
+		}
+		vao = vertex_buffer = index_buffer = 0;
+		vertices.reset(0);
+		indices.reset(0);
+		n_meshes = 0;
+	}
+
+	void swap(geometry_arena& a) {
+		std::swap(format, a.format);
+		std::swap(vao, a.vao);
+		std::swap(vertex_buffer, a.vertex_buffer);
+		std::swap(index_buffer, a.index_buffer);
+		attributes.swap(a.attributes);
+		std::swap(vertices, a.vertices);
+		std::swap(indices, a.indices);
+		std::swap(n_meshes, a.n_meshes);
+	}
+
+	// copies the triangles (or the edges) of s
+	mesh add(const shape& s, bool edges = false) {
+		mesh m;
+		const std::vector<unsigned int>& ind = edges ? s.indices_edges : s.indices_triangles;
+		std::vector<unsigned char> data;
+		std::vector<renderable::attribute> atts;
+		s.encode(format, true, data, atts, m.position_transform);
+		m.n_vertices = s.vn;
+		m.n_indices = (GLuint)ind.size();
+		m.mode = edges ? GL_LINES : GL_TRIANGLES;
+		m.first_vertex = allocate(vertices, vertex_buffer, m.n_vertices, format.size(), gpu_memory::VERTEX_BUFFER);
+		m.first_index = allocate(indices, index_buffer, m.n_indices, sizeof(GLuint), gpu_memory::INDEX_BUFFER);
+		upload(vertex_buffer, (size_t)m.first_vertex * format.size(), data.size(), data.data());
+		upload(index_buffer, (size_t)m.first_index * sizeof(GLuint), ind.size() * sizeof(GLuint), ind.data());
+		++n_meshes;
+		return m;
+	}
+
+	// frees the ranges of m (the mesh must not be drawn anymore)
+	void remove(const mesh& m) {
+		vertices.release(m.first_vertex, m.n_vertices);
+		indices.release(m.first_index, m.n_indices);
+		--n_meshes;
+	}
+
+	void bind() const {
+		glBindVertexArray(vao);
+	}
+
+	// with the arena bound
+	void draw(const mesh& m) const {
+		glDrawElementsBaseVertex(m.mode, m.n_indices, GL_UNSIGNED_INT, (void*)((size_t)m.first_index * sizeof(GLuint)), m.first_vertex);
+	}
+
+	int meshes() const { return n_meshes; }
+	GLuint vertex_capacity() const { return vertices.capacity; }
+	GLuint index_capacity() const { return indices.capacity; }
+	GLuint free_vertices() const { return vertices.n_free(); }
+	GLuint free_indices() const { return indices.n_free(); }
+
+private:
+	// first fit allocation of ranges of [0, capacity)
+	struct range_allocator {
+		std::map<GLuint, GLuint> free;	// first -> count, not adjacent
+		GLuint capacity = 0;
+
+		void reset(GLuint c) {
+			free.clear();
+			capacity = c;
+			if (c)
+				free[0] = c;
+		}
+
+		bool allocate(GLuint n, GLuint& first) {
+			for (auto it = free.begin(); it != free.end(); ++it)
+				if (it->second >= n) {
+					first = it->first;
+					GLuint rest = it->second - n;
+					free.erase(it);
+					if (rest)
+						free[first + n] = rest;
+					return true;
+				}
+			return false;
+		}
+
+		void release(GLuint first, GLuint n) {
+			if (!n)
+				return;
+			auto next = free.lower_bound(first);
+			if (next != free.end() && first + n == next->first) {
+				n += next->second;
+				next = free.erase(next);
+			}
+			if (next != free.begin()) {
+				auto prev = std::prev(next);
+				if (prev->first + prev->second == first) {
+					prev->second += n;
+					return;
+				}
+			}
+			free[first] = n;
+		}
+
+		// [capacity, c) becomes free
+		void grow(GLuint c) {
+			GLuint old = capacity;
+			capacity = c;
+			release(old, c - old);
+		}
+
+		GLuint n_free() const {
+			GLuint n = 0;
+			for (const auto& r : free)
+				n += r.second;
+			return n;
+		}
+	};
+
+	std::vector<renderable::attribute> attributes;
+	range_allocator vertices, indices;
+	int n_meshes = 0;
+
+	static GLuint new_buffer(size_t bytes, gpu_memory::category c) {
+		GLuint b;
+		glGenBuffers(1, &b);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, b);
+		glBufferData(GL_COPY_WRITE_BUFFER, bytes, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		gpu_memory::add(c, bytes);
+		return b;
+	}
+
+	static void delete_buffer(GLuint b, size_t bytes, gpu_memory::category c) {
+		glDeleteBuffers(1, &b);
+		gpu_memory::remove(c, bytes);
+	}
+
+	void bind_buffers() {
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+		for (const renderable::attribute& a : attributes) {
+			glEnableVertexAttribArray(a.index);
+			glVertexAttribPointer(a.index, a.num_components, a.type, a.normalized, format.size(), (void*)(size_t)a.offset);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// n elements of the given size from a, doubling the buffer until they fit
+	GLuint allocate(range_allocator& a, GLuint& buffer, GLuint n, size_t size, gpu_memory::category cat) {
+		GLuint first = 0;
+		while (n && !a.allocate(n, first)) {
+			GLuint c = std::max(a.capacity * 2, a.capacity + n);
+			GLuint b = new_buffer((size_t)c * size, cat);
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, b);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (size_t)a.capacity * size);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			delete_buffer(buffer, (size_t)a.capacity * size, cat);
+			buffer = b;
+			bind_buffers();
+			a.grow(c);
+		}
+		return first;
+	}
+
+	static void upload(GLuint buffer, size_t offset, size_t bytes, const void* data) {
+		if (!bytes)
+			return;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+};
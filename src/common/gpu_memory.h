@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+/*
+Accounting of the GL objects alive, to keep long sessions within a GPU memory budget.
+The types owning GL objects (renderable, shader, geometry_arena, stream_buffer,
+reflection_probes) register here what they create and unregister what they delete, so at
+any time the counters tell how many bytes are in buffers and textures, per category, and
+how many vertex arrays, programs and shaders exist (they are not exact driver numbers: the
+bytes are those requested, without alignment and the driver's own copies).
+	gpu_memory::stats s = gpu_memory::query();
+	if (s.total_bytes() > budget) ...
+	gpu_memory::report();					// all the counters, on stdout
+	gpu_memory::report_every(10.0);			// e.g. each frame: a report every 10 seconds
+*/
+struct gpu_memory {
+	enum category { VERTEX_BUFFER, INDEX_BUFFER, STREAM_BUFFER, TEXTURE, N_CATEGORIES };
+
+	struct stats {
+		long long bytes[N_CATEGORIES];
+		int objects[N_CATEGORIES];		// buffers or textures
+		int vertex_arrays, programs, shaders;
+		long long peak_bytes;			// largest total since the start
+
+		long long total_bytes() const {
+			long long t = 0;
+			for (int c = 0; c < N_CATEGORIES; ++c)
+				t += bytes[c];
+			return t;
+		}
+	};
+
+	static const char* name(category c) {
+		static const char* names[N_CATEGORIES] = { "vertex buffers", "index buffers", "stream buffers", "textures" };
+		return names[c];
+	}
+
+	// a buffer or texture of the given size was created (n = 1) or deleted (n = -1)
+	static void add(category c, long long bytes, int n = 1) {
+		counters& k = live();
+		k.bytes[c] += n * bytes;
+		k.objects[c] += n;
+		long long t = 0;
+		for (int i = 0; i < N_CATEGORIES; ++i)
+			t += k.bytes[i];
+		long long p = k.peak_bytes.load();
+		while (t > p && !k.peak_bytes.compare_exchange_weak(p, t))
+			;
+	}
+	static void remove(category c, long long bytes) { add(c, bytes, -1); }
+
+	static void add_vertex_arrays(int n) { live().vertex_arrays += n; }
+	static void add_programs(int n) { live().programs += n; }
+	static void add_shaders(int n) { live().shaders += n; }
+
+	static stats query() {
+		const counters& k = live();
+		stats s;
+		for (int c = 0; c < N_CATEGORIES; ++c) {
+			s.bytes[c] = k.bytes[c];
+			s.objects[c] = k.objects[c];
+		}
+		s.vertex_arrays = k.vertex_arrays;
+		s.programs = k.programs;
+		s.shaders = k.shaders;
+		s.peak_bytes = k.peak_bytes;
+		return s;
+	}
+
+	static void report(FILE* f = stdout) {
+		stats s = query();
+		fprintf(f, "GPU memory: %.2f MB (peak %.2f MB)\n", s.total_bytes() / 1048576.0, s.peak_bytes / 1048576.0);
+		for (int c = 0; c < N_CATEGORIES; ++c)
+			fprintf(f, "  %-15s %6d  %10.2f MB\n", name((category)c), s.objects[c], s.bytes[c] / 1048576.0);
+		fprintf(f, "  vertex arrays %d, programs %d, shaders %d\n", s.vertex_arrays, s.programs, s.shaders);
+	}
+
+	// reports if at least seconds passed since the last report of report_every
+	static void report_every(double seconds, FILE* f = stdout) {
+		static auto last = std::chrono::steady_clock::now();
+		auto now = std::chrono::steady_clock::now();
+		if (std::chrono::duration<double>(now - last).count() < seconds)
+			return;
+		last = now;
+		report(f);
+	}
+
+private:
+	struct counters {
+		std::atomic<long long> bytes[N_CATEGORIES] = {};
+		std::atomic<int> objects[N_CATEGORIES] = {};
+		std::atomic<int> vertex_arrays{ 0 }, programs{ 0 }, shaders{ 0 };
+		std::atomic<long long> peak_bytes{ 0 };
+	};
+
+	static counters& live() {
+		static counters k;
+		return k;
+	}
+};
@@ -0,0 +1,308 @@
+#pragma once
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "gpu_memory.h"
+#ifdef HEADLESS_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
+/*
+Headless mode of the GL examples, to run them without a display (e.g. in automation, also
+with Mesa llvmpipe) and to benchmark and compare their rendering.
+Command line:
+	--headless [n_frames]	renders n_frames (default 100) and exits
+	--dump prefix			saves the frames as prefix_0000.ppm, prefix_0001.ppm ...
+	--dump-every k			... only one every k frames
+	--timings file.csv		writes the CPU and GPU time of each frame
+	--warmup k				leaves the first k frames (default 1) out of the statistics
+	--gpu-report seconds	prints the GPU memory in use (see gpu_memory) every that many
+							seconds and at the end, also without --headless
+In headless mode the window is invisible and the frames are drawn into an offscreen
+framebuffer of the same size. On Linux without a display, if the example is built with
+HEADLESS_EGL (when CMake finds EGL), GLFW uses its null platform for a window without a
+context, and the context is an EGL surfaceless one (Mesa, also llvmpipe): this is why GL
+must be loaded with hl.loader() instead of glfwGetProcAddress. Each frame is timed on the CPU (from begin_frame
+to end_frame) and on the GPU (GL_TIME_ELAPSED query). Dumped frames are read into pixel
+buffers and written N_SLOTS - 1 frames later, as are the query results, so that neither
+stalls the pipeline.
+Usage in the example:
+	headless hl(argc, argv);
+	hl.init_hints();					// before glfwInit
+	hl.window_hints();					// before glfwCreateWindow
+	gladLoadGLLoader(hl.loader());		// after glfwMakeContextCurrent
+	hl.create(w, h);
+	while (hl.running(window)) {		// instead of !glfwWindowShouldClose(window)
+		hl.begin_frame();
+		... draw ...
+		hl.end_frame();
+		glfwSwapBuffers(window); glfwPollEvents();
+	}
+	hl.finish();						// before glfwTerminate
+Without --headless all the calls do nothing (but the GPU memory reports).
+*/
+struct headless {
+	static const int N_SLOTS = 3;	// frames in flight for the queries and the readbacks
+
+	bool enabled = false;
+	int n_frames = 100;
+	std::string dump_prefix;
+	int dump_every = 1;
+	std::string timings_path;
+	int warmup = 1;	// first frames compile shaders, and llvmpipe gets their GPU time wrong
+	double gpu_report = 0.0;	// seconds between GPU memory reports, 0 for none
+
+	headless(int argc, char** argv) {
+		for (int i = 1; i < argc; ++i) {
+			if (!strcmp(argv[i], "--headless")) {
+				enabled = true;
+				if (i + 1 < argc && argv[i + 1][0] != '-')
+					n_frames = atoi(argv[++i]);
+			}
+			else if (!strcmp(argv[i], "--dump") && i + 1 < argc)
+				dump_prefix = argv[++i];
+			else if (!strcmp(argv[i], "--dump-every") && i + 1 < argc)
+				dump_every = std::max(1, atoi(argv[++i]));
+			else if (!strcmp(argv[i], "--timings") && i + 1 < argc)
+				timings_path = argv[++i];
+			else if (!strcmp(argv[i], "--warmup") && i + 1 < argc)
+				warmup = std::max(0, atoi(argv[++i]));
+			else if (!strcmp(argv[i], "--gpu-report") && i + 1 < argc)
+				gpu_report = std::max(0.0, atof(argv[++i]));
+		}
+	}
+
+	void init_hints() {
+		if (!enabled)
+			return;
+#if defined(HEADLESS_EGL) && defined(__linux__) && GLFW_VERSION_MAJOR * 100 + GLFW_VERSION_MINOR >= 304
+		if (!getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY")) {
+			glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+			surfaceless = true;
+		}
+#endif
+	}
+
+	void window_hints() {
+		if (!enabled)
+			return;
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#ifdef HEADLESS_EGL
+		if (surfaceless) {
+			glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+			if (!create_egl_context())
+				fprintf(stderr, "headless: cannot create an EGL surfaceless context\n");
+		}
+#endif
+	}
+
+	// function to load GL with
+	GLADloadproc loader() const {
+#ifdef HEADLESS_EGL
+		if (surfaceless)
+			return (GLADloadproc)eglGetProcAddress;
+#endif
+		return (GLADloadproc)glfwGetProcAddress;
+	}
+
+	// framebuffer, queries and pixel buffers (with the context current)
+	bool create(int _w, int _h) {
+		if (!enabled)
+			return true;
+		w = _w;
+		h = _h;
+		if (!surfaceless)
+			glfwSwapInterval(0);
+
+		glGenFramebuffers(1, &fbo);
+		glGenRenderbuffers(2, rbo);
+		glBindRenderbuffer(GL_RENDERBUFFER, rbo[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+		glBindRenderbuffer(GL_RENDERBUFFER, rbo[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, w, h);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo[0]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo[1]);
+		bool ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glViewport(0, 0, w, h);
+
+		glGenQueries(N_SLOTS, queries);
+		glGenBuffers(N_SLOTS, pbos);
+		for (int i = 0; i < N_SLOTS; ++i) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, w * h * 4, NULL, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		if (!ok)
+			fprintf(stderr, "headless: incomplete framebuffer\n");
+		return ok;
+	}
+
+	bool running(GLFWwindow* window) const {
+		return enabled ? frame < n_frames : !glfwWindowShouldClose(window);
+	}
+
+	void begin_frame() {
+		if (!enabled)
+			return;
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glBeginQuery(GL_TIME_ELAPSED, queries[frame % N_SLOTS]);
+		t_begin = std::chrono::steady_clock::now();
+	}
+
+	void end_frame() {
+		if (gpu_report > 0.0)
+			gpu_memory::report_every(gpu_report);
+		if (!enabled)
+			return;
+		int s = frame % N_SLOTS;
+		glEndQuery(GL_TIME_ELAPSED);
+		cpu_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_begin).count());
+		gpu_ms.push_back(0.0);
+		slot_dumped[s] = !dump_prefix.empty() && frame % dump_every == 0;
+		if (slot_dumped[s]) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[s]);
+			glReadBuffer(GL_COLOR_ATTACHMENT0);
+			glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+		++frame;
+		if (frame >= N_SLOTS)
+			collect(frame - N_SLOTS);	// its slot is the next one
+	}
+
+	// collects the frames still in flight, prints the statistics and releases the GL objects
+	void finish() {
+		if (gpu_report > 0.0 && !finished)
+			gpu_memory::report();
+		if (!enabled || finished)
+			return;
+		finished = true;
+		for (int f = std::max(0, frame - N_SLOTS + 1); f < frame; ++f)
+			collect(f);
+		if ((int)cpu_ms.size() > warmup) {
+			print_stats("cpu", std::vector<double>(cpu_ms.begin() + warmup, cpu_ms.end()));
+			print_stats("gpu", std::vector<double>(gpu_ms.begin() + warmup, gpu_ms.end()));
+		}
+		if (!timings_path.empty()) {
+			FILE* f = fopen(timings_path.c_str(), "w");
+			if (f) {
+				fprintf(f, "frame,cpu_ms,gpu_ms\n");
+				for (size_t i = 0; i < cpu_ms.size(); ++i)
+					fprintf(f, "%d,%.4f,%.4f\n", (int)i, cpu_ms[i], gpu_ms[i]);
+				fclose(f);
+			}
+		}
+		release();
+	}
+
+	void release() {
+		if (!fbo)
+			return;
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(2, rbo);
+		glDeleteQueries(N_SLOTS, queries);
+		glDeleteBuffers(N_SLOTS, pbos);
+		fbo = 0;
+#ifdef HEADLESS_EGL
+		if (egl_context != EGL_NO_CONTEXT) {
+			eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(egl_display, egl_context);
+			eglTerminate(egl_display);
+			egl_context = EGL_NO_CONTEXT;
+		}
+#endif
+	}
+
+	std::vector<double> cpu_ms, gpu_ms;	// per frame
+
+private:
+	bool surfaceless = false;
+	bool finished = false;
+	int w = 0, h = 0;
+	int frame = 0;	// frames ended
+	GLuint fbo = 0, rbo[2] = { 0, 0 };
+	GLuint queries[N_SLOTS] = {}, pbos[N_SLOTS] = {};
+	bool slot_dumped[N_SLOTS] = {};
+	std::chrono::steady_clock::time_point t_begin;
+#ifdef HEADLESS_EGL
+	EGLDisplay egl_display = EGL_NO_DISPLAY;
+	EGLContext egl_context = EGL_NO_CONTEXT;
+
+	// OpenGL 4.1 core context with no surface, made current
+	bool create_egl_context() {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (!get_display)
+			return false;
+		egl_display = get_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, NULL, NULL) || !eglBindAPI(EGL_OPENGL_API))
+			return false;
+		const EGLint config_attribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config;
+		EGLint n_configs = 0;
+		if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &n_configs) || n_configs == 0)
+			return false;
+		const EGLint context_attribs[] = { EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 1,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+		egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+		return egl_context != EGL_NO_CONTEXT && eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context);
+	}
+#endif
+
+	// reads the GPU time and writes the dump of frame f
+	void collect(int f) {
+		int s = f % N_SLOTS;
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(queries[s], GL_QUERY_RESULT, &ns);
+		gpu_ms[f] = ns * 1e-6;
+		if (!slot_dumped[s])
+			return;
+		slot_dumped[s] = false;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[s]);
+		const unsigned char* px = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, w * h * 4, GL_MAP_READ_BIT);
+		if (px) {
+			char name[32];
+			snprintf(name, sizeof(name), "_%04d.ppm", f);
+			save_ppm(dump_prefix + name, px);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	// RGBA, bottom row first
+	void save_ppm(const std::string& path, const unsigned char* px) const {
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f)
+			return;
+		fprintf(f, "P6\n%d %d\n255\n", w, h);
+		std::vector<unsigned char> row(w * 3);
+		for (int j = h - 1; j >= 0; --j) {
+			for (int i = 0; i < w; ++i)
+				for (int k = 0; k < 3; ++k)
+					row[i * 3 + k] = px[(j * w + i) * 4 + k];
+			fwrite(row.data(), 1, row.size(), f);
+		}
+		fclose(f);
+	}
+
+	static void print_stats(const char* what, std::vector<double> ms) {
+		std::sort(ms.begin(), ms.end());
+		double sum = 0.0;
+		for (double v : ms)
+			sum += v;
+		printf("%s ms per frame: avg %.3f min %.3f median %.3f p95 %.3f max %.3f (%d frames)\n", what, sum / ms.size(),
+			ms.front(), ms[ms.size() / 2], ms[std::min(ms.size() - 1, ms.size() * 95 / 100)], ms.back(), (int)ms.size());
+	}
+};
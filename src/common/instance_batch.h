@@ -0,0 +1,119 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+#include <../../external/glm/glm.hpp>
+#include "renderable.h"
+#include "gpu_memory.h"
+
+/*
+Instanced drawing of many copies of the same mesh, each with its model matrix and color:
+instead of setting the uniforms and drawing each copy, the instances of the frame are
+collected in a vector and drawn with a single glDrawElementsInstanced.
+The matrix and the color of the instances are vertex attributes of the mesh's vertex array
+that advance once per instance (glVertexAttribDivisor), from a buffer of the batch that is
+refilled each frame (orphaned with glBufferData, so the CPU does not wait for the GPU still
+reading the previous frame). By default the color is the attribute 3 and the matrix the
+attributes 4 to 7 (a mat4 takes four, one per column):
+	s.bind_attribute("aColor", 3);		// in vec4 aColor;
+	s.bind_attribute("aM", 4);			// in mat4 aM;
+One batch per mesh (it is attached to its vertex array, and uses its first set of indices):
+	instance_batch b;
+	b.attach(quad);
+	... each frame:
+	b.clear();
+	b.add(M, color); ...
+	b.draw();
+The batch owns its buffer as a renderable, it can be moved but not copied.
+*/
+struct instance_batch {
+	struct instance {
+		glm::mat4 M;
+		glm::vec4 color;
+	};
+
+	std::vector<instance> instances;
+
+	instance_batch() {}
+	instance_batch(const instance_batch&) = delete;
+	instance_batch& operator=(const instance_batch&) = delete;
+	instance_batch(instance_batch&& b) noexcept { swap(b); }
+	instance_batch& operator=(instance_batch&& b) noexcept { swap(b); return *this; }
+	~instance_batch() { release(); }
+
+	// adds the per-instance attributes to the vertex array of r (created and with its indices)
+	void attach(const renderable& r, unsigned int color_location = 3, unsigned int matrix_location = 4) {
+		release();
+		vao = r.vao;
+		elements = r.elements.empty() ? renderable::element_array() : r.elements[0];
+		position_transform = r.position_transform;
+		capacity = 64;
+		glGenBuffers(1, &buffer);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(instance), NULL, GL_STREAM_DRAW);
+		gpu_memory::add(gpu_memory::VERTEX_BUFFER, capacity * sizeof(instance));
+		glEnableVertexAttribArray(color_location);
+		glVertexAttribPointer(color_location, 4, GL_FLOAT, false, sizeof(instance), (void*)offsetof(instance, color));
+		glVertexAttribDivisor(color_location, 1);
+		for (unsigned int c = 0; c < 4; ++c) {
+			glEnableVertexAttribArray(matrix_location + c);
+			glVertexAttribPointer(matrix_location + c, 4, GL_FLOAT, false, sizeof(instance), (void*)(offsetof(instance, M) + c * sizeof(glm::vec4)));
+			glVertexAttribDivisor(matrix_location + c, 1);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void release() {
+		if (buffer) {
+			glDeleteBuffers(1, &buffer);
+			gpu_memory::remove(gpu_memory::VERTEX_BUFFER, capacity * sizeof(instance));
+		}
+		buffer = 0;
+		capacity = 0;
+		vao = 0;
+		instances.clear();
+	}
+
+	void swap(instance_batch& b) {
+		instances.swap(b.instances);
+		std::swap(vao, b.vao);
+		std::swap(buffer, b.buffer);
+		std::swap(capacity, b.capacity);
+		std::swap(elements, b.elements);
+		std::swap(position_transform, b.position_transform);
+	}
+
+	void clear() { instances.clear(); }
+
+	// M is the model matrix (the position transform of the mesh is applied here)
+	void add(const glm::mat4& M, glm::vec3 color) {
+		instances.push_back({ M * position_transform, glm::vec4(color, 1.f) });
+	}
+
+	// uploads the instances and draws them, with the program already in use
+	void draw() {
+		if (instances.empty() || !buffer)
+			return;
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		if (instances.size() > capacity) {
+			gpu_memory::remove(gpu_memory::VERTEX_BUFFER, capacity * sizeof(instance));
+			while (capacity < instances.size())
+				capacity *= 2;
+			gpu_memory::add(gpu_memory::VERTEX_BUFFER, capacity * sizeof(instance));
+		}
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(instance), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(instance), instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(vao);
+		glDrawElementsInstanced(elements.mode, elements.count, elements.itype, NULL, (GLsizei)instances.size());
+		glBindVertexArray(0);
+	}
+
+private:
+	GLuint vao = 0, buffer = 0;
+	size_t capacity = 0;	// in instances
+	renderable::element_array elements;
+	glm::mat4 position_transform = glm::mat4(1.f);
+};
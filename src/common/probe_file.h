@@ -0,0 +1,131 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*
+File of baked reflection probes, written by the ray tracer (code_00_raytracer/probe_baker.h)
+and read by the raster examples (reflection_probes.h). It does not depend on OpenGL.
+Every probe is a cube map with n_mips levels: level 0 is the radiance seen from the probe
+position, level m is prefiltered for roughness m / (n_mips - 1), at half the resolution of
+level m-1. The face size is a power of two and there are at most log2(face_size) + 1 levels
+(down to 1x1, as in the GL mip chain). The texels are RGB9E5 (three 9 bit mantissas and a
+shared 5 bit exponent, the GL_RGB9_E5 format), 4 bytes for an HDR color.
+Layout: header, then for each probe its position and the levels (largest first), each with
+the 6 faces in the order and orientation of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i.
+*/
+struct probe_file {
+	struct header {
+		char magic[8];
+		uint32_t n_probes, face_size, n_mips, reserved;
+	};
+
+	struct probe {
+		float pos[3];
+		std::vector<uint32_t> texels;	// all the levels
+	};
+
+	uint32_t face_size = 0, n_mips = 0;
+	std::vector<probe> probes;
+
+	static uint32_t level_size(uint32_t face_size, uint32_t m) { return std::max(1u, face_size >> m); }
+
+	static bool valid_size(uint32_t face_size) { return face_size > 0 && (face_size & (face_size - 1)) == 0; }
+
+	// levels down to 1x1: log2(face_size) + 1
+	static uint32_t max_mips(uint32_t face_size) {
+		uint32_t n = 1;
+		while (face_size > 1) {
+			face_size >>= 1;
+			++n;
+		}
+		return n;
+	}
+
+	// texels of all the levels of a probe
+	uint32_t probe_texels() const {
+		uint32_t n = 0;
+		for (uint32_t m = 0; m < n_mips; ++m)
+			n += 6 * level_size(face_size, m) * level_size(face_size, m);
+		return n;
+	}
+
+	// first texel of face f of level m, in probe::texels
+	uint32_t offset(uint32_t m, int f) const {
+		uint32_t n = 0;
+		for (uint32_t l = 0; l < m; ++l)
+			n += 6 * level_size(face_size, l) * level_size(face_size, l);
+		return n + f * level_size(face_size, m) * level_size(face_size, m);
+	}
+
+	// level to sample for a given roughness in [0,1] (fractional: interpolate between levels)
+	float lod(float roughness) const { return roughness * (n_mips - 1); }
+
+	// shared exponent packing of the EXT_texture_shared_exponent specification
+	static uint32_t pack_rgb9e5(float r, float g, float b) {
+		const int N = 9, B = 15;
+		const float max_value = 65408.f;	// (2^9 - 1) / 2^9 * 2^16
+		float c[3] = { r, g, b };
+		for (float& v : c)
+			v = (v > 0.f) ? std::min(v, max_value) : 0.f;	// also NaN -> 0
+		float maxc = std::max(c[0], std::max(c[1], c[2]));
+		int e = std::max(-B - 1, (int)floor(log2(std::max(maxc, 1e-30f)))) + 1 + B;
+		if ((int)floor(maxc / ldexp(1.f, e - B - N) + 0.5f) == (1 << N))
+			++e;
+		uint32_t p = (uint32_t)e << 27;
+		for (int k = 0; k < 3; ++k)
+			p |= (uint32_t)floor(c[k] / ldexp(1.f, e - B - N) + 0.5f) << (9 * k);
+		return p;
+	}
+
+	static void unpack_rgb9e5(uint32_t p, float* rgb) {
+		float scale = ldexp(1.f, (int)(p >> 27) - 15 - 9);
+		for (int k = 0; k < 3; ++k)
+			rgb[k] = ((p >> (9 * k)) & 511) * scale;
+	}
+
+	bool save(const std::string& path) const {
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f)
+			return false;
+		header h = { { 'P', 'R', 'O', 'B', 'E', 'S', '1', 0 }, (uint32_t)probes.size(), face_size, n_mips, 0 };
+		fwrite(&h, sizeof(h), 1, f);
+		for (const probe& p : probes) {
+			fwrite(p.pos, sizeof(float), 3, f);
+			fwrite(p.texels.data(), sizeof(uint32_t), p.texels.size(), f);
+		}
+		bool ok = !ferror(f);
+		fclose(f);
+		return ok;
+	}
+
+	bool load(const std::string& path) {
+		FILE* f = fopen(path.c_str(), "rb");
+		if (!f)
+			return false;
+		header h;
+		bool ok = fread(&h, sizeof(h), 1, f) == 1 && !memcmp(h.magic, "PROBES1", 8) && valid_size(h.face_size) && h.n_mips > 0;
+		if (ok) {
+			// the levels past 1x1 are read and dropped
+			face_size = h.face_size;
+			n_mips = h.n_mips;
+			uint32_t stored = probe_texels();
+			n_mips = std::min(n_mips, max_mips(face_size));
+			probes.resize(h.n_probes);
+			for (probe& p : probes) {
+				p.texels.resize(stored);
+				ok = ok && fread(p.pos, sizeof(float), 3, f) == 3
+					&& fread(p.texels.data(), sizeof(uint32_t), p.texels.size(), f) == p.texels.size();
+				p.texels.resize(probe_texels());
+			}
+		}
+		fclose(f);
+		if (!ok)
+			probes.clear();
+		return ok;
+	}
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <../../external/glm/glm.hpp>
+#include "probe_file.h"
+#include "gpu_memory.h"
+
+/*
+Reflection probes baked offline by the ray tracer (code_00_raytracer_probes), loaded as
+GL_RGB9_E5 cube map textures with their prefiltered mip levels.
+In the shader a reflection of roughness r at a point p samples the cube map of the probe
+nearest to p along the reflected direction, at level lod(r) (passed as a uniform):
+	vec3 refl = textureLod(uProbe, reflect(-V, N), uLod).rgb;
+so the only per frame cost is a texture fetch.
+The textures are owned as the buffers of a renderable: deleted with release() or when the
+object is destroyed, and moved but not copied.
+*/
+struct reflection_probes {
+	probe_file file;
+	std::vector<GLuint> textures;	// one cube map per probe
+
+	reflection_probes() {}
+	reflection_probes(const reflection_probes&) = delete;
+	reflection_probes& operator=(const reflection_probes&) = delete;
+	reflection_probes(reflection_probes&& r) noexcept { swap(r); }
+	reflection_probes& operator=(reflection_probes&& r) noexcept { swap(r); return *this; }
+	~reflection_probes() { release(); }
+
+	// reads the file and creates the textures (with a current GL context)
+	bool load(const std::string& path) {
+		release();
+		if (!file.load(path))
+			return false;
+		for (const probe_file::probe& p : file.probes) {
+			textures.push_back(0);
+			glGenTextures(1, &textures.back());
+			glBindTexture(GL_TEXTURE_CUBE_MAP, textures.back());
+			for (uint32_t m = 0; m < file.n_mips; ++m) {
+				GLsizei s = probe_file::level_size(file.face_size, m);
+				for (int f = 0; f < 6; ++f)
+					glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, m, GL_RGB9_E5, s, s, 0, GL_RGB, GL_UNSIGNED_INT_5_9_9_9_REV,
+						&p.texels[file.offset(m, f)]);
+			}
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, file.n_mips - 1);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+			gpu_memory::add(gpu_memory::TEXTURE, texture_bytes());
+		}
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		return true;
+	}
+
+	void release() {
+		if (!textures.empty())
+			glDeleteTextures((GLsizei)textures.size(), textures.data());
+		for (size_t i = 0; i < textures.size(); ++i)
+			gpu_memory::remove(gpu_memory::TEXTURE, texture_bytes());
+		textures.clear();
+	}
+
+	void swap(reflection_probes& r) {
+		std::swap(file, r.file);
+		textures.swap(r.textures);
+	}
+
+	// bytes of the cube map of a probe, all levels (a GL_RGB9_E5 texel is 4 bytes)
+	long long texture_bytes() const { return 4ll * file.probe_texels(); }
+
+	// index of the probe nearest to p (-1 if none)
+	int nearest(glm::vec3 p) const {
+		int best = -1;
+		float best_d = 0.f;
+		for (int i = 0; i < (int)file.probes.size(); ++i) {
+			const float* q = file.probes[i].pos;
+			float d = glm::length(p - glm::vec3(q[0], q[1], q[2]));
+			if (best < 0 || d < best_d) {
+				best = i;
+				best_d = d;
+			}
+		}
+		return best;
+	}
+
+	// level of the cube maps for a roughness in [0,1]
+	float lod(float roughness) const { return file.lod(roughness); }
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <functional>
+#include <../../external/glm/glm.hpp>
+#include <../../external/glm/ext.hpp>
+#include "renderable.h"
+#include "shaders.h"
+
+/*
+Queue of the draw calls of a frame, executed sorted to change the GL state as little as
+possible. During the frame the draws are submitted as packets (program, vertex array, set of
+indices, model matrix and color); flush() sorts them by a 64 bit key and executes them,
+calling glUseProgram and glBindVertexArray only when they change:
+	bits 63-60	pass (e.g. opaque, then transparent)
+	bits 59-48	program (the index returned by add_program)
+	bits 47-32	vertex array
+	bits 31-0	depth in [0,1], front to back (back to front in the passes set so)
+so the opaque geometry of the same program and mesh is drawn front to back (the early depth
+test discards the hidden fragments). Packets with the same key are drawn in the order they
+were submitted. The keys are sorted with a radix sort (8 bits at a time, skipping the bytes
+that are the same in all the keys), linear in the number of packets.
+The programs are registered through their shader objects, which the queue keeps a pointer to:
+a shader must outlive the queue, and must not be moved (it can be released and created
+again: when its program changes the uniform locations are looked up again).
+	render_queue q;
+	int p = q.add_program(s, "uM", "uCol");		// once
+	q.set_back_to_front(1);
+	q.on_pass[1] = [] { glEnable(GL_BLEND); glDepthMask(GL_FALSE); };
+	... each frame:
+	q.submit(p, quad, M, color, render_queue::depth(VP, M));
+	q.submit(p, glass, M, color_with_alpha, render_queue::depth(VP, M), 1);
+	q.flush();
+*/
+struct render_queue {
+	static const int N_PASSES = 16;
+
+	struct packet {
+		int program;					// index in programs
+		GLuint vao;
+		renderable::element_array elements;
+		glm::mat4 M;
+		glm::vec4 color;
+	};
+
+	// state changes and draws of the last flush
+	int n_draws = 0, n_program_changes = 0, n_vao_changes = 0;
+
+	// called before the first draw of a pass, to set its state (e.g. blending)
+	std::function<void()> on_pass[N_PASSES];
+
+	// registers the program of s with the names of its model matrix and color uniforms (a vec3
+	// or vec4; empty names for none) and returns its index for submit
+	int add_program(const shader& s, const std::string& matrix_uniform, const std::string& color_uniform) {
+		program p;
+		p.s = &s;
+		p.matrix_uniform = matrix_uniform;
+		p.color_uniform = color_uniform;
+		programs.push_back(p);
+		return (int)programs.size() - 1;
+	}
+
+	// draws of this pass are sorted back to front (e.g. the transparent ones)
+	void set_back_to_front(int pass, bool on = true) {
+		if (on)
+			back_to_front |= 1u << pass;
+		else
+			back_to_front &= ~(1u << pass);
+	}
+
+	// the set of indices i of r, with model matrix M (the position transform of r is applied
+	// here); depth in [0,1], 0 the nearest
+	void submit(int program, const renderable& r, const glm::mat4& M, glm::vec4 color, float depth = 0.f, int pass = 0, int i = 0) {
+		packet p;
+		p.program = program;
+		p.vao = r.vao;
+		p.elements = r.elements[i];
+		p.M = M * r.position_transform;
+		p.color = color;
+		packets.push_back(p);
+		keys.push_back(key(pass, program, r.vao, depth));
+	}
+	void submit(int program, const renderable& r, const glm::mat4& M, glm::vec3 color, float depth = 0.f, int pass = 0, int i = 0) {
+		submit(program, r, M, glm::vec4(color, 1.f), depth, pass, i);
+	}
+
+	// depth of the origin of the model matrix M, in [0,1] for the visible ones
+	static float depth(const glm::mat4& VP, const glm::mat4& M) {
+		glm::vec4 c = VP * M[3];
+		return (c.w > 0.f) ? glm::clamp(0.5f * c.z / c.w + 0.5f, 0.f, 1.f) : 0.f;
+	}
+
+	uint64_t key(int pass, int program, GLuint vao, float depth) const {
+		uint32_t d = (uint32_t)(glm::clamp(depth, 0.f, 1.f) * 4294967295.0);
+		if (back_to_front & (1u << pass))
+			d = ~d;
+		return ((uint64_t)(pass & 0xF) << 60) | ((uint64_t)(program & 0xFFF) << 48) | ((uint64_t)(vao & 0xFFFF) << 32) | d;
+	}
+
+	// sorts the packets, draws them and empties the queue
+	void flush() {
+		n_draws = n_program_changes = n_vao_changes = 0;
+		sort();
+		for (program& pr : programs)
+			if (pr.id != pr.s->program)
+				pr.lookup();
+		int current_program = -1, current_pass = -1;
+		GLuint current_vao = 0;
+		for (size_t k = 0; k < order.size(); ++k) {
+			const packet& p = packets[order[k]];
+			const program& pr = programs[p.program];
+			int pass = (int)(keys[k] >> 60);
+			if (pass != current_pass) {
+				current_pass = pass;
+				if (on_pass[pass])
+					on_pass[pass]();
+			}
+			if (p.program != current_program) {
+				glUseProgram(pr.id);
+				current_program = p.program;
+				++n_program_changes;
+			}
+			if (p.vao != current_vao) {
+				glBindVertexArray(p.vao);
+				current_vao = p.vao;
+				++n_vao_changes;
+			}
+			if (pr.uM != -1)
+				glUniformMatrix4fv(pr.uM, 1, GL_FALSE, &p.M[0][0]);
+			if (pr.uCol != -1) {
+				if (pr.color_type == GL_FLOAT_VEC4)
+					glUniform4fv(pr.uCol, 1, &p.color[0]);
+				else
+					glUniform3fv(pr.uCol, 1, &p.color[0]);
+			}
+			glDrawElements(p.elements.mode, p.elements.count, p.elements.itype, NULL);
+			++n_draws;
+		}
+		glBindVertexArray(0);
+		packets.clear();
+		keys.clear();
+	}
+
+	size_t size() const { return packets.size(); }
+
+private:
+	struct program {
+		const shader* s;
+		std::string matrix_uniform, color_uniform;
+		GLuint id = 0;			// the program of s when the locations were looked up
+		GLint uM = -1, uCol = -1;
+		GLint color_type = GL_FLOAT_VEC3;
+
+		void lookup() {
+			id = s->program;
+			uM = matrix_uniform.empty() ? -1 : glGetUniformLocation(id, matrix_uniform.c_str());
+			uCol = color_uniform.empty() ? -1 : glGetUniformLocation(id, color_uniform.c_str());
+			color_type = GL_FLOAT_VEC3;
+			if (uCol != -1) {
+				const char* name = color_uniform.c_str();
+				GLuint index = GL_INVALID_INDEX;
+				glGetUniformIndices(id, 1, &name, &index);
+				if (index != GL_INVALID_INDEX)
+					glGetActiveUniformsiv(id, 1, &index, GL_UNIFORM_TYPE, &color_type);
+			}
+		}
+	};
+
+	std::vector<program> programs;
+	uint32_t back_to_front = 0;
+	std::vector<packet> packets;
+	std::vector<uint64_t> keys, keys_tmp;
+	std::vector<uint32_t> order, order_tmp;	// indices of the packets, sorted by key
+
+	// LSD radix sort of the keys (stable), carrying the packet indices along
+	void sort() {
+		size_t n = keys.size();
+		order.resize(n);
+		order_tmp.resize(n);
+		keys_tmp.resize(n);
+		for (size_t i = 0; i < n; ++i)
+			order[i] = (uint32_t)i;
+		uint32_t count[8][256];
+		memset(count, 0, sizeof(count));
+		for (uint64_t k : keys)
+			for (int b = 0; b < 8; ++b)
+				++count[b][(k >> (8 * b)) & 0xFF];
+		for (int b = 0; b < 8; ++b) {
+			uint32_t* c = count[b];
+			if (n == 0 || c[(keys[0] >> (8 * b)) & 0xFF] == n)
+				continue;	// the same byte in all the keys
+			uint32_t sum = 0;
+			for (int d = 0; d < 256; ++d) {
+				uint32_t t = c[d];
+				c[d] = sum;
+				sum += t;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				uint32_t dst = c[(keys[i] >> (8 * b)) & 0xFF]++;
+				keys_tmp[dst] = keys[i];
+				order_tmp[dst] = order[i];
+			}
+			keys.swap(keys_tmp);
+			order.swap(order_tmp);
+		}
+	}
+};
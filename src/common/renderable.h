@@ -1,13 +1,52 @@
 #pragma once
 #include <glad/glad.h>
 #include <vector>
+#include <../../external/glm/glm.hpp>
+#include "gpu_memory.h"
+
+/* encodings of the attributes of a vertex in an interleaved buffer (see shape::to_renderable).
+*  The compact ones trade precision for bandwidth (each decoded component differs at most by):
+*  POS_HALF:		half floats, |error| <= |x| / 2048 (relative, 11 bit mantissa), range +-65504
+*  POS_SNORM16:		16 bit integers in the bounding cube of the shape, |error| <= half size / 65534,
+*					decoded by renderable::position_transform
+*  COL_RGBA8:		8 bit per channel in [0,1], |error| <= 1 / 510
+*  NORM_INT_2_10_10_10: 10 bit per component in [-1,1], |error| <= 1 / 511
+*  Fully compact a vertex takes 16 bytes instead of 36.
+*/
+struct vertex_format {
+	enum position_encoding { POS_FLOAT, POS_HALF, POS_SNORM16 };
+	enum color_encoding { COL_FLOAT, COL_RGBA8 };
+	enum normal_encoding { NORM_FLOAT, NORM_INT_2_10_10_10 };
+
+	position_encoding position = POS_FLOAT;
+	color_encoding color = COL_FLOAT;
+	normal_encoding normal = NORM_FLOAT;
+
+	static vertex_format compact() { return vertex_format{ POS_SNORM16, COL_RGBA8, NORM_INT_2_10_10_10 }; }
+
+	// bytes of a vertex with all three attributes
+	unsigned int size() const {
+		return ((position == POS_FLOAT) ? 12 : 8) + ((color == COL_FLOAT) ? 12 : 4) + ((normal == NORM_FLOAT) ? 12 : 4);
+	}
+};
 
+/* a renderable owns its vertex array and the buffers it creates, and deletes them when it is
+*  destroyed (or with release(), which must be called while the GL context is still alive if
+*  the renderable outlives it). It can be moved but not copied.
+*/
 struct renderable {
 
-	renderable() :vao(-1) {}
+	renderable() :vao(0) {}
+	renderable(const renderable&) = delete;
+	renderable& operator=(const renderable&) = delete;
+	renderable(renderable&& r) noexcept :vao(0) { swap(r); }
+	renderable& operator=(renderable&& r) noexcept { swap(r); return *this; }	// r deletes what this had
+	~renderable() { release(); }
+
 	struct element_array {
-		element_array():ind(0), mode(0), count(0), itype(GL_UNSIGNED_INT){}
+		element_array():ind(0), mode(0), count(0), itype(GL_UNSIGNED_INT), bytes(0){}
 		GLuint ind, mode, count, itype;
+		GLsizeiptr bytes;
 	};
 
 	// vertex array object
@@ -15,12 +54,55 @@ struct renderable {
 
 	// vertex buffer objects
 	std::vector<GLuint> vbos;
+	std::vector<GLsizeiptr> vbo_bytes;	// size of each of vbos, -1 for those not created here
 
 	// vector of element array (indices)
 	std::vector<element_array > elements;
 
+	// to apply to the positions before the model matrix (not the identity for quantized positions)
+	glm::mat4 position_transform = glm::mat4(1.f);
+
+	// an attribute of an interleaved vertex buffer
+	struct attribute {
+		unsigned int index, num_components, type;
+		bool normalized;		// integers are mapped to [0,1] (unsigned) or [-1,1] (signed)
+		unsigned int offset;	// bytes from the start of the vertex
+	};
+
 	void create() {
+		release();
 		glGenVertexArrays(1, &vao);
+		gpu_memory::add_vertex_arrays(1);
+	}
+
+	// deletes the vertex array and the buffers
+	void release() {
+		for (size_t i = 0; i < vbos.size(); ++i)
+			if (vbo_bytes[i] >= 0) {
+				glDeleteBuffers(1, &vbos[i]);
+				gpu_memory::remove(gpu_memory::VERTEX_BUFFER, vbo_bytes[i]);
+			}
+		for (element_array& e : elements) {
+			glDeleteBuffers(1, &e.ind);
+			gpu_memory::remove(gpu_memory::INDEX_BUFFER, e.bytes);
+		}
+		if (vao) {
+			glDeleteVertexArrays(1, &vao);
+			gpu_memory::add_vertex_arrays(-1);
+		}
+		vao = 0;
+		vbos.clear();
+		vbo_bytes.clear();
+		elements.clear();
+		position_transform = glm::mat4(1.f);
+	}
+
+	void swap(renderable& r) {
+		std::swap(vao, r.vao);
+		vbos.swap(r.vbos);
+		vbo_bytes.swap(r.vbo_bytes);
+		elements.swap(r.elements);
+		std::swap(position_transform, r.position_transform);
 	}
 
 	void bind() {
@@ -36,8 +118,9 @@ struct renderable {
 
 		glBindVertexArray(vao);
 
-		/* create a buffer for the render data in video RAM */
+		/* use a buffer created elsewhere (it is not deleted by this renderable) */
 		vbos.push_back(va_id);
+		vbo_bytes.push_back(-1);
 		
 		glBindBuffer(GL_ARRAY_BUFFER, vbos.back());
 		glEnableVertexAttribArray(attribute_index);
@@ -62,12 +145,14 @@ struct renderable {
 
 		/* create a buffer for the render data in video RAM */
 		vbos.push_back(0);
+		vbo_bytes.push_back(sizeof(T) * count);
 		glGenBuffers(1, &vbos.back());
 
 		glBindBuffer(GL_ARRAY_BUFFER, vbos.back());
 
 		/* declare what data in RAM are filling the buffering video RAM */
 		glBufferData(GL_ARRAY_BUFFER, sizeof(T) * count, values, GL_STATIC_DRAW);
+		gpu_memory::add(gpu_memory::VERTEX_BUFFER, vbo_bytes.back());
 		glEnableVertexAttribArray(attribute_index);
 
 		/* specify the data format */
@@ -77,6 +162,30 @@ struct renderable {
 		return vbos.back();
 	}
 
+	/* one buffer with all the attributes of each vertex one after the other, stride bytes per
+	*  vertex, so that a vertex is fetched with a single read
+	*/
+	GLuint add_interleaved_vertex_attributes(const void* data, unsigned int n_vertices, unsigned int stride,
+		const std::vector<attribute>& attributes) {
+
+		glBindVertexArray(vao);
+
+		vbos.push_back(0);
+		vbo_bytes.push_back((GLsizeiptr)n_vertices * stride);
+		glGenBuffers(1, &vbos.back());
+		glBindBuffer(GL_ARRAY_BUFFER, vbos.back());
+		glBufferData(GL_ARRAY_BUFFER, vbo_bytes.back(), data, GL_STATIC_DRAW);
+		gpu_memory::add(gpu_memory::VERTEX_BUFFER, vbo_bytes.back());
+
+		for (const attribute& a : attributes) {
+			glEnableVertexAttribArray(a.index);
+			glVertexAttribPointer(a.index, a.num_components, a.type, a.normalized, stride, (void*)(size_t)a.offset);
+		}
+
+		glBindVertexArray(0);
+		return vbos.back();
+	}
+
 	template <class T>
 	GLuint add_vertex_attribute(const T* values, unsigned int count,
 		unsigned int attribute_index,
@@ -96,6 +205,8 @@ struct renderable {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elements.back().ind);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(IND_TYPE) * count, indices, GL_STATIC_DRAW);
 		glBindVertexArray(NULL);
+		elements.back().bytes = sizeof(IND_TYPE) * count;
+		gpu_memory::add(gpu_memory::INDEX_BUFFER, elements.back().bytes);
 		elements.back().mode = mode;
 		elements.back().count = count;
 		elements.back().itype = type_to_GL<IND_TYPE>();
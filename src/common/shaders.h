@@ -9,6 +9,7 @@
 #include <fstream>
 #include <regex>
 #include "../common/debugging.h"
+#include "gpu_memory.h"
 
 template <typename... Args>
 std::vector<std::string> join(Args... args) {
@@ -17,8 +18,41 @@ std::vector<std::string> join(Args... args) {
 	return vec;
 }
 
+/* a shader owns its program and its shaders, and deletes them when it is destroyed (or with
+*  release(), which must be called while the GL context is still alive if the shader outlives
+*  it). It can be moved but not copied.
+*/
 struct shader {
-	GLuint   vertex_shader, fragment_shader, program;
+	GLuint   vertex_shader = 0, fragment_shader = 0, program = 0;
+
+	shader() {}
+	shader(const shader&) = delete;
+	shader& operator=(const shader&) = delete;
+	shader(shader&& s) noexcept { swap(s); }
+	shader& operator=(shader&& s) noexcept { swap(s); return *this; }	// s deletes what this had
+	~shader() { release(); }
+
+	void release() {
+		if (program) {
+			glDeleteProgram(program);
+			gpu_memory::add_programs(-1);
+		}
+		for (GLuint s : { vertex_shader, fragment_shader })
+			if (s) {
+				glDeleteShader(s);
+				gpu_memory::add_shaders(-1);
+			}
+		vertex_shader = fragment_shader = program = 0;
+		uni.clear();
+	}
+
+	void swap(shader& s) {
+		std::swap(vertex_shader, s.vertex_shader);
+		std::swap(fragment_shader, s.fragment_shader);
+		std::swap(program, s.program);
+		uni.swap(s.uni);
+		att.swap(s.att);
+	}
 
 	std::map<std::string, int> uni;
 	std::vector<std::pair<unsigned int,std::string>> att;
@@ -89,10 +123,12 @@ struct shader {
 	}
 	void  create_program(std::string vertex_shader_src_code, std::string fragment_shader_src_code) {
 
+		release();
 		create_shader(vertex_shader_src_code.c_str(), GL_VERTEX_SHADER);
 		create_shader(fragment_shader_src_code.c_str(), GL_FRAGMENT_SHADER);
 
 		program = glCreateProgram();
+		gpu_memory::add_programs(1);
 		glAttachShader(program, vertex_shader);
 		glAttachShader(program, fragment_shader);
 
@@ -128,6 +164,7 @@ private:
 		case GL_FRAGMENT_SHADER: s = fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);break;
 		}
 
+		gpu_memory::add_shaders(1);
 		glShaderSource(s, 1, &src, NULL);
 		glCompileShader(s);
 		int status;
@@ -1,5 +1,8 @@
 #pragma once
 #include <vector>
+#include <cstring>
+#include <cfloat>
+#include <algorithm>
 #include "renderable.h"
 #include <../../external/glm/ext.hpp>  
 #include <../../glm/gtx/string_cast.hpp>
@@ -72,6 +75,130 @@ public:
 			r.add_indices<GLuint>(&indices_edges[0], (unsigned int)indices_edges.size(), GL_LINES);
 	}
 
+	// largest difference between an attribute and what is decoded from its encoding
+	struct encoding_error {
+		float position = 0.f, color = 0.f, normal = 0.f;
+	};
+
+	/* same attributes and indices, but in one interleaved buffer with the encodings of f
+	*  (see vertex_format). Returns the error made by the encodings
+	*/
+	encoding_error to_renderable(renderable& r, vertex_format f) {
+		std::vector<unsigned char> data;
+		std::vector<renderable::attribute> atts;
+		r.create();	// before encode, create() resets position_transform
+		encoding_error err = encode(f, false, data, atts, r.position_transform);
+
+		r.add_interleaved_vertex_attributes(data.data(), vn, (unsigned int)data.size() / std::max(1u, vn), atts);
+
+		if (!indices_triangles.empty())
+			r.add_indices<GLuint>(&indices_triangles[0], (unsigned int)indices_triangles.size(), GL_TRIANGLES);
+
+		if (!indices_edges.empty())
+			r.add_indices<GLuint>(&indices_edges[0], (unsigned int)indices_edges.size(), GL_LINES);
+		return err;
+	}
+
+	/* appends to data the vertices encoded as in f, and returns in atts the layout of a vertex
+	*  and in position_transform the decoding of the positions.
+	*  With all_attributes the layout is the same for every shape: colors (gray) and normals
+	*  (+z) are written also when the shape has none
+	*/
+	encoding_error encode(vertex_format f, bool all_attributes, std::vector<unsigned char>& data,
+		std::vector<renderable::attribute>& atts, glm::mat4& position_transform) const {
+		encoding_error err;
+		bool has_colors = colors.size() >= 3 * vn, has_normals = normals.size() >= 3 * vn;
+		unsigned int pos_size = (f.position == vertex_format::POS_FLOAT) ? 12 : 8;
+		unsigned int col_size = (!has_colors && !all_attributes) ? 0 : (f.color == vertex_format::COL_FLOAT) ? 12 : 4;
+		unsigned int nor_size = (!has_normals && !all_attributes) ? 0 : (f.normal == vertex_format::NORM_FLOAT) ? 12 : 4;
+		unsigned int stride = pos_size + col_size + nor_size;
+		atts.clear();
+
+		// quantized positions are in the bounding cube, mapped to [-1,1]^3
+		glm::vec3 center(0.f);
+		float half = 1.f;
+		position_transform = glm::mat4(1.f);
+		if (f.position == vertex_format::POS_SNORM16 && vn > 0) {
+			glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+			for (unsigned int i = 0; i < vn; ++i) {
+				bmin = glm::min(bmin, get_pos(i));
+				bmax = glm::max(bmax, get_pos(i));
+			}
+			center = (bmin + bmax) * 0.5f;
+			half = glm::max(glm::max(bmax.x - bmin.x, bmax.y - bmin.y), bmax.z - bmin.z) * 0.5f;
+			if (half <= 0.f)
+				half = 1.f;
+			position_transform = glm::scale(glm::translate(glm::mat4(1.f), center), glm::vec3(half));
+		}
+		switch (f.position) {
+		case vertex_format::POS_FLOAT: atts.push_back({ 0, 3, GL_FLOAT, false, 0 }); break;
+		case vertex_format::POS_HALF: atts.push_back({ 0, 3, GL_HALF_FLOAT, false, 0 }); break;
+		case vertex_format::POS_SNORM16: atts.push_back({ 0, 3, GL_SHORT, true, 0 }); break;
+		}
+		if (col_size)
+			atts.push_back((f.color == vertex_format::COL_FLOAT) ? renderable::attribute{ 1, 3, GL_FLOAT, false, pos_size }
+				: renderable::attribute{ 1, 4, GL_UNSIGNED_BYTE, true, pos_size });
+		if (nor_size)
+			atts.push_back((f.normal == vertex_format::NORM_FLOAT) ? renderable::attribute{ 2, 3, GL_FLOAT, false, pos_size + col_size }
+				: renderable::attribute{ 2, 4, GL_INT_2_10_10_10_REV, true, pos_size + col_size });
+
+		size_t first = data.size();
+		data.resize(first + (size_t)stride * vn);
+		for (unsigned int i = 0; i < vn; ++i) {
+			unsigned char* v = &data[first + (size_t)i * stride];
+			glm::vec3 p = get_pos(i), dp;
+			if (f.position == vertex_format::POS_FLOAT) {
+				memcpy(v, &p, 12);
+				dp = p;
+			}
+			else if (f.position == vertex_format::POS_HALF) {
+				glm::uint64 h = glm::packHalf4x16(glm::vec4(p, 1.f));
+				memcpy(v, &h, 8);
+				dp = glm::vec3(glm::unpackHalf4x16(h));
+			}
+			else {
+				glm::uint64 q = glm::packSnorm4x16(glm::vec4((p - center) / half, 1.f));
+				memcpy(v, &q, 8);
+				dp = glm::vec3(glm::unpackSnorm4x16(q)) * half + center;
+			}
+			glm::vec3 d = glm::abs(dp - p);
+			err.position = glm::max(err.position, glm::max(glm::max(d.x, d.y), d.z));
+			v += pos_size;
+
+			if (col_size) {
+				glm::vec3 c = has_colors ? glm::vec3(colors[3 * i], colors[3 * i + 1], colors[3 * i + 2]) : glm::vec3(0.5f), dc;
+				if (f.color == vertex_format::COL_FLOAT) {
+					memcpy(v, &c, 12);
+					dc = c;
+				}
+				else {
+					glm::uint32 q = glm::packUnorm4x8(glm::vec4(c, 1.f));
+					memcpy(v, &q, 4);
+					dc = glm::vec3(glm::unpackUnorm4x8(q));
+				}
+				glm::vec3 d = glm::abs(c - dc);
+				err.color = glm::max(err.color, glm::max(glm::max(d.x, d.y), d.z));
+				v += col_size;
+			}
+
+			if (nor_size) {
+				glm::vec3 n = has_normals ? glm::vec3(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]) : glm::vec3(0.f, 0.f, 1.f), dn;
+				if (f.normal == vertex_format::NORM_FLOAT) {
+					memcpy(v, &n, 12);
+					dn = n;
+				}
+				else {
+					glm::uint32 q = glm::packSnorm3x10_1x2(glm::vec4(n, 0.f));
+					memcpy(v, &q, 4);
+					dn = glm::vec3(glm::unpackSnorm3x10_1x2(q));
+				}
+				glm::vec3 d = glm::abs(n - dn);
+				err.normal = glm::max(err.normal, glm::max(glm::max(d.x, d.y), d.z));
+			}
+		}
+		return err;
+	}
+
 
 };
 
@@ -329,14 +456,18 @@ struct shape_maker {
 		return res;
 	}
 
-	static renderable quad() {
-		shape s;
-		renderable r;
+	static void quad(shape& s) {
 		s.positions = { -1,-1,0,  1,-1,0, 1,1,0, -1,1,0 };
 		s.normals = { 0,0,1, 0,0,1, 0,0,1, 0,0,1 };
 		s.indices_triangles = { 0,1,2, 0,2,3 };
 		s.vn = 4;
 		s.fn = 2;
+	}
+
+	static renderable quad() {
+		shape s;
+		renderable r;
+		quad(s);
 		s.to_renderable(r);
 		return r;
 	}
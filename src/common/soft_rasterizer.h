@@ -0,0 +1,338 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <../../external/glm/glm.hpp>
+#include "simple_shapes.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFT_RASTER_SSE2
+#endif
+
+/*
+CPU rasterizer for the triangles of a shape, to render the examples without a GPU (e.g.
+on machines with no driver, or to produce frames headless).
+draw() does what the vertex shader of the examples does: it transforms the vertices by a
+matrix (gl_Position = M * position, e.g. with M = matrix_stack::m()), clips against the near
+plane, and keeps the triangles with the uniform color of the draw (as uCol) or with the
+colors of the shape. flush() then:
+ - bins the triangles into TILE x TILE tiles of the screen,
+ - rasterizes the tiles in parallel (each tile owns its pixels, and draws its triangles in
+   the order they were drawn, so the result does not depend on the threads),
+ - inside a tile, visits the BLOCK x BLOCK blocks overlapped by a triangle, skipping those
+   outside an edge or, with the depth test, whose farthest depth is nearer than the
+   triangle (hierarchical z), and evaluates the edge functions 4 pixels at a time (SSE2).
+The fill rule is the top-left rule of GL, depth is GL_LESS on window z in [0,1], colors are
+interpolated with perspective correction. The color buffer is RGBA8, bottom row first,
+as glReadPixels returns it.
+*/
+struct soft_rasterizer {
+	static const int TILE = 64;
+	static const int BLOCK = 8;
+
+	soft_rasterizer(int _w, int _h) :w(_w), h(_h), color(_w * _h, 0), depth(_w * _h, 1.f) {
+		tiles_x = (w + TILE - 1) / TILE;
+		tiles_y = (h + TILE - 1) / TILE;
+		blocks_x = (w + BLOCK - 1) / BLOCK;
+		block_zmax.assign(blocks_x * ((h + BLOCK - 1) / BLOCK), 1.f);
+		bins.resize(tiles_x * tiles_y);
+	}
+
+	int w, h;
+	std::vector<uint32_t> color;	// RGBA8
+	std::vector<float> depth;
+	bool depth_test = false;		// as glEnable(GL_DEPTH_TEST), applies to the next draws
+	int n_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	void clear(glm::vec4 c, float d = 1.f) {
+		flush();
+		std::fill(color.begin(), color.end(), pack(glm::vec3(c), c.a));
+		std::fill(depth.begin(), depth.end(), d);
+		std::fill(block_zmax.begin(), block_zmax.end(), d);
+	}
+
+	// the triangles of s transformed by M, with color col
+	void draw(const shape& s, const glm::mat4& M, glm::vec3 col) {
+		draw(s, M, &col);
+	}
+
+	// the triangles of s transformed by M, with the colors of the shape (gray if it has none)
+	void draw(const shape& s, const glm::mat4& M) {
+		draw(s, M, 0);
+	}
+
+	// rasterizes the triangles drawn so far
+	void flush() {
+		if (tris.empty())
+			return;
+		for (auto& b : bins)
+			b.clear();
+		for (int t = 0; t < (int)tris.size(); ++t) {
+			const tri& tr = tris[t];
+			for (int ty = tr.bb[1] / TILE; ty <= tr.bb[3] / TILE; ++ty)
+				for (int tx = tr.bb[0] / TILE; tx <= tr.bb[2] / TILE; ++tx)
+					bins[ty * tiles_x + tx].push_back(t);
+		}
+		std::atomic<int> next(0);
+		auto work = [&]() {
+			for (int t = next++; t < tiles_x * tiles_y; t = next++)
+				raster_tile(t);
+		};
+		std::vector<std::thread> threads;
+		for (int t = 1; t < std::min(n_threads, tiles_x * tiles_y); ++t)
+			threads.push_back(std::thread(work));
+		work();
+		for (std::thread& t : threads)
+			t.join();
+		tris.clear();
+	}
+
+	// binary PPM, top row first
+	bool save_ppm(const char* filename) {
+		flush();
+		FILE* f = fopen(filename, "wb");
+		if (!f)
+			return false;
+		fprintf(f, "P6\n%d %d\n255\n", w, h);
+		std::vector<unsigned char> row(w * 3);
+		for (int j = h - 1; j >= 0; --j) {
+			for (int i = 0; i < w; ++i)
+				for (int k = 0; k < 3; ++k)
+					row[i * 3 + k] = (color[j * w + i] >> (8 * k)) & 255;
+			fwrite(row.data(), 1, row.size(), f);
+		}
+		bool ok = !ferror(f);
+		fclose(f);
+		return ok;
+	}
+
+private:
+	struct vertex {
+		glm::vec4 p;	// clip space
+		glm::vec3 c;
+	};
+
+	// a triangle ready for rasterization: the edge functions and the planes of the attributes,
+	// all as a * x + b * y + c in window coordinates
+	struct tri {
+		float e[3][3];		// edge functions, > 0 inside
+		bool top_left[3];	// pixels exactly on the edge are inside
+		float z[3], iw[3], cw[3][3];	// window z, 1/w, color/w
+		float zmin;
+		int bb[4];			// pixels: min x, min y, max x, max y
+		bool depth_test;
+	};
+
+	int tiles_x, tiles_y, blocks_x;
+	std::vector<float> block_zmax;	// farthest depth in each block (hierarchical z)
+	std::vector<tri> tris;
+	std::vector<std::vector<int>> bins;
+
+	static uint32_t pack(glm::vec3 c, float a = 1.f) {
+		glm::vec4 v = glm::clamp(glm::vec4(c, a), 0.f, 1.f) * 255.f + 0.5f;
+		return uint32_t(v.r) | uint32_t(v.g) << 8 | uint32_t(v.b) << 16 | uint32_t(v.a) << 24;
+	}
+
+	void draw(const shape& s, const glm::mat4& M, const glm::vec3* col) {
+		std::vector<vertex> v(s.vn);
+		for (unsigned int i = 0; i < s.vn; ++i) {
+			v[i].p = M * glm::vec4(s.get_pos(i), 1.f);
+			v[i].c = col ? *col : (s.colors.size() >= 3 * (i + 1)) ? glm::vec3(s.colors[3 * i], s.colors[3 * i + 1], s.colors[3 * i + 2]) : glm::vec3(0.5f);
+		}
+		for (size_t i = 0; i + 2 < s.indices_triangles.size(); i += 3) {
+			const unsigned int* t = &s.indices_triangles[i];
+			clip_and_add(v[t[0]], v[t[1]], v[t[2]]);
+		}
+	}
+
+	// clips against the near plane (z >= -w) and adds the resulting triangles
+	void clip_and_add(const vertex& a, const vertex& b, const vertex& c) {
+		const vertex in[3] = { a, b, c };
+		vertex out[4];
+		int n = 0;
+		for (int k = 0; k < 3; ++k) {
+			const vertex& p = in[k], & q = in[(k + 1) % 3];
+			float dp = p.p.z + p.p.w, dq = q.p.z + q.p.w;
+			if (dp >= 0.f)
+				out[n++] = p;
+			if ((dp >= 0.f) != (dq >= 0.f)) {
+				float t = dp / (dp - dq);
+				out[n++] = vertex{ p.p + (q.p - p.p) * t, p.c + (q.c - p.c) * t };
+			}
+		}
+		for (int k = 1; k + 1 < n; ++k)
+			setup(out[0], out[k], out[k + 1]);
+	}
+
+	void setup(const vertex& a, const vertex& b, const vertex& c) {
+		const vertex* v[3] = { &a, &b, &c };
+		float x[3], y[3];
+		tri t;
+		for (int k = 0; k < 3; ++k) {
+			float iw = 1.f / v[k]->p.w;
+			x[k] = (v[k]->p.x * iw + 1.f) * 0.5f * w;
+			y[k] = (v[k]->p.y * iw + 1.f) * 0.5f * h;
+			t.z[k] = (v[k]->p.z * iw + 1.f) * 0.5f;
+			t.iw[k] = iw;
+		}
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if (area == 0.f || !std::isfinite(area))
+			return;
+		if (area < 0.f) {	// no culling: make it counterclockwise
+			std::swap(x[1], x[2]);
+			std::swap(y[1], y[2]);
+			std::swap(t.z[1], t.z[2]);
+			std::swap(t.iw[1], t.iw[2]);
+			std::swap(v[1], v[2]);
+			area = -area;
+		}
+		float xmin = std::min(x[0], std::min(x[1], x[2])), xmax = std::max(x[0], std::max(x[1], x[2]));
+		float ymin = std::min(y[0], std::min(y[1], y[2])), ymax = std::max(y[0], std::max(y[1], y[2]));
+		t.bb[0] = std::max(0, (int)floor(xmin));
+		t.bb[1] = std::max(0, (int)floor(ymin));
+		t.bb[2] = std::min(w - 1, (int)ceil(xmax));
+		t.bb[3] = std::min(h - 1, (int)ceil(ymax));
+		if (t.bb[0] > t.bb[2] || t.bb[1] > t.bb[3])
+			return;
+
+		// edge k is opposite to vertex k, and is its barycentric coordinate times area
+		float attr[5][3];
+		for (int k = 0; k < 3; ++k) {
+			int i = (k + 1) % 3, j = (k + 2) % 3;
+			float A = -(y[j] - y[i]), B = x[j] - x[i];
+			t.e[k][0] = A;
+			t.e[k][1] = B;
+			t.e[k][2] = -(A * x[i] + B * y[i]);
+			t.top_left[k] = A > 0.f || (A == 0.f && B < 0.f);
+			attr[0][k] = t.z[k];
+			attr[1][k] = t.iw[k];
+			for (int c = 0; c < 3; ++c)
+				attr[2 + c][k] = v[k]->c[c] * t.iw[k];
+		}
+		// planes of the attributes: sum over k of attr_k * e_k / area
+		float plane[5][3];
+		for (int a = 0; a < 5; ++a)
+			for (int c = 0; c < 3; ++c)
+				plane[a][c] = (attr[a][0] * t.e[0][c] + attr[a][1] * t.e[1][c] + attr[a][2] * t.e[2][c]) / area;
+		t.zmin = std::min(t.z[0], std::min(t.z[1], t.z[2]));
+		for (int c = 0; c < 3; ++c) {
+			t.z[c] = plane[0][c];
+			t.iw[c] = plane[1][c];
+			for (int k = 0; k < 3; ++k)
+				t.cw[k][c] = plane[2 + k][c];
+		}
+		t.depth_test = depth_test;
+		tris.push_back(t);
+	}
+
+	void raster_tile(int tile) {
+		int x0 = (tile % tiles_x) * TILE, y0 = (tile / tiles_x) * TILE;
+		int x1 = std::min(x0 + TILE, w) - 1, y1 = std::min(y0 + TILE, h) - 1;
+		for (int ti : bins[tile]) {
+			const tri& t = tris[ti];
+			int bx0 = std::max(x0, t.bb[0]) / BLOCK, bx1 = std::min(x1, t.bb[2]) / BLOCK;
+			int by0 = std::max(y0, t.bb[1]) / BLOCK, by1 = std::min(y1, t.bb[3]) / BLOCK;
+			for (int by = by0; by <= by1; ++by)
+				for (int bx = bx0; bx <= bx1; ++bx) {
+					float& zmax = block_zmax[by * blocks_x + bx];
+					if (t.depth_test && t.zmin >= zmax)
+						continue;	// hierarchical z: everything in the block is nearer
+					if (outside_block(t, bx * BLOCK, by * BLOCK))
+						continue;
+					if (raster_block(t, bx * BLOCK, by * BLOCK))
+						update_zmax(bx, by, zmax);
+				}
+		}
+	}
+
+	// is the block with corner (px, py) outside one of the edges?
+	static bool outside_block(const tri& t, int px, int py) {
+		for (int k = 0; k < 3; ++k) {
+			const float* e = t.e[k];
+			// the corner of the block (pixel centers) where the edge function is largest
+			float x = px + 0.5f + ((e[0] > 0.f) ? BLOCK - 1 : 0), y = py + 0.5f + ((e[1] > 0.f) ? BLOCK - 1 : 0);
+			if (e[0] * x + e[1] * y + e[2] < 0.f)
+				return true;
+		}
+		return false;
+	}
+
+	void update_zmax(int bx, int by, float& zmax) const {
+		int i1 = std::min((bx + 1) * BLOCK, w), j1 = std::min((by + 1) * BLOCK, h);
+		float m = 0.f;
+		for (int j = by * BLOCK; j < j1; ++j)
+			for (int i = bx * BLOCK; i < i1; ++i)
+				m = std::max(m, depth[j * w + i]);
+		zmax = m;
+	}
+
+	// writes the pixel (i, j) covered by t at window depth z, if it passes the depth test
+	void shade(const tri& t, int i, int j, float z) {
+		float* d = &depth[j * w + i];
+		if (t.depth_test) {
+			if (!(z < *d))
+				return;
+			*d = z;
+		}
+		float x = i + 0.5f, y = j + 0.5f;
+		float iw = t.iw[0] * x + t.iw[1] * y + t.iw[2];
+		glm::vec3 c;
+		for (int k = 0; k < 3; ++k)
+			c[k] = (t.cw[k][0] * x + t.cw[k][1] * y + t.cw[k][2]) / iw;
+		color[j * w + i] = pack(c);
+	}
+
+	// rasterizes t in the block with corner (px, py). Returns true if some depth was written
+	bool raster_block(const tri& t, int px, int py) {
+		int i1 = std::min(px + BLOCK, w), j1 = std::min(py + BLOCK, h);
+		bool written = false;
+		for (int j = py; j < j1; ++j) {
+			float y = j + 0.5f;
+			int i = px;
+#ifdef SOFT_RASTER_SSE2
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 offs = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			for (; i + 4 <= i1; i += 4) {
+				__m128 x = _mm_add_ps(_mm_set1_ps((float)i), offs);
+				__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+				for (int k = 0; k < 3; ++k) {
+					__m128 e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.e[k][0]), x), _mm_set1_ps(t.e[k][1] * y + t.e[k][2]));
+					inside = _mm_and_ps(inside, t.top_left[k] ? _mm_cmpge_ps(e, zero) : _mm_cmpgt_ps(e, zero));
+				}
+				__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.z[0]), x), _mm_set1_ps(t.z[1] * y + t.z[2]));
+				inside = _mm_and_ps(inside, _mm_cmple_ps(z, _mm_set1_ps(1.f)));	// far plane
+				if (t.depth_test)
+					inside = _mm_and_ps(inside, _mm_cmplt_ps(z, _mm_loadu_ps(&depth[j * w + i])));
+				int mask = _mm_movemask_ps(inside);
+				if (!mask)
+					continue;
+				float zs[4];
+				_mm_storeu_ps(zs, z);
+				for (int l = 0; l < 4; ++l)
+					if (mask & (1 << l))
+						shade(t, i + l, j, zs[l]);
+				written |= t.depth_test;
+			}
+#endif
+			for (; i < i1; ++i) {
+				float x = i + 0.5f;
+				bool inside = true;
+				for (int k = 0; k < 3; ++k) {
+					float e = t.e[k][0] * x + t.e[k][1] * y + t.e[k][2];
+					inside = inside && (t.top_left[k] ? e >= 0.f : e > 0.f);
+				}
+				float z = t.z[0] * x + t.z[1] * y + t.z[2];
+				if (inside && z <= 1.f) {
+					shade(t, i, j, z);
+					written |= t.depth_test;
+				}
+			}
+		}
+		return written;
+	}
+};
@@ -0,0 +1,171 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstring>
+#include <vector>
+#include "gpu_memory.h"
+
+/*
+Buffer for the data that changes every frame (vertices, indices, uniforms), so that it is
+not necessary to create buffers with glBufferData each frame.
+The buffer is split in N_REGIONS regions, one per frame in flight: during a frame the data
+is appended to the current region (upload() returns its offset in the buffer), and
+end_frame() puts a fence after the commands that read it. When the ring comes back to a
+region its fence says if the GPU is done with it:
+ - with GL 4.4 the buffer is mapped once, persistently and coherently, and upload() is a
+   memcpy. If the GPU is still reading the region (it is more than N_REGIONS - 1 frames
+   behind) begin_frame() waits for it (counted in n_waits);
+ - with GL 4.1 upload() is a glBufferSubData, and if the GPU is still reading the region the
+   whole buffer is orphaned (glBufferData with NULL, counted in n_orphans): the driver gives
+   new memory and frees the old one when the GPU is done, so the CPU does not wait.
+The same buffer can be bound as GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER or GL_UNIFORM_BUFFER
+at the returned offsets, e.g.:
+	sb.begin_frame();
+	GLintptr v = sb.upload(vertices), u = sb.upload(&block, sizeof(block), sb.uniform_alignment());
+	glBindBuffer(GL_ARRAY_BUFFER, sb.id);
+	glVertexAttribPointer(0, 3, GL_FLOAT, false, 0, (void*)v);
+	glBindBufferRange(GL_UNIFORM_BUFFER, 0, sb.id, u, sizeof(block));
+	... draw ...
+	sb.end_frame();
+It owns the buffer (deleted with release() or when it is destroyed, see renderable), and can
+be moved but not copied.
+*/
+struct stream_buffer {
+	static const int N_REGIONS = 3;
+
+	GLuint id = 0;
+	GLsizeiptr region_size = 0;
+	bool persistent = false;	// mapped with glBufferStorage
+	int n_waits = 0, n_orphans = 0;
+
+	stream_buffer() {}
+	stream_buffer(const stream_buffer&) = delete;
+	stream_buffer& operator=(const stream_buffer&) = delete;
+	stream_buffer(stream_buffer&& b) noexcept { swap(b); }
+	stream_buffer& operator=(stream_buffer&& b) noexcept { swap(b); return *this; }
+	~stream_buffer() { release(); }
+
+	// region_size: bytes available each frame
+	bool create(GLsizeiptr _region_size, bool allow_persistent = true) {
+		release();
+		region_size = _region_size;
+		persistent = allow_persistent && GLAD_GL_VERSION_4_4;
+		glGenBuffers(1, &id);
+		gpu_memory::add(gpu_memory::STREAM_BUFFER, N_REGIONS * region_size);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+		if (persistent) {
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_COPY_WRITE_BUFFER, N_REGIONS * region_size, NULL, flags);
+			mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, N_REGIONS * region_size, flags);
+			if (!mapped)
+				return false;
+		}
+		else
+			glBufferData(GL_COPY_WRITE_BUFFER, N_REGIONS * region_size, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		region = N_REGIONS - 1;
+		head = region_size;
+		return true;
+	}
+
+	void release() {
+		for (GLsync& f : fences)
+			if (f) {
+				glDeleteSync(f);
+				f = 0;
+			}
+		if (id) {
+			if (mapped) {
+				glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+				glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &id);
+			gpu_memory::remove(gpu_memory::STREAM_BUFFER, N_REGIONS * region_size);
+		}
+		id = 0;
+		mapped = 0;
+	}
+
+	void swap(stream_buffer& b) {
+		std::swap(id, b.id);
+		std::swap(region_size, b.region_size);
+		std::swap(persistent, b.persistent);
+		std::swap(n_waits, b.n_waits);
+		std::swap(n_orphans, b.n_orphans);
+		std::swap(mapped, b.mapped);
+		std::swap(region, b.region);
+		std::swap(head, b.head);
+		std::swap(fences, b.fences);
+	}
+
+	// moves to the next region, making sure the GPU is not reading it anymore
+	void begin_frame() {
+		region = (region + 1) % N_REGIONS;
+		head = 0;
+		GLsync& f = fences[region];
+		if (!f)
+			return;
+		GLenum res = glClientWaitSync(f, 0, 0);
+		if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) {
+			if (persistent) {
+				++n_waits;
+				while (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED && res != GL_WAIT_FAILED)
+					res = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			}
+			else {
+				++n_orphans;
+				glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+				glBufferData(GL_COPY_WRITE_BUFFER, N_REGIONS * region_size, NULL, GL_STREAM_DRAW);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+		}
+		glDeleteSync(f);
+		f = 0;
+	}
+
+	// after the commands that read the data of this frame
+	void end_frame() {
+		if (fences[region])
+			glDeleteSync(fences[region]);
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	// copies size bytes in the current region. Returns their offset in the buffer (a multiple
+	// of align), or -1 if the region is full
+	GLintptr upload(const void* data, GLsizeiptr size, GLsizeiptr align = 4) {
+		GLsizeiptr start = (head + align - 1) / align * align;
+		if (start + size > region_size)
+			return -1;
+		GLintptr offset = region * region_size + start;
+		if (persistent)
+			memcpy(mapped + offset, data, size);
+		else {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		head = start + size;
+		return offset;
+	}
+
+	template <class T>
+	GLintptr upload(const std::vector<T>& values, GLsizeiptr align = 4) {
+		return upload(values.data(), sizeof(T) * values.size(), align);
+	}
+
+	// alignment of the offsets for glBindBufferRange(GL_UNIFORM_BUFFER, ...)
+	static GLsizeiptr uniform_alignment() {
+		GLint a = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &a);
+		return a;
+	}
+
+	// bytes used in the current region
+	GLsizeiptr used() const { return head; }
+
+private:
+	unsigned char* mapped = 0;
+	int region = 0;
+	GLsizeiptr head = 0;
+	GLsync fences[N_REGIONS] = {};
+};
@@ -0,0 +1,233 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <../../external/glm/glm.hpp>
+#include "simple_shapes.h"
+
+/*
+Bounding volume hierarchy over the triangles of one or more shapes, answering occlusion
+queries (is there anything along this segment?).
+It is built top down with the binned surface area heuristic: at each node the centroids
+are sorted into a few bins along the longest axis and the split between bins with the
+smallest cost  area(left)*n(left) + area(right)*n(right)  is taken.
+The triangles are copied in leaf order as (v0, e1 = v1-v0, e2 = v2-v0), so a leaf is a
+contiguous run of memory and the queries do not touch the shapes anymore.
+*/
+struct triangle_bvh {
+	struct node {
+		glm::vec3 bmin;
+		int first;		// leaf: first triangle. Inner node: index of the left child (right = left+1)
+		glm::vec3 bmax;
+		int count;		// number of triangles (0 for inner nodes)
+	};
+	struct triangle {
+		glm::vec3 v0, e1, e2;
+	};
+
+	std::vector<node> nodes;
+	std::vector<triangle> triangles;
+
+	// add the triangles of s (positions must be in the same frame for all the shapes added)
+	void add(const shape& s) {
+		for (size_t i = 0; i + 2 < s.indices_triangles.size(); i += 3) {
+			glm::vec3 v0 = s.get_pos(s.indices_triangles[i]);
+			glm::vec3 v1 = s.get_pos(s.indices_triangles[i + 1]);
+			glm::vec3 v2 = s.get_pos(s.indices_triangles[i + 2]);
+			triangles.push_back(triangle{ v0, v1 - v0, v2 - v0 });
+		}
+	}
+
+	void build(int max_leaf_size = 4) {
+		nodes.clear();
+		if (triangles.empty())
+			return;
+		int n = (int)triangles.size();
+		std::vector<build_ref> refs(n);
+		for (int i = 0; i < n; ++i) {
+			const triangle& t = triangles[i];
+			glm::vec3 v1 = t.v0 + t.e1, v2 = t.v0 + t.e2;
+			refs[i].bmin = glm::min(t.v0, glm::min(v1, v2));
+			refs[i].bmax = glm::max(t.v0, glm::max(v1, v2));
+			refs[i].c = (refs[i].bmin + refs[i].bmax) * 0.5f;
+			refs[i].id = i;
+		}
+		nodes.reserve(2 * n / max_leaf_size + 1);
+		nodes.push_back(node());
+		split(0, refs, 0, n, max_leaf_size, 0);
+
+		// reorder the triangles as they appear in the leaves
+		std::vector<triangle> sorted(n);
+		for (int i = 0; i < n; ++i)
+			sorted[i] = triangles[refs[i].id];
+		triangles.swap(sorted);
+	}
+
+	glm::vec3 bbox_min() const { return nodes.empty() ? glm::vec3(0.f) : nodes[0].bmin; }
+	glm::vec3 bbox_max() const { return nodes.empty() ? glm::vec3(0.f) : nodes[0].bmax; }
+
+	// true if the segment orig + t*dir, t in (0, t_max), hits a triangle
+	bool occluded(glm::vec3 orig, glm::vec3 dir, float t_max) const {
+		if (nodes.empty())
+			return false;
+		glm::vec3 inv_dir = 1.f / dir;
+		if (!hit_box(nodes[0], orig, inv_dir, t_max))
+			return false;
+		// the children are tested before being pushed, the nearest one is visited first
+		int stack[128];
+		int sp = 0;
+		int ni = 0;
+		for (;;) {
+			const node& nd = nodes[ni];
+			if (nd.count) {
+				for (int i = nd.first; i < nd.first + nd.count; ++i)
+					if (hit_triangle(triangles[i], orig, dir, t_max))
+						return true;
+			}
+			else {
+				float t0, t1;
+				bool h0 = hit_box(nodes[nd.first], orig, inv_dir, t_max, &t0);
+				bool h1 = hit_box(nodes[nd.first + 1], orig, inv_dir, t_max, &t1);
+				if (h0 && h1) {
+					bool swap = t1 < t0;
+					stack[sp++] = nd.first + !swap;
+					ni = nd.first + swap;
+					continue;
+				}
+				if (h0 || h1) {
+					ni = nd.first + h1;
+					continue;
+				}
+			}
+			if (!sp)
+				return false;
+			ni = stack[--sp];
+		}
+	}
+
+private:
+	struct build_ref {
+		glm::vec3 bmin, bmax, c;
+		int id;
+	};
+
+	static float area(glm::vec3 e) { return e.x * e.y + e.y * e.z + e.z * e.x; }
+
+	void split(int ni, std::vector<build_ref>& refs, int b, int e, int max_leaf_size, int depth) {
+		const int N_BINS = 12;
+		const int MAX_SAH_DEPTH = 64;	// below it only median splits, so the depth stays bounded
+		glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX), cmin(FLT_MAX), cmax(-FLT_MAX);
+		for (int i = b; i < e; ++i) {
+			bmin = glm::min(bmin, refs[i].bmin);
+			bmax = glm::max(bmax, refs[i].bmax);
+			cmin = glm::min(cmin, refs[i].c);
+			cmax = glm::max(cmax, refs[i].c);
+		}
+		nodes[ni].bmin = bmin;
+		nodes[ni].bmax = bmax;
+
+		int axis = 0;
+		glm::vec3 ext = cmax - cmin;
+		if (ext.y > ext[axis]) axis = 1;
+		if (ext.z > ext[axis]) axis = 2;
+
+		int mid = -1;
+		if (e - b > max_leaf_size && ext[axis] > 0.f && depth < MAX_SAH_DEPTH) {
+			// bin the centroids
+			glm::vec3 bin_min[N_BINS], bin_max[N_BINS];
+			int bin_n[N_BINS] = { 0 };
+			for (int k = 0; k < N_BINS; ++k) {
+				bin_min[k] = glm::vec3(FLT_MAX);
+				bin_max[k] = glm::vec3(-FLT_MAX);
+			}
+			float scale = N_BINS / ext[axis];
+			auto bin_of = [&](const build_ref& r) {
+				return std::min(N_BINS - 1, (int)((r.c[axis] - cmin[axis]) * scale));
+			};
+			for (int i = b; i < e; ++i) {
+				int k = bin_of(refs[i]);
+				++bin_n[k];
+				bin_min[k] = glm::min(bin_min[k], refs[i].bmin);
+				bin_max[k] = glm::max(bin_max[k], refs[i].bmax);
+			}
+
+			// sweep from the right, then from the left, to evaluate the cost of every split
+			float right_cost[N_BINS];
+			glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+			int count = 0;
+			for (int k = N_BINS - 1; k > 0; --k) {
+				lo = glm::min(lo, bin_min[k]);
+				hi = glm::max(hi, bin_max[k]);
+				count += bin_n[k];
+				right_cost[k] = count ? area(hi - lo) * count : 0.f;
+			}
+			lo = glm::vec3(FLT_MAX);
+			hi = glm::vec3(-FLT_MAX);
+			count = 0;
+			float best_cost = area(bmax - bmin) * (e - b);	// cost of a leaf
+			int best_k = -1;
+			for (int k = 1; k < N_BINS; ++k) {
+				lo = glm::min(lo, bin_min[k - 1]);
+				hi = glm::max(hi, bin_max[k - 1]);
+				count += bin_n[k - 1];
+				float cost = (count ? area(hi - lo) * count : 0.f) + right_cost[k];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_k = k;
+				}
+			}
+			if (best_k > 0)
+				mid = int(std::partition(refs.begin() + b, refs.begin() + e,
+					[&](const build_ref& r) { return bin_of(r) < best_k; }) - refs.begin());
+		}
+		// too many triangles for a leaf but no (allowed) good split: halve along the axis
+		if ((mid <= b || mid >= e) && e - b > 4 * max_leaf_size) {
+			mid = (b + e) / 2;
+			std::nth_element(refs.begin() + b, refs.begin() + mid, refs.begin() + e,
+				[&](const build_ref& r0, const build_ref& r1) { return r0.c[axis] < r1.c[axis]; });
+		}
+
+		if (mid <= b || mid >= e) {
+			nodes[ni].first = b;
+			nodes[ni].count = e - b;
+			return;
+		}
+		int left = (int)nodes.size();
+		nodes[ni].first = left;
+		nodes[ni].count = 0;
+		nodes.push_back(node());
+		nodes.push_back(node());
+		split(left, refs, b, mid, max_leaf_size, depth + 1);
+		split(left + 1, refs, mid, e, max_leaf_size, depth + 1);
+	}
+
+	static bool hit_box(const node& nd, glm::vec3 o, glm::vec3 inv_dir, float t_max, float* t_entry = NULL) {
+		glm::vec3 t0 = (nd.bmin - o) * inv_dir, t1 = (nd.bmax - o) * inv_dir;
+		glm::vec3 tn = glm::min(t0, t1), tf = glm::max(t0, t1);
+		float t_near = std::max(std::max(tn.x, tn.y), std::max(tn.z, 0.f));
+		float t_far = std::min(std::min(tf.x, tf.y), std::min(tf.z, t_max));
+		if (t_entry)
+			*t_entry = t_near;
+		return t_near <= t_far;
+	}
+
+	// Moller-Trumbore
+	static bool hit_triangle(const triangle& t, glm::vec3 o, glm::vec3 d, float t_max) {
+		glm::vec3 p = glm::cross(d, t.e2);
+		float det = glm::dot(t.e1, p);
+		if (std::fabs(det) < 1e-12f)
+			return false;
+		float inv_det = 1.f / det;
+		glm::vec3 s = o - t.v0;
+		float u = glm::dot(s, p) * inv_det;
+		if (u < 0.f || u > 1.f)
+			return false;
+		glm::vec3 q = glm::cross(s, t.e1);
+		float v = glm::dot(d, q) * inv_det;
+		if (v < 0.f || u + v > 1.f)
+			return false;
+		float tt = glm::dot(t.e2, q) * inv_det;
+		return tt > 0.f && tt < t_max;
+	}
+};